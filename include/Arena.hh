@@ -0,0 +1,149 @@
+/**
+ * @file Arena.hh
+ *
+ * Region-based memory allocation
+ */
+
+#ifndef ARENA_HH
+#define ARENA_HH
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <vector>
+#include <type_traits>
+
+/**
+ * An array in an arena. It does not own its elements, which live until
+ * the arena is reset.
+ */
+template <class T>
+struct ArenaArray {
+    T      *data;
+    size_t count;
+
+    ArenaArray() : data(NULL), count(0) {}
+    ArenaArray(T *data, size_t count) : data(data), count(count) {}
+
+    T *begin() const { return data; }
+    T *end() const { return data + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T &operator[](size_t i) const { return data[i]; }
+};
+
+/**
+ * An arena hands out memory from large blocks by bumping a pointer, and
+ * frees all of it at once. Objects whose lifetimes end together, e.g.
+ * those of a run or of a phase of it, are allocated in the same arena,
+ * and released by reset() or by the arena's destructor, without
+ * individual deletes and without fragmenting the heap.
+ *
+ * reset() keeps the blocks, so that an arena that is reset between
+ * runs, phases or replicates reaches a steady state in which it does not
+ * allocate at all.
+ */
+class Arena {
+public:
+    /**
+     * Constructor
+     * @param blockSize Size of the blocks (bytes). Larger requests get a
+     *                  block of their own.
+     */
+    explicit Arena(size_t blockSize = 64 * 1024);
+    ~Arena();
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    /**
+     * Allocate raw memory
+     * @param size Size (bytes)
+     * @param align Alignment (a power of 2)
+     */
+    void *alloc(size_t size, size_t align = alignof(std::max_align_t));
+
+    /**
+     * Create an object in the arena. Its destructor, unless trivial, is
+     * run by reset() or by the arena's destructor, in reverse order of
+     * creation.
+     * @param args Constructor arguments
+     */
+    template <class T, class... Args>
+    T *make(Args&&... args)
+    {
+        T *obj = new (alloc(sizeof(T), alignof(T)))
+            T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value) {
+            addFinalizer(destroy<T>, obj);
+        }
+        return obj;
+    }
+
+    /**
+     * Allocate an array of trivially copyable elements, zero-filled
+     * @param n Number of elements
+     */
+    template <class T>
+    ArenaArray<T> makeArray(size_t n)
+    {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "ArenaArray elements must be trivially copyable");
+        T *data = static_cast<T *>(alloc(n * sizeof(T), alignof(T)));
+        memset(data, 0, n * sizeof(T));
+        return ArenaArray<T>(data, n);
+    }
+
+    /**
+     * Copy a vector of trivially copyable elements into the arena
+     * @param v Vector to copy
+     */
+    template <class T>
+    ArenaArray<T> copy(const std::vector<T> &v)
+    {
+        ArenaArray<T> a = makeArray<T>(v.size());
+        if (!v.empty()) {
+            memcpy(a.data, v.data(), v.size() * sizeof(T));
+        }
+        return a;
+    }
+
+    /**
+     * Destroy all objects and make all memory available again, keeping
+     * the blocks
+     */
+    void reset();
+
+    /**
+     * Number of bytes handed out since construction or the last reset()
+     */
+    size_t bytesUsed() const { return used; }
+
+private:
+    struct Block {
+        char   *mem;
+        size_t size;
+    };
+
+    struct Finalizer {
+        void      (*destroy)(void *);
+        void      *obj;
+        Finalizer *prev;
+    };
+
+    template <class T>
+    static void destroy(void *obj) { static_cast<T *>(obj)->~T(); }
+
+    void addFinalizer(void (*destroy)(void *), void *obj);
+    void runFinalizers();
+
+    size_t             blockSize;
+    std::vector<Block> blocks;
+    size_t             current;     // index of the block being filled
+    size_t             offset;      // in blocks[current]
+    size_t             used;
+    Finalizer          *finalizers; // most recent first
+};
+
+#endif
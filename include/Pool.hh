@@ -0,0 +1,89 @@
+/**
+ * @file Pool.hh
+ *
+ * Pool allocation of fixed-size objects
+ */
+
+#ifndef POOL_HH
+#define POOL_HH
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+#include <type_traits>
+
+/**
+ * A pool of objects of type T, allocated in chunks of chunkSize objects.
+ * Destroyed objects are kept on a free list and reused by create(), so
+ * that objects that are created and destroyed throughout a run, such as
+ * scheduler events, cost neither a malloc nor a free once the pool has
+ * grown to the largest number of objects alive at once.
+ */
+template <class T, size_t chunkSize = 64>
+class Pool {
+public:
+    Pool() : freeList(NULL) {}
+
+    ~Pool()
+    {
+        for (auto c : chunks) {
+            delete [] c;
+        }
+    }
+
+    Pool(const Pool &) = delete;
+    Pool &operator=(const Pool &) = delete;
+
+    /**
+     * Create an object
+     * @param args Constructor arguments
+     */
+    template <class... Args>
+    T *create(Args&&... args)
+    {
+        if (freeList == NULL) {
+            grow();
+        }
+        Slot *s = freeList;
+        freeList = s->next;
+        return new (&s->storage) T(std::forward<Args>(args)...);
+    }
+
+    /**
+     * Destroy an object created by create()
+     */
+    void destroy(T *obj)
+    {
+        obj->~T();
+        Slot *s = reinterpret_cast<Slot *>(obj);
+        s->next = freeList;
+        freeList = s;
+    }
+
+private:
+    union Slot {
+        Slot *next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    void grow()
+    {
+        Slot *c = new Slot[chunkSize];
+        chunks.push_back(c);
+        link(c);
+    }
+
+    void link(Slot *c)
+    {
+        for (size_t i = 0; i < chunkSize; i++) {
+            c[i].next = freeList;
+            freeList = &c[i];
+        }
+    }
+
+    std::vector<Slot *> chunks;
+    Slot *freeList;
+};
+
+#endif
@@ -8,12 +8,72 @@
 #ifndef SCHED_HH
 #define SCHED_HH
 
+#include <functional>
 #include "Util.hh"
 
 /**
  * Event scheduler
+ *
+ * Events are kept in a binary heap, ordered by time and, among events
+ * scheduled for the same time, by the order in which they were scheduled.
+ * Scheduling, cancelling and processing an event take O(log n) time, so
+ * that protocols with thousands of events cost no more per event than
+ * ones with a few.
+ *
+ * An event's action is any callable, e.g. a lambda that captures the
+ * event's parameters by value. A trivially copyable action no larger than
+ * two pointers (e.g. a lambda that captures a function pointer and a
+ * number, or a pointer to a long-lived string and a flag) is stored
+ * without a heap allocation. The action is destroyed with the event:
+ * after its last occurrence, when it is discarded or cleared, or, if it
+ * is cancelled, only when its entry reaches the top of the heap, which
+ * may be at the end of the run.
  */
 namespace Sched {
+    /**
+     * Identifies a scheduled event, e.g. to cancel it
+     */
+    typedef uint EventId;
+
+    /**
+     * Action of an event
+     * @param scheduledTime Time of this occurrence of the event
+     * @param currentTime Time at which the event is processed
+     */
+    typedef std::function<void(double scheduledTime,
+                               double currentTime)> Action;
+
+    /**
+     * Schedule an event
+     * @param time Time for which event will be scheduled
+     * @param action Action
+     * @return the event's ID
+     */
+    EventId schedule(double time, Action action);
+
+    /**
+     * Schedule a recurring event, which occurs at first, first + period,
+     * first + 2 * period, ..., up to last
+     * @param first Time of the first occurrence
+     * @param period Time between occurrences (> 0)
+     * @param last Latest time of an occurrence (>= first); DBL_MAX: no end
+     * @param action Action, performed at each occurrence
+     * @return the event's ID, which identifies all its occurrences
+     */
+    EventId scheduleRecurring(
+        double first,
+        double period,
+        double last,
+        Action action);
+
+    /**
+     * Cancel an event, i.e. all of its occurrences that have not been
+     * processed yet. An event may cancel itself from its action.
+     * @param id Event ID
+     * @return whether the event was still pending
+     */
+    bool cancel(EventId id);
+
     /**
      * Callback function signatures
      */
@@ -32,27 +92,28 @@ namespace Sched {
                                  double currentTime,
                                  void *data);
     /**
-     * Schedule an event
+     * Schedule an event that calls a function
      * @param time Time for which event will be scheduled
      * @param cb Callback function
      * @param data Will be passed as parameter to cb
+     * @return the event's ID
      */
-    void scheduleEvent(
-        double time, 
+    EventId scheduleEvent(
+        double time,
         NoneCallback cb);
 
-    void scheduleEvent(
-        double time, 
+    EventId scheduleEvent(
+        double time,
         UintCallback cb,
         uint data);
 
-    void scheduleEvent(
-        double time, 
+    EventId scheduleEvent(
+        double time,
         DbleCallback cb,
         double data);
 
-    void scheduleEvent(
-        double time, 
+    EventId scheduleEvent(
+        double time,
         VoidPtrCallback cb,
         void *data);
 
@@ -61,6 +122,20 @@ namespace Sched {
      */
     void clearEvents();
 
+    /**
+     * Get the scheduled times of all pending events, in processing order.
+     * A recurring event is represented by its next occurrence.
+     */
+    std::vector<double> getEventTimes();
+
+    /**
+     * Remove, without processing them, all events, or occurrences of
+     * recurring events, scheduled at or before the specified time, e.g.
+     * events that had already been processed when a checkpoint was taken
+     * @return Number of events (occurrences) removed
+     */
+    uint discardEvents(double time);
+
     /**
      * Process all events scheduled to run at or before the specified time
      */
@@ -76,6 +76,17 @@ public:
         return traceTags.find(tag) != traceTags.end();
     }
 
+    /**
+     * Set a function to be called before each trace message is written,
+     * e.g. to flush output that is written asynchronously, so that trace
+     * messages appear in order with it and it is not lost when
+     * TRACE_FATAL aborts
+     */
+    static void setFlushHook(void (*hook)())
+    {
+        flushHook = hook;
+    }
+
 #ifdef TRACE_ON
     #define TRACE(lvl, ...) \
         do { \
@@ -180,6 +191,9 @@ public:
                       const char *fmt,
                       Args  ... args)
     {
+        if (flushHook != NULL) {
+            flushHook();
+        }
         FILE *dest = lvl >= TRACE_Warn ? stderr : stdout;
         fmt::print(dest, "{}{} {}[{}] {}(): ",
                 indentStr(), traceLevelString(lvl), file, line, func);
@@ -218,6 +232,7 @@ private:
     static TraceLevel traceLevel;
     static unordered_set<string> traceTags;
     static uint indentLevel;
+    static void (*flushHook)();
     
     enum { MAXINDENT = 128 };
     
@@ -44,6 +44,17 @@ namespace Util {
      */
     void initRand();
 
+    /**
+     * Get the state of the random number generator, e.g. for saving
+     * it in a checkpoint. Requires that initRand has been called.
+     */
+    string getRandState();
+
+    /**
+     * Restore a random number generator state obtained from getRandState
+     */
+    void setRandState(const string &state);
+
     /**
      * Generate a random integer in [min, max[
      */
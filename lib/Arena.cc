@@ -0,0 +1,76 @@
+/**
+ * @file Arena.cc
+ *
+ * Implementation of region-based memory allocation
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "Arena.hh"
+#include "Trace.hh"
+
+Arena::Arena(size_t blockSize)
+    : blockSize(blockSize), current(0), offset(0), used(0), finalizers(NULL)
+{}
+
+Arena::~Arena()
+{
+    runFinalizers();
+    for (auto &b : blocks) {
+        free(b.mem);
+    }
+}
+
+void *Arena::alloc(size_t size, size_t align)
+{
+    // Try the current block, then the following ones (which were in use
+    // before the last reset)
+    //
+    for (; current < blocks.size(); current++, offset = 0) {
+        Block &b = blocks[current];
+        uintptr_t p = (uintptr_t) (b.mem + offset);
+        size_t pad = (align - p % align) % align;
+        if (offset + pad + size <= b.size) {
+            offset += pad + size;
+            used += size;
+            return (void *) (p + pad);
+        }
+    }
+
+    // Add a block. malloc aligns it for any fundamental type.
+    //
+    Block b;
+    b.size = size + align > blockSize ? size + align : blockSize;
+    b.mem = (char *) malloc(b.size);
+    ABORT_IF(b.mem == NULL, "Arena: out of memory ({} bytes)", b.size);
+    blocks.push_back(b);
+    current = blocks.size() - 1;
+    offset = 0;
+    return alloc(size, align);
+}
+
+void Arena::addFinalizer(void (*destroy)(void *), void *obj)
+{
+    Finalizer *f = new (alloc(sizeof(Finalizer), alignof(Finalizer)))
+        Finalizer;
+    f->destroy = destroy;
+    f->obj = obj;
+    f->prev = finalizers;
+    finalizers = f;
+}
+
+void Arena::runFinalizers()
+{
+    for (Finalizer *f = finalizers; f != NULL; f = f->prev) {
+        f->destroy(f->obj);
+    }
+    finalizers = NULL;
+}
+
+void Arena::reset()
+{
+    runFinalizers();
+    current = 0;
+    offset = 0;
+    used = 0;
+}
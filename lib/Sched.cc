@@ -7,166 +7,277 @@
  * Date: 2016-11-03
  */
 
-#include <string>
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
 #include "Sched.hh"
+#include "Pool.hh"
 
 namespace Sched {
-    enum EventDataType {
-        NONE,
-        UINT,
-        DBLE,
-        VOID_PTR
-    };
-
-    struct EventData {
-        union {
-            uint   u;
-            double d;
-            void   *v;
-        };
-
-        EventData() {}
-        EventData(uint u)   : u(u) {}
-        EventData(double d) : d(d) {}
-        EventData(void *v)  : v(v) {}
-    };
-
-    union Callback {
-        NoneCallback n;
-        UintCallback u;
-        DbleCallback d;
-        VoidPtrCallback v;
-    };
-
     /**
      * A scheduled event
      */
     struct Event {
-        double        time;
-        EventDataType type;
-        Callback      cb;
-        EventData     data;
-        Event         *next;
+        EventId  id;
+        Action   action;
+        double   first;         // time of the first occurrence
+        double   period;        // 0: not recurring
+        double   last;          // latest time of an occurrence
+        uint64_t occurrence;    // index of the next occurrence
+        bool     cancelled;
 
         Event(
-            double time,
-            EventDataType type,
-            Callback cb,
-            EventData data)
-            : time(time),
-              type(type),
-              cb(cb), 
-              data(data), 
-              next(NULL)
+            EventId id,
+            Action &&action,
+            double first,
+            double period,
+            double last)
+            : id(id),
+              action(std::move(action)),
+              first(first),
+              period(period),
+              last(last),
+              occurrence(0),
+              cancelled(false)
         {}
+
+        /**
+         * Time of the next occurrence
+         */
+        double time() const { return first + occurrence * period; }
+    };
+
+    /**
+     * Entry of the event heap. The time and sequence number are copied
+     * from the event, so that comparisons need not dereference it.
+     */
+    struct HeapEntry {
+        double   time;
+        uint64_t seq;           // order in which the entries were added
+        Event    *event;
     };
 
     /**
-     * List of scheduled events.
+     * Heap order: the entry that is processed next is the greatest
+     */
+    static bool later(const HeapEntry &a, const HeapEntry &b)
+    {
+        return a.time > b.time || (a.time == b.time && a.seq > b.seq);
+    }
+
+    /**
+     * Scheduled events. Each pending event, or the next occurrence of a
+     * recurring event, has one entry.
+     */
+    static std::vector<HeapEntry> heap;
+
+    /**
+     * Pending events, indexed by ID - 1, for cancel(). The slot of an
+     * event that is no longer pending is NULL. IDs are not reused, so
+     * this grows by one pointer per scheduled event, without a
+     * per-event allocation.
+     */
+    static std::vector<Event *> pending;
+
+    static EventId nextId = 1;
+    static uint64_t nextSeq = 0;
+
+    /**
+     * Storage of the events, reused as events are processed
+     */
+    static Pool<Event> eventPool;
+
+    /**
+     * Add the next occurrence of an event to the heap
+     */
+    static void push(Event *event)
+    {
+        heap.push_back({ event->time(), nextSeq++, event });
+        std::push_heap(heap.begin(), heap.end(), later);
+    }
+
+    /**
+     * Remove the next entry from the heap
+     * @return its event
+     */
+    static Event *pop()
+    {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        Event *event = heap.back().event;
+        heap.pop_back();
+        return event;
+    }
+
+    /**
+     * Destroy an event that has no more occurrences
+     */
+    static void retire(Event *event)
+    {
+        if (!event->cancelled) {
+            pending[event->id - 1] = NULL;
+        }
+        eventPool.destroy(event);
+    }
+
+    /**
+     * Schedule an event or a recurring event
      */
-    static Event *nextEvent = NULL;
+    static EventId add(double first, double period, double last,
+                       Action &&action)
+    {
+        Event *event = eventPool.create(
+            nextId++, std::move(action), first, period, last);
+        pending.push_back(event);
+        push(event);
+        return event->id;
+    }
+
+    EventId schedule(double time, Action action)
+    {
+        return add(time, 0.0, time, std::move(action));
+    }
+
+    EventId scheduleRecurring(
+        double first,
+        double period,
+        double last,
+        Action action)
+    {
+        ABORT_UNLESS(period > 0.0, "Bad period for recurring event: {}",
+                     period);
+        ABORT_UNLESS(first <= last,
+                     "Recurring event ends ({}) before it starts ({})",
+                     last, first);
+        return add(first, period, last, std::move(action));
+    }
 
     /**
-     * Schedule an event
-     * @param time Time for which event will be scheduled
-     * @param cb Callback function
-     * @param data Event Data
+     * Cancel an event. Its heap entry, if any, is removed lazily, when
+     * it reaches the top of the heap.
      */
-    void scheduleEvent(
-        double time, 
-        EventDataType type,
-        Callback cb,
-        EventData data)
-    {
-        Event *newEv = new Event(time, type, cb, data);
-
-        // Find event after which to insert new event
-        //
-        Event **p = &nextEvent;
-        while ((*p != NULL) && ((*p)->time <= time)) {
-            p = &((*p)->next);
+    bool cancel(EventId id)
+    {
+        if (id == 0 || id > pending.size() || pending[id - 1] == NULL) {
+            return false;
         }
-        newEv->next = *p;
-        *p = newEv;
+        pending[id - 1]->cancelled = true;
+        pending[id - 1] = NULL;
+        return true;
     }
 
-    void scheduleEvent(
-        double time, 
-        NoneCallback ncb)
+    EventId scheduleEvent(
+        double time,
+        NoneCallback cb)
     {
-        Callback cb;
-        cb.n = ncb;
-        scheduleEvent(time, NONE, cb, EventData());
+        return schedule(time, cb);
     }
 
-    void scheduleEvent(
-        double time, 
-        UintCallback ucb,
+    EventId scheduleEvent(
+        double time,
+        UintCallback cb,
         uint data)
     {
-        Callback cb;
-        cb.u = ucb;
-        EventData d;
-        d.u = data;
-        scheduleEvent(time, UINT, cb, d);
+        return schedule(time, [cb, data](double stime, double now) {
+            cb(stime, now, data);
+        });
     }
 
-    void scheduleEvent(
-        double time, 
-        DbleCallback dcb,
+    EventId scheduleEvent(
+        double time,
+        DbleCallback cb,
         double data)
     {
-        Callback cb;
-        cb.d = dcb;
-        EventData d;
-        d.d = data;
-        scheduleEvent(time, DBLE, cb, d);
+        return schedule(time, [cb, data](double stime, double now) {
+            cb(stime, now, data);
+        });
     }
 
-    void scheduleEvent(
-        double time, 
-        VoidPtrCallback vcb,
+    EventId scheduleEvent(
+        double time,
+        VoidPtrCallback cb,
         void *data)
     {
-        Callback cb;
-        cb.v = vcb;
-        EventData d;
-        d.v = data;
-        scheduleEvent(time, VOID_PTR, cb, d);
+        return schedule(time, [cb, data](double stime, double now) {
+            cb(stime, now, data);
+        });
     }
-            
+
     /**
      * Clear all scheduled events
      */
     void clearEvents()
     {
-        for (Event *ev = nextEvent; ev != NULL; ev = ev->next) {
-            delete ev;
+        for (auto &e : heap) {
+            if (!e.event->cancelled) {
+                pending[e.event->id - 1] = NULL;
+            }
+            eventPool.destroy(e.event);
+        }
+        heap.clear();
+    }
+
+    /**
+     * Get the scheduled times of all pending events
+     */
+    std::vector<double> getEventTimes()
+    {
+        std::vector<HeapEntry> entries;
+        for (auto &e : heap) {
+            if (!e.event->cancelled) {
+                entries.push_back(e);
+            }
+        }
+        std::sort(entries.begin(), entries.end(),
+                  [](const HeapEntry &a, const HeapEntry &b) {
+                      return later(b, a);
+                  });
+
+        std::vector<double> times;
+        for (auto &e : entries) {
+            times.push_back(e.time);
         }
-        nextEvent = NULL;
+        return times;
     }
 
     /**
-     * Process a scheduled event.
+     * Remove all events scheduled at or before the specified time
      */
-    static void processEvent(Event *event, double now)
-    {
-        switch(event->type) {
-            case NONE:
-                event->cb.n(event->time, now);
-                break;
-            case UINT:
-                event->cb.u(event->time, now, event->data.u);
-                break;
-            case DBLE:
-                event->cb.d(event->time, now, event->data.d);
-                break;
-            case VOID_PTR:
-                event->cb.v(event->time, now, event->data.v);
-                break;
-            default:
-                abort();
+    uint discardEvents(double time)
+    {
+        uint count = 0;
+        while (!heap.empty() && heap.front().time <= time) {
+            Event *event = pop();
+            if (event->cancelled) {
+                retire(event);
+                continue;
+            }
+
+            // Skip the occurrences up to time, without stepping through
+            // them one by one. Beyond 1e15 occurrences, those of a
+            // recurring event can no longer be told apart (e.g. when
+            // discarding everything up to DBL_MAX), so it ends there.
+            //
+            uint64_t next = event->occurrence + 1;
+            if (event->period > 0.0) {
+                double n = floor((time - event->first) / event->period) + 1;
+                if (n >= 1e15) {
+                    count++;
+                    retire(event);
+                    continue;
+                }
+                next = std::max(next, (uint64_t) n);
+            }
+            count += next - event->occurrence;
+            event->occurrence = next;
+
+            if (event->period > 0.0 && event->time() <= event->last) {
+                push(event);
+            } else {
+                retire(event);
+            }
         }
+        return count;
     }
 
     /**
@@ -174,11 +285,22 @@ namespace Sched {
      */
     void processEvents(double now)
     {
-        while (nextEvent != NULL && nextEvent->time <= now) {
-            Event *ev = nextEvent;
-            processEvent(ev, now);
-            nextEvent = ev->next;
-            delete ev;
+        while (!heap.empty() && heap.front().time <= now) {
+            Event *event = pop();
+            if (!event->cancelled) {
+                event->action(event->time(), now);
+            }
+
+            // The action may have cancelled the event
+            //
+            if (!event->cancelled && event->period > 0.0) {
+                event->occurrence++;
+                if (event->time() <= event->last) {
+                    push(event);
+                    continue;
+                }
+            }
+            retire(event);
         }
     }
 }
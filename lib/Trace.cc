@@ -10,3 +10,4 @@
 Trace::TraceLevel Trace::traceLevel = Trace::TRACE_Warn;
 unordered_set<string> Trace::traceTags;
 uint Trace::indentLevel = 0;
+void (*Trace::flushHook)() = NULL;
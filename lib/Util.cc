@@ -62,6 +62,17 @@ namespace Util {
         randSeed = now.tv_usec;
     }
 
+    string getRandState()
+    {
+        ABORT_IF(true, "getRandState is not supported with UTIL_THREADED");
+        return "";
+    }
+
+    void setRandState(const string &)
+    {
+        ABORT_IF(true, "setRandState is not supported with UTIL_THREADED");
+    }
+
 /**
  * Generate a random integer in [min, max[
  */
@@ -104,13 +115,57 @@ namespace Util {
     /**
      * Initialize rand
      */
+    // State array of random(3). Supplying our own (of the same size as
+    // the default one) through initstate(3) makes it possible to save
+    // and restore the generator state.
+    //
+    static char randState[128];
+    static bool randStateInitialized = false;
+
     void initRand()
     {
         // Use the system clock's usecs to randomize random(3)
         //
         struct timeval now;
         gettimeofday(&now, 0);
-        srandom(now.tv_usec);
+        initstate(now.tv_usec, randState, sizeof(randState));
+        randStateInitialized = true;
+    }
+
+    /**
+     * Get the state of random(3)
+     */
+    string getRandState()
+    {
+        ABORT_IF(!randStateInitialized, "initRand has not been called");
+
+        // setstate(3) stores the current position in the state array
+        //
+        setstate(randState);
+        return string(randState, sizeof(randState));
+    }
+
+    /**
+     * Restore a state of random(3) obtained from getRandState
+     */
+    void setRandState(const string &state)
+    {
+        ABORT_IF(state.size() != sizeof(randState), "Bad random state size");
+        if (!randStateInitialized) {
+            initstate(1, randState, sizeof(randState));
+            randStateInitialized = true;
+        }
+
+        // setstate(3) first stores the current position in the state
+        // array that is in use, which is randState. So switch to a copy
+        // of the new state before copying it into randState, or its
+        // position would be overwritten.
+        //
+        static char newState[sizeof(randState)];
+        memcpy(newState, state.data(), sizeof(newState));
+        setstate(newState);
+        memcpy(randState, newState, sizeof(randState));
+        setstate(randState);
     }
 
     /**
@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <map>
+
+#include "NsBranch.hh"
+#include "Trace.hh"
+
+/**
+ * A variant of a branch file
+ */
+struct NsBranchVariant {
+    string propsPath;
+    string name;        // props file name without directory and suffix
+    Props props;
+    vector<NsBranchEvent> events;
+};
+
+static vector<NsBranchVariant> variants;
+static vector<uint> group;          // the variants run by this process
+static double comparedUpTo = -1;    // events of group agree up to here
+static string outDir;
+static uint branchRun;
+static vector<pid_t> children;
+static off_t forkOutputSize;        // of standard output, at the last fork
+
+/**
+ * Read a branch file and the props of its variants
+ * @param path Branch file path
+ * @param cmdLineProps Props that apply to all variants
+ */
+static void readVariants(const char *path, Props &cmdLineProps)
+{
+    std::ifstream in(path);
+    ABORT_IF(!in, "Cannot open branch file {}", path);
+
+    std::map<string, uint> names;
+    string line;
+    uint lineNum = 0;
+    while (std::getline(in, line)) {
+        lineNum++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        string propsPath;
+        if (!(fields >> propsPath)) {
+            continue;
+        }
+        string extra;
+        ABORT_IF(fields >> extra, "{}:{}: extra field '{}'",
+                 path, lineNum, extra);
+
+        NsBranchVariant v;
+        v.propsPath = propsPath;
+        size_t start = propsPath.rfind('/');
+        start = (start == string::npos) ? 0 : start + 1;
+        size_t end = propsPath.rfind(".props");
+        if (end == string::npos || end < start) {
+            end = propsPath.size();
+        }
+        v.name = propsPath.substr(start, end - start);
+        ABORT_IF(names[v.name]++ > 0, "{}:{}: {} appears more than once",
+                 path, lineNum, v.name);
+        v.props = cmdLineProps;
+        v.props.readProps(propsPath.c_str());
+        variants.push_back(v);
+    }
+    ABORT_IF(variants.empty(), "No variants in branch file {}", path);
+}
+
+/**
+ * Get the props of a variant that must be the same for the variants of a
+ * family, i.e. all but the title and the event props, in a canonical form
+ */
+static string familyKey(Props &p, const vector<string> &eventPropNames)
+{
+    vector<string> lines;
+    std::istringstream in(p.toString());
+    string line;
+    while (std::getline(in, line)) {
+        string name = line.substr(0, line.find(": "));
+        if (name != "title" &&
+            std::find(eventPropNames.begin(), eventPropNames.end(), name) ==
+                eventPropNames.end())
+        {
+            lines.push_back(line);
+        }
+    }
+    std::sort(lines.begin(), lines.end());
+
+    string key;
+    for (auto &l : lines) {
+        key.append(l);
+        key.append("\n");
+    }
+    return key;
+}
+
+/**
+ * Fork a process for each of a list of variant groups but the first.
+ * This process runs the first, the children the others.
+ * @return the index of the group run by this process
+ */
+static uint forkGroups(const vector<vector<uint>> &groups)
+{
+    fflush(stdout);
+    fflush(stderr);
+    forkOutputSize = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+
+    uint g = 0;
+    for (uint i = 1; i < groups.size(); i++) {
+        pid_t pid = fork();
+        ABORT_IF(pid < 0, "fork failed: {}", strerror(errno));
+        if (pid == 0) {
+            g = i;
+            children.clear();
+            break;
+        }
+        children.push_back(pid);
+    }
+    group = groups[g];
+    return g;
+}
+
+/**
+ * Copy the contents of a file
+ * @param from File descriptor to copy from, starting at offset 0
+ * @param to File descriptor to append to
+ * @param size Number of bytes to copy, or -1 to copy up to the end
+ */
+static void copyFile(int from, int to, off_t size = -1)
+{
+    char buf[65536];
+    off_t offset = 0;
+    while (size < 0 || offset < size) {
+        size_t count = sizeof(buf);
+        if (size >= 0 && size - offset < (off_t) count) {
+            count = size - offset;
+        }
+        ssize_t n = pread(from, buf, count, offset);
+        ABORT_IF(n < 0, "Cannot read output: {}", strerror(errno));
+        if (n == 0) break;
+        ABORT_IF(write(to, buf, n) != n, "Cannot write output: {}",
+                 strerror(errno));
+        offset += n;
+    }
+}
+
+/**
+ * Redirect standard output to a new temporary file
+ * @param copy Whether to copy the output up to the last fork to the new
+ *        file. The output file is shared with the parent process, which
+ *        may have written more to it since.
+ */
+static void redirectOutput(bool copy)
+{
+    fflush(stdout);
+    FILE *tmp = tmpfile();
+    ABORT_IF(tmp == NULL, "Cannot create temporary output file");
+    if (copy) {
+        ABORT_IF(forkOutputSize < 0, "Cannot get the output size");
+        copyFile(STDOUT_FILENO, fileno(tmp), forkOutputSize);
+    }
+    ABORT_IF(dup2(fileno(tmp), STDOUT_FILENO) < 0,
+             "Cannot redirect output: {}", strerror(errno));
+    fclose(tmp);
+}
+
+/**
+ * Read a branch file and fork a process for each family of its variants
+ * @param branchFile Branch file path
+ * @param outputDir Output directory
+ * @param cmdLineProps Props that apply to all variants
+ * @param eventPropNames Names of the props that specify events
+ * @param getEvents Function that gets the events specified by props
+ * @return the props file path of this process's first variant
+ */
+const char *branch_start(const char *branchFile, const char *outputDir,
+                         Props &cmdLineProps,
+                         const vector<string> &eventPropNames,
+                         NsBranchEventsFn getEvents)
+{
+    outDir = outputDir;
+    branchRun = cmdLineProps.getUint("branchRun", 0);
+    readVariants(branchFile, cmdLineProps);
+
+    vector<vector<uint>> families;
+    std::map<string, uint> familyIndex;
+    for (uint v = 0; v < variants.size(); v++) {
+        variants[v].events = getEvents(variants[v].props);
+        string key = familyKey(variants[v].props, eventPropNames);
+        if (familyIndex.count(key) == 0) {
+            familyIndex[key] = families.size();
+            families.push_back(vector<uint>());
+        }
+        families[familyIndex[key]].push_back(v);
+    }
+
+    forkGroups(families);
+    redirectOutput(false);
+
+    return variants[group[0]].propsPath.c_str();
+}
+
+/**
+ * Branch off the variants whose events up to some time differ from those
+ * of this process's first variant. Must be called before the events up
+ * to that time are processed.
+ * @param time Time of the events to be processed next
+ * @param after Set to the time up to which events have been processed
+ *        by the time of the branch point
+ * @return the props of the new group of variants if this process is one
+ *         of the branches, whose events after 'after' must be
+ *         rescheduled, otherwise NULL
+ */
+Props *branch_point(uint time, double &after)
+{
+    if (group.size() <= 1) return NULL;
+
+    vector<vector<uint>> branches;
+    vector<vector<string>> branchEvents;
+    for (uint v : group) {
+        vector<string> events;
+        for (auto &e : variants[v].events) {
+            if (e.time > comparedUpTo && e.time <= time) {
+                events.push_back(e.key);
+            }
+        }
+        uint b = std::find(branchEvents.begin(), branchEvents.end(), events) -
+            branchEvents.begin();
+        if (b == branches.size()) {
+            branches.push_back(vector<uint>());
+            branchEvents.push_back(events);
+        }
+        branches[b].push_back(v);
+    }
+    after = comparedUpTo;
+    comparedUpTo = time;
+
+    if (branches.size() == 1) return NULL;
+
+    for (uint b = 1; b < branches.size(); b++) {
+        TRACE_INFO("Branching off {} at time {}",
+                   variants[branches[b][0]].name, time);
+    }
+    if (forkGroups(branches) == 0) return NULL;
+
+    redirectOutput(true);
+    return &variants[group[0]].props;
+}
+
+/**
+ * Write the outputs of this process's variants and wait for the
+ * processes branched off from it
+ * @return exit status: 0 if all of them succeeded, else 1
+ */
+int branch_finish()
+{
+    fflush(stdout);
+
+    for (uint v : group) {
+        NsBranchVariant &var = variants[v];
+        for (const string &dir : { outDir, outDir + "/" + var.name }) {
+            ABORT_IF(mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST,
+                     "Cannot create directory {}", dir);
+        }
+        string path = fmt::format("{}/{}/{}.raw", outDir, var.name, branchRun);
+        FILE *f = fopen(path.c_str(), "w");
+        ABORT_IF(f == NULL, "Cannot create {}", path);
+        fmt::print(f, "===================================\n");
+        fmt::print(f, "{}", var.props.toString());
+        fmt::print(f, "===================================\n");
+        fflush(f);
+        copyFile(STDOUT_FILENO, fileno(f));
+        fclose(f);
+    }
+
+    int status = 0;
+    for (pid_t pid : children) {
+        int childStatus;
+        if (waitpid(pid, &childStatus, 0) != pid ||
+            !WIFEXITED(childStatus) || WEXITSTATUS(childStatus) != 0)
+        {
+            TRACE_ERROR("Branch process {} failed", pid);
+            status = 1;
+        }
+    }
+    return status;
+}
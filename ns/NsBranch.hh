@@ -0,0 +1,64 @@
+#ifndef NS_BRANCH_HH
+#define NS_BRANCH_HH
+
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+
+#include "Props.hh"
+
+/**
+ * Branching event sweeps
+ *
+ * Most experiments come in families of runs that differ only in the time
+ * of one event, e.g. a lesion at day 1, 2, ... 21. With -branch
+ * <branchFile>, ns simulates the history that such runs have in common
+ * only once. Each line of the branch file names a props file:
+ *
+ *     # props file
+ *     props/ns_05a_lesion_01d.props
+ *     props/ns_05b_lesion_02d.props
+ *
+ * Variants whose props differ in anything but the title and the event
+ * props run in separate processes from the start. The others share one
+ * process until the first time step at which their events differ. There,
+ * before the events are processed, the process fork()s a child for each
+ * group of variants whose events up to that time differ from those of
+ * the process's first variant, and the child reschedules the events of
+ * its group. The children get copy-on-write copies of the system, so
+ * only the pages of unit and connection state that change after the
+ * branch point are duplicated, and a family of N runs of T steps costs
+ * about T steps plus the suffixes after the branch points instead of
+ * N * T steps.
+ *
+ * Up to its branch point, a variant draws the same random numbers as the
+ * other variants of its family, so that it is exactly a run of its props
+ * file with that seed and differences between the variants are not
+ * masked by sampling noise.
+ *
+ * Variant <name> writes <outDir>/<name>/<branchRun>.raw (branchRun
+ * defaults to 0), the layout used by multi_ns: its props, then the output
+ * shared with the rest of its family up to its branch point, then its
+ * own. Until then the output is kept in a temporary file.
+ */
+
+/**
+ * An event, as far as branching is concerned: its time and a string that
+ * tells it apart from other events at the same time
+ */
+struct NsBranchEvent {
+    uint time;          // hours
+    string key;
+};
+
+typedef vector<NsBranchEvent> (*NsBranchEventsFn)(Props &props);
+
+const char *branch_start(const char *branchFile, const char *outDir,
+                         Props &cmdLineProps,
+                         const vector<string> &eventPropNames,
+                         NsBranchEventsFn getEvents);
+Props *branch_point(uint time, double &after);
+int branch_finish();
+
+#endif
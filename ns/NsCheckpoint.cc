@@ -0,0 +1,354 @@
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <map>
+
+#include "Sched.hh"
+
+#include "NsCheckpoint.hh"
+#include "NsSystem.hh"
+
+/**
+ * Serializes the checkpoint metadata
+ */
+class MetaWriter {
+public:
+    template<class T> void put(const T &val)
+    {
+        const char *p = (const char *) &val;
+        buf.insert(buf.end(), p, p + sizeof(T));
+    }
+
+    void putString(const string &s)
+    {
+        put<uint32_t>(s.size());
+        buf.insert(buf.end(), s.begin(), s.end());
+    }
+
+    vector<char> buf;
+};
+
+/**
+ * Deserializes the checkpoint metadata
+ */
+class MetaReader {
+public:
+    MetaReader(const char *begin, const char *end) : p(begin), end(end) {}
+
+    template<class T> T get()
+    {
+        T val;
+        ABORT_IF(p + sizeof(T) > end, "Truncated checkpoint metadata");
+        memcpy(&val, p, sizeof(T));
+        p += sizeof(T);
+        return val;
+    }
+
+    string getString()
+    {
+        uint32_t n = get<uint32_t>();
+        ABORT_IF(p + n > end, "Truncated checkpoint metadata");
+        string s(p, n);
+        p += n;
+        return s;
+    }
+
+private:
+    const char *p;
+    const char *end;
+};
+
+/**
+ * Layers and tracts in checkpoint order, i.e. ordered by ID
+ */
+static std::map<string, NsLayer *> sortedLayers(NsSystem *system)
+{
+    return std::map<string, NsLayer *>(system->layers.begin(),
+                                       system->layers.end());
+}
+
+static std::map<string, NsTract *> sortedTracts(NsSystem *system)
+{
+    return std::map<string, NsTract *>(system->tracts.begin(),
+                                       system->tracts.end());
+}
+
+/**
+ * Write a checkpoint of the system to a file. The checkpoint is written
+ * to a temporary file first, which replaces the file at path only when
+ * complete, so that an interrupted write leaves the previous checkpoint
+ * intact.
+ * @param system The system
+ * @param path Checkpoint file path
+ * @param lastEventTime Time of the last event processing
+ */
+void checkpoint_write(NsSystem *system, const string &path,
+                      double lastEventTime)
+{
+    string tmpPath = path + ".tmp";
+    FILE *f = fopen(tmpPath.c_str(), "w");
+    ABORT_IF(f == NULL, "Cannot create {}", tmpPath);
+    vector<char> fbuf(1 << 20);
+    setvbuf(f, fbuf.data(), _IOFBF, fbuf.size());
+
+    NsCheckpointHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, "NSCP", 4);
+    hdr.version = checkpointVersion;
+    hdr.numReplicates = numReplicates;
+    hdr.simTime = simTime;
+    hdr.timeStep = timeStep;
+    fwrite(&hdr, sizeof(hdr), 1, f);
+
+    MetaWriter meta;
+
+    // Units, and the layer metadata
+    //
+    auto layers = sortedLayers(system);
+    meta.put<uint32_t>(layers.size());
+    for (auto &le : layers) {
+        NsLayer *l = le.second;
+        meta.putString(l->id);
+        meta.put<uint32_t>(l->units.size());
+        meta.put<uint64_t>(hdr.numUnits);
+        meta.put<uint8_t>(l->isFrozen);
+        meta.put<uint8_t>(l->isLesioned);
+        meta.put<uint32_t>(l->nextPatternUnit);
+        for (uint r = 0; r < numReplicates; r++) {
+            meta.put<double>(l->inhibition[r]);
+        }
+        meta.put<uint32_t>(l->definedPatternHandles.size());
+        for (auto h : l->definedPatternHandles) {
+            meta.putString(patternId(h));
+            for (auto &pat : l->definedPatterns[h]) {
+                meta.put<uint32_t>(pat.units.size());
+                for (auto i : pat.units) {
+                    meta.put<uint32_t>(i);
+                }
+            }
+        }
+
+        for (auto u : l->units) {
+            for (uint r = 0; r < numReplicates; r++) {
+                NsCheckpointUnit cu;
+                memset(&cu, 0, sizeof(cu));
+                cu.lastNetInput = u->lastNetInput[r];
+                cu.isActive = u->isActive[r];
+                cu.newIsActive = u->newIsActive[r];
+                fwrite(&cu, sizeof(cu), 1, f);
+            }
+        }
+        hdr.numUnits += l->units.size();
+    }
+
+    // Connections, and the tract metadata. A tract's connections are
+    // created in checkpoint order.
+    //
+    auto tracts = sortedTracts(system);
+    meta.put<uint32_t>(tracts.size());
+    for (auto &te : tracts) {
+        NsTract *t = te.second;
+        ABORT_IF(t->connections.size() !=
+                 t->fromLayer->units.size() * t->toLayer->units.size(),
+                 "Tract {} is not fully connected", t->id);
+        meta.putString(t->id);
+        meta.put<uint64_t>(hdr.numConnections);
+        meta.put<double>(t->e3Level);
+
+        for (auto c : t->connections) {
+            for (uint r = 0; r < numReplicates; r++) {
+                NsCheckpointConnection cc;
+                memset(&cc, 0, sizeof(cc));
+                cc.psdSize = c->psdSize[r];
+                cc.numCiAmpars = c->numCiAmpars[r];
+                cc.numCpAmpars = c->numCpAmpars[r];
+                cc.isPotentiated = c->isPotentiated[r];
+                cc.psiIsOn = c->isPsiOn();
+                fwrite(&cc, sizeof(cc), 1, f);
+            }
+        }
+        hdr.numConnections += t->connections.size();
+    }
+
+    // Pending events and random state
+    //
+    meta.put<double>(lastEventTime);
+    vector<double> eventTimes = Sched::getEventTimes();
+    meta.put<uint32_t>(eventTimes.size());
+    for (auto t : eventTimes) {
+        meta.put<double>(t);
+    }
+    vector<string> randState = replicates_getRandState();
+    meta.put<uint32_t>(randState.size());
+    for (auto &s : randState) {
+        meta.putString(s);
+    }
+
+    hdr.metaOffset = sizeof(hdr) +
+        hdr.numUnits * numReplicates * sizeof(NsCheckpointUnit) +
+        hdr.numConnections * numReplicates * sizeof(NsCheckpointConnection);
+    hdr.metaSize = meta.buf.size();
+    fwrite(meta.buf.data(), 1, meta.buf.size(), f);
+
+    fseek(f, 0, SEEK_SET);
+    fwrite(&hdr, sizeof(hdr), 1, f);
+
+    ABORT_IF(fflush(f) != 0 || fsync(fileno(f)) != 0,
+             "Error writing {}", tmpPath);
+    fclose(f);
+    ABORT_IF(rename(tmpPath.c_str(), path.c_str()) != 0,
+             "Cannot rename {} to {}", tmpPath, path);
+
+    TRACE_INFO("Checkpoint at simTime {} written to {}", simTime, path);
+}
+
+/**
+ * Restore the system from a checkpoint. The system must have been built
+ * from the same props, and its events scheduled, but not yet run.
+ * @param system The system
+ * @param path Checkpoint file path
+ */
+void checkpoint_read(NsSystem *system, const string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    ABORT_IF(fd < 0, "Cannot open {}", path);
+    struct stat st;
+    ABORT_IF(fstat(fd, &st) != 0, "Cannot stat {}", path);
+    size_t fileSize = st.st_size;
+    ABORT_IF(fileSize < sizeof(NsCheckpointHeader),
+             "{} is not a checkpoint", path);
+    const char *base = (const char *) mmap(NULL, fileSize, PROT_READ,
+                                           MAP_PRIVATE, fd, 0);
+    ABORT_IF(base == MAP_FAILED, "Cannot map {}", path);
+    close(fd);
+    madvise((void *) base, fileSize, MADV_SEQUENTIAL);
+
+    const NsCheckpointHeader *hdr = (const NsCheckpointHeader *) base;
+    ABORT_IF(memcmp(hdr->magic, "NSCP", 4) != 0,
+             "{} is not a checkpoint", path);
+    ABORT_IF(hdr->version != checkpointVersion,
+             "{}: unsupported checkpoint version {}", path, hdr->version);
+    ABORT_IF(hdr->numReplicates != numReplicates,
+             "{} has {} replicates, expected {}",
+             path, hdr->numReplicates, numReplicates);
+    ABORT_IF(hdr->metaOffset + hdr->metaSize > fileSize,
+             "{} is truncated", path);
+
+    const NsCheckpointUnit *units = (const NsCheckpointUnit *)
+        (base + sizeof(NsCheckpointHeader));
+    const NsCheckpointConnection *conns = (const NsCheckpointConnection *)
+        (units + hdr->numUnits * numReplicates);
+    MetaReader meta(base + hdr->metaOffset,
+                    base + hdr->metaOffset + hdr->metaSize);
+
+    simTime = hdr->simTime;
+    timeStep = hdr->timeStep;
+
+    // Layers and units
+    //
+    uint32_t numLayers = meta.get<uint32_t>();
+    ABORT_IF(numLayers != system->layers.size(),
+             "{} has {} layers, expected {}",
+             path, numLayers, system->layers.size());
+    for (uint32_t li = 0; li < numLayers; li++) {
+        string id = meta.getString();
+        ABORT_IF(system->layers.count(id) == 0, "{}: unknown layer {}",
+                 path, id);
+        NsLayer *l = system->getLayer(id);
+        uint32_t numUnits = meta.get<uint32_t>();
+        uint64_t firstUnit = meta.get<uint64_t>();
+        ABORT_IF(numUnits != l->units.size(),
+                 "{}: layer {} has {} units, expected {}",
+                 path, id, numUnits, l->units.size());
+
+        l->isFrozen = meta.get<uint8_t>();
+        l->isLesioned = meta.get<uint8_t>();
+        l->nextPatternUnit = meta.get<uint32_t>();
+        for (uint r = 0; r < numReplicates; r++) {
+            l->inhibition[r] = meta.get<double>();
+        }
+        l->clearPatterns();
+        uint32_t numPatterns = meta.get<uint32_t>();
+        for (uint32_t pi = 0; pi < numPatterns; pi++) {
+            string pid = meta.getString();
+            vector<NsPattern> patterns(numReplicates);
+            for (auto &pat : patterns) {
+                pat.resize(meta.get<uint32_t>());
+                for (auto &i : pat) {
+                    i = meta.get<uint32_t>();
+                }
+            }
+            l->definePattern(registerPattern(pid), patterns);
+        }
+
+        const NsCheckpointUnit *cu = units + firstUnit * numReplicates;
+        for (auto u : l->units) {
+            u->isFrozen = l->isFrozen;
+            for (uint r = 0; r < numReplicates; r++, cu++) {
+                u->lastNetInput[r] = cu->lastNetInput;
+                u->isActive[r] = cu->isActive;
+                u->newIsActive[r] = cu->newIsActive;
+            }
+        }
+    }
+
+    // Tracts and connections
+    //
+    uint32_t numTracts = meta.get<uint32_t>();
+    ABORT_IF(numTracts != system->tracts.size(),
+             "{} has {} tracts, expected {}",
+             path, numTracts, system->tracts.size());
+    for (uint32_t ti = 0; ti < numTracts; ti++) {
+        string id = meta.getString();
+        ABORT_IF(system->tracts.count(id) == 0, "{}: unknown tract {}",
+                 path, id);
+        NsTract *t = system->getTract(id);
+        uint64_t firstConnection = meta.get<uint64_t>();
+        t->e3Level = meta.get<double>();
+        t->lastE3Level = DBL_MAX;
+
+        const NsCheckpointConnection *cc =
+            conns + firstConnection * numReplicates;
+        for (auto c : t->connections) {
+            c->togglePsi(cc->psiIsOn);
+            for (uint r = 0; r < numReplicates; r++, cc++) {
+                c->psdSize[r] = cc->psdSize;
+                c->numCiAmpars[r] = cc->numCiAmpars;
+                c->numCpAmpars[r] = cc->numCpAmpars;
+                c->isPotentiated[r] = cc->isPotentiated;
+            }
+        }
+    }
+    system->calcRates();
+
+    // Drop the events that were processed before the checkpoint was
+    // taken; what remains should be what was pending then.
+    //
+    double lastEventTime = meta.get<double>();
+    Sched::discardEvents(lastEventTime);
+    vector<double> eventTimes(meta.get<uint32_t>());
+    for (auto &t : eventTimes) {
+        t = meta.get<double>();
+    }
+    if (eventTimes != Sched::getEventTimes()) {
+        TRACE_WARN("{}: scheduled events differ from those pending "
+                   "at the checkpoint", path);
+    }
+
+    vector<string> randState(meta.get<uint32_t>());
+    for (auto &s : randState) {
+        s = meta.getString();
+    }
+    if (hdr->numRanks != 0 || !replicates_setRandState(randState)) {
+        TRACE_WARN("{}: written by the parallel engine, random state not "
+                   "restored", path);
+    }
+
+    munmap((void *) base, fileSize);
+
+    TRACE_INFO("Restarting at simTime {} from {}", simTime, path);
+}
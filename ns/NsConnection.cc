@@ -5,23 +5,36 @@
 #include "NsConnection.hh"
 
 /*
- * Constructor
+ * Constructor. The state of the connection, in the tract's arrays, is
+ * initialized by the tract.
  */
-NsConnection::NsConnection(const NsTract *tract,
+NsConnection::NsConnection(NsTract *tract,
+                           uint index,
                            const NsUnit *fromUnit,
                            NsUnit *toUnit)
     : forceStaticInit(initializeStatics()),
-      isPotentiated(false),
+      isPotentiated(&tract->isPotentiated[index * numReplicates]),
+      psdSize(&tract->psdSize[index * numReplicates]),
+      numCiAmpars(&tract->numCiAmpars[index * numReplicates]),
+      numCpAmpars(&tract->numCpAmpars[index * numReplicates]),
       fromUnit(fromUnit),
       toUnit(toUnit),
+      fromIsActive(fromUnit->isActive),
       tract(tract),
-      id(fmt::format("{}-{}", fromUnit->id, toUnit->id)),
-      psdSize(minPsdSize),
-      numCiAmpars(minNumCiAmpars),
-      numCpAmpars(minNumCpAmpars),
       psiIsOn(false)
+{}
+
+/**
+ * Get the connection's ID, "<fromUnit ID>-<toUnit ID>". It is only needed
+ * for trace output, so it is formatted on first use rather than for each
+ * of the millions of connections when the network is built.
+ */
+const string &NsConnection::getId() const
 {
-    toUnit->inConnections.push_back(this);
+    if (id.empty()) {
+        id = fmt::format("{}-{}", fromUnit->id, toUnit->id);
+    }
+    return id;
 }
 
 /*
@@ -37,8 +50,8 @@ double NsConnection::potProbHalf;
 /**
  * Initialize static member variables This needs to happen before regular
  * member variables are initialized in the constructor, but can't be done by
- * static member initializers because it must happen after props have been
- * initialized, which happens in main().
+ * static member initializers because it must happen after the parameters
+ * have been resolved, which happens in main().
  * 
  * Hence the 'forceStaticInit' member variable that forces this function to
  * be called before any other member variables are initialized.
@@ -47,12 +60,13 @@ bool NsConnection::initializeStatics()
 {
     static bool staticsInitialized = false;
     if (!staticsInitialized) {
-        minPsdSize = props.getDouble("minPsdSize");
-        maxPsdSize = props.getDouble("maxPsdSize");
-        minNumCiAmpars = props.getDouble("minNumCiAmpars");
-        minNumCpAmpars = props.getDouble("minNumCpAmpars");
-        potProbK = props.getDouble("potProbK");
-        potProbHalf = props.getDouble("potProbHalf");
+        const NsConnectionParams &p = params_connection();
+        minPsdSize = p.minPsdSize;
+        maxPsdSize = p.maxPsdSize;
+        minNumCiAmpars = p.minNumCiAmpars;
+        minNumCpAmpars = p.minNumCpAmpars;
+        potProbK = p.potProbK;
+        potProbHalf = p.potProbHalf;
         staticsInitialized = true;
     }
     return true;
@@ -62,74 +76,88 @@ bool NsConnection::initializeStatics()
  * Set 'isPotentiated' = true. This will cause CI-AMPARs to move into slots
  * as they are vacated by decaying CP-AMPARs
  */
-void NsConnection::potentiate(const char *tag)
+void NsConnection::potentiate(uint r, const char *tag)
 {
-    isPotentiated = true;
+    isPotentiated[r] = true;
 
-    infoTrace("{:.1f} potentiating {} ({}) [{}]\n",
+    infoTrace(replicateOutput(r), "{:.1f} potentiating {} ({}) [{}]\n",
               (double) simTime / 24.,
-              id, tag, toUnit->lastNetInput);
+              getId(), tag, toUnit->lastNetInput[r]);
 }
 
 /**
  * Turn off isPotentiated flag; this will cause CI-AMPARs
  * to start being removed;
  */
-void NsConnection::depotentiate(const char *tag)
+void NsConnection::depotentiate(uint r, const char *tag)
 {
-    isPotentiated = false;
-    setNumCiAmpars(minNumCiAmpars);
+    isPotentiated[r] = false;
+    setNumCiAmpars(r, minNumCiAmpars);
 
-    infoTrace("{:.1f} depotentiating {} ({}) [{}]\n",
+    infoTrace(replicateOutput(r), "{:.1f} depotentiating {} ({}) [{}]\n",
               (double) simTime / 24.,
-              id, tag, getStrength());
+              getId(), tag, getStrength(r));
 }
 
 /**
  * Decay num CP-AMPARs no matter what. If the connection is potentiated AND
  * Hebbian, drive in CI-AMPARs, otherwise decay them towards their min and
  * shrink PSD.
+ *
+ * This runs for every connection in every time step, so all replicates
+ * are updated in one branch-free loop, with a single sanity check at the
+ * end instead of the checks in setNumCiAmpars and setNumCpAmpars.
  */
 void NsConnection::amparTrafficking(double cpAmparRemovalRate, 
                                     double ciAmparInsertionRate,
                                     double ciAmparRemovalRate)
 {
-    setNumCpAmpars(numCpAmpars -
-                   cpAmparRemovalRate * (numCpAmpars - minNumCpAmpars));
-
-    if (isPotentiated && !psiIsOn) {
-        if (fromUnit->isActive && toUnit->isActive) {
-            double delta = Util::min(ciAmparInsertionRate,
-                                     psdSize - (numCpAmpars + numCiAmpars));
-            setNumCiAmpars(numCiAmpars + delta);
+    const uint8_t *fromIsActive = fromUnit->isActive;
+    const uint8_t *toIsActive = toUnit->isActive;
+    const double psdDecayRate = tract->psdDecayRate;
+    bool isBad = false;
+
+    for (uint r = 0; r < numReplicates; r++) {
+        double cp = numCpAmpars[r] -
+            cpAmparRemovalRate * (numCpAmpars[r] - minNumCpAmpars);
+        double ci = numCiAmpars[r];
+
+        if (isPotentiated[r] && !psiIsOn) {
+            if (fromIsActive[r] && toIsActive[r]) {
+                ci += Util::min(ciAmparInsertionRate, psdSize[r] - (cp + ci));
+            }
+        } else {
+            // Constitutive CI-AMPAR removal
+            //
+            ci -= ciAmparRemovalRate * (ci - minNumCiAmpars);
         }
-    } else {
-        // Constitutive CI-AMPAR removal
+
+        // PSD size decays toward the greater of the number of inserted
+        // AMPARs and minPsdSize
         //
-        setNumCiAmpars(numCiAmpars -
-                       ciAmparRemovalRate * (numCiAmpars - minNumCiAmpars));
-    }
+        double asymptote = Util::max(cp + ci, minPsdSize);
+        psdSize[r] -= psdDecayRate * (psdSize[r] - asymptote);
 
-    // PSD size decays toward the greater of the number of inserted
-    // AMPARs and minPsdSize
-    //
-    double asymptote =
-        Util::max(numCpAmpars + numCiAmpars, minPsdSize);
-    psdSize -= tract->psdDecayRate * (psdSize - asymptote);
+        isBad |= (cp < minNumCpAmpars) | (ci < minNumCiAmpars) |
+                 isnan(cp) | isnan(ci);
+        numCpAmpars[r] = cp;
+        numCiAmpars[r] = ci;
+    }
+    ABORT_IF(isBad, "Oops");
 }
 
 /**
  * Remove all CI-AMPARs and replace them by CP-AMPARs
  */
-void NsConnection::reactivate()
+void NsConnection::reactivate(uint r)
 {
     // Rapid removal of CI-AMPARs
     //
-    setNumCiAmpars(minNumCiAmpars);
+    setNumCiAmpars(r, minNumCiAmpars);
  
     // Rapid replacement by CP-AMPARS
     //
-    setNumCpAmpars(psdSize - numCiAmpars);
+    setNumCpAmpars(r, psdSize[r] - numCiAmpars[r]);
 }
 
 /**
@@ -139,7 +167,9 @@ void NsConnection::stimulate(double learnRate, uint numStimCycles,
                              const char *tag)
 {
     if (learnRate > 0) {
-        learn(learnRate, numStimCycles, tag);
+        for (uint r = 0; r < numReplicates; r++) {
+            learn(r, learnRate, numStimCycles, tag);
+        }
     }
 }
 
@@ -149,16 +179,17 @@ void NsConnection::stimulate(double learnRate, uint numStimCycles,
  * vacant slots with CP-AMPARs. Then, with  a probability depending on
  * the number of learning cycles, potentiate the synapse.
  */
-void NsConnection::learn(double learnRate, uint numStimCycles, const char *tag)
+void NsConnection::learn(uint r, double learnRate, uint numStimCycles,
+                         const char *tag)
 {
-    if (fromUnit->isActive && toUnit->isActive) {
+    if (isHebbian(r)) {
         for (uint i = 0; i < numStimCycles; i++) {
-            psdSize += learnRate * (maxPsdSize - psdSize);
+            psdSize[r] += learnRate * (maxPsdSize - psdSize[r]);
         }
 
-        setNumCpAmpars(psdSize - numCiAmpars);
+        setNumCpAmpars(r, psdSize[r] - numCiAmpars[r]);
         
-        if (!isPotentiated && !psiIsOn) {
+        if (!isPotentiated[r] && !psiIsOn) {
             // Probability of potentiation is an asigmoid function of
             // stimulation level, reflecting a fuzzy threshold level e.g. of
             // accumulated kinase in a series of spikes.
@@ -168,39 +199,58 @@ void NsConnection::learn(double learnRate, uint numStimCycles, const char *tag)
             double probOfPotentiation =
                 MathUtil::asigmoid(numStimCycles, potProbK, potProbHalf) *
                 tract->maxPotProb;
-            if (Util::randDouble(0.0, 1.0) < probOfPotentiation) {
-                potentiate(tag);
+            if (replicateRandDouble(r) < probOfPotentiation) {
+                potentiate(r, tag);
             }
         }
     }
 }
 
-/*
- * Calculate strength as the number of inserted AMPARs divided by
- * maxPsdSize, the maximum number of AMPARs that can be inserted.
- * Thus, strength is a number in the range 0.0 to 1.0
- */
-double  NsConnection::getStrength() const
-{
-    return (numCiAmpars + numCpAmpars) / 100 /*maxPsdSize*/;
-}
-
 void NsConnection::printStateHdr()
 {
-    infoTrace("time conn ID PSD-SIZE CI-AMPARS CP-AMPARS Potentiated Hebbian\n");
+    if (recordOutput) return;
+
+    for (uint r = 0; r < numReplicates; r++) {
+        infoTrace(replicateOutput(r),
+                  "time conn ID PSD-SIZE CI-AMPARS CP-AMPARS Potentiated Hebbian\n");
+    }
 }
 
 void NsConnection::printState() const
 {
-    infoTrace("{} conn {} {:.1f} {} {} {} {}\n",
-               simTime / 24., id, 
-              psdSize, numCiAmpars, numCpAmpars, isPotentiated, isHebbian());
+    if (recordOutput) {
+        uint32_t name = output_name(tract->id);
+        for (uint r = 0; r < numReplicates; r++) {
+            uint16_t flags = (isPotentiated[r] ? NS_REC_POTENTIATED : 0) |
+                             (isHebbian(r) ? NS_REC_HEBBIAN : 0);
+            output_record(r, NS_REC_CONN, name, fromUnit->index,
+                          toUnit->index, psdSize[r], numCiAmpars[r],
+                          numCpAmpars[r], flags);
+        }
+        return;
+    }
+    if (asyncOutput) {
+        if (!TRACE_INFO_IS_ON) return;
+        for (uint r = 0; r < numReplicates; r++) {
+            log_conn(replicateOutput(r), simTime / 24., &getId(), psdSize[r],
+                     numCiAmpars[r], numCpAmpars[r], isPotentiated[r],
+                     isHebbian(r));
+        }
+        return;
+    }
+    for (uint r = 0; r < numReplicates; r++) {
+        infoTrace(replicateOutput(r), "{} conn {} {:.1f} {} {} {} {}\n",
+                  simTime / 24., getId(), psdSize[r], numCiAmpars[r],
+                  numCpAmpars[r], (bool) isPotentiated[r], isHebbian(r));
+    }
 }
 
 string NsConnection::toStr(uint iLvl, const string &iStr) const
 {
-    return fmt::format("{}{} psd={} ci={} cp={}",
-                       Util::repeatStr(iStr, iLvl),
-                       id,
-                       psdSize, numCiAmpars, numCpAmpars);
+    string ret = Util::repeatStr(iStr, iLvl) + getId();
+    for (uint r = 0; r < numReplicates; r++) {
+        ret += fmt::format(" psd={} ci={} cp={}",
+                           psdSize[r], numCiAmpars[r], numCpAmpars[r]);
+    }
+    return ret;
 }
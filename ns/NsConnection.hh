@@ -2,6 +2,7 @@
 #define NS_CONNECTION_HH
 
 #include <math.h>
+#include <stdint.h>
 #include "NsUnit.hh"
 #include "NsGlobals.hh"
 
@@ -11,52 +12,78 @@ class NsConnection {
 private:
     bool forceStaticInit;
 public:
-    NsConnection(const NsTract *tract, const NsUnit *from, NsUnit *to);
+    NsConnection(NsTract *tract, uint index,
+                 const NsUnit *from, NsUnit *to);
     void stimulate(double learnRate, uint numStimCycles, const char *tag);
     void amparTrafficking(double cpAmparRemovalRate,
                           double ciAmparInsertionRate,
                           double ciAmparRemovalRate);
 
     static void printStateHdr();
-    void depotentiate(const char *tag);
+    void depotentiate(uint r, const char *tag);
     void togglePsi(bool state) { psiIsOn = state; }
-    void reactivate();
-    double getStrength() const;
+    bool isPsiOn() const { return psiIsOn; }
+    void reactivate(uint r);
+    double getStrength(uint r) const
+    {
+        return strength(numCiAmpars[r], numCpAmpars[r]);
+    }
     void printState() const;
+    const string &getId() const;
     string toStr(uint iLvl = 0, const string &iStr = "   ") const;
-    bool isHebbian() const { return fromUnit->isActive && toUnit->isActive; }
+    bool isHebbian(uint r) const
+    {
+        return fromUnit->isActive[r] && toUnit->isActive[r];
+    }
+
+    /*
+     * Strength is the number of inserted AMPARs divided by maxPsdSize,
+     * the maximum number of AMPARs that can be inserted. Thus, strength
+     * is a number in the range 0.0 to 1.0
+     */
+    static double strength(double numCiAmpars, double numCpAmpars)
+    {
+        return (numCiAmpars + numCpAmpars) / 100 /*maxPsdSize*/;
+    }
+
+    // Connection state, one value per replicate, in the tract's
+    // replicate-major arrays
+    //
+    uint8_t *isPotentiated;
+    double  *psdSize;
+    double  *numCiAmpars;
+    double  *numCpAmpars;
 
-    bool isPotentiated;
     const NsUnit *fromUnit;
     NsUnit *toUnit;
+    const uint8_t *fromIsActive;  // fromUnit->isActive, for computing
+                                  // net input without an indirection
 
 private:
-    void potentiate(const char *tag);
+    void potentiate(uint r, const char *tag);
     bool initializeStatics();
 
-    void setNumCiAmpars(double n)
+    void setNumCiAmpars(uint r, double n)
     {
-        TRACE_DEBUG("simTime: {} {}.numCiAmpars {:5.2f} --> {:5.2f}\n",
-                    simTime, id, numCiAmpars, n);
+        TRACE_DEBUG("simTime: {} {}.numCiAmpars[{}] {:5.2f} --> {:5.2f}\n",
+                    simTime, getId(), r, numCiAmpars[r], n);
         ABORT_IF(n < minNumCiAmpars || isnan(n), "Oops");
-        numCiAmpars = n;
+        numCiAmpars[r] = n;
     }
     
-    void setNumCpAmpars(double n)
+    void setNumCpAmpars(uint r, double n)
     {
-        TRACE_DEBUG("simTime: {} {}.numCpAmpars {:5.2f} --> {:5.2f}\n",
-                    simTime, id, numCpAmpars, n);
+        TRACE_DEBUG("simTime: {} {}.numCpAmpars[{}] {:5.2f} --> {:5.2f}\n",
+                    simTime, getId(), r, numCpAmpars[r], n);
         ABORT_IF(n < minNumCpAmpars || isnan(n), "Oops");
-        numCpAmpars = n;
+        numCpAmpars[r] = n;
     }
     
-    void learn(double learnRate, uint numStimCycles, const char *tag);
+    void learn(uint r, double learnRate, uint numStimCycles,
+               const char *tag);
 
     const  NsTract *tract;
-    const  string  id;
-    double         psdSize;
-    double         numCiAmpars;
-    double         numCpAmpars;
+    mutable string id;              // see getId()
     bool           psiIsOn;
     bool           staticsInitialized;
 
@@ -8,82 +8,146 @@
 NsLayer::NsLayer(const string &id, const string &type)
     : id(id),
       type(type),
-      width(props.getUint(id + '.' + "width")),
-      height(props.getUint(id + '.' + "height")),
-      k(props.getDouble(id + '.' + "k")),
-      minInhibition(props.getDouble("minInhibition")),
-      maxInhibition(props.getDouble("maxInhibition")),
-      initInhibition(props.getDouble("initInhibition")),
-      inhibIncr(props.getDouble("inhibIncr")),
-      inhibition(initInhibition),
+      params(params_layer(id)),
+      width(params.width),
+      height(params.height),
+      k(params.k),
+      inhibition(numReplicates, params.initInhibition),
       isClamped(false),
       isFrozen(false),
       isLesioned(false),
-      orthogonalPatterns(props.getBool("orthogonalPatterns")),
-      nextPatternUnit(0),
-      printPatterns(props.getBool("printPatterns"))
+      nextPatternUnit(0)
 {
     uint numUnits = width * height;
+    activations.resize(numUnits * numReplicates, false);
+    newActivations.resize(numUnits * numReplicates, false);
+    unitSlab.reserve(numUnits);
+    units.reserve(numUnits);
     for (uint i = 0; i < numUnits; i++) {
-        units.push_back(new NsUnit(this, i));
+        unitSlab.emplace_back(this, i,
+                              &activations[i * numReplicates],
+                              &newActivations[i * numReplicates]);
+        units.push_back(&unitSlab.back());
     }
 }
 
-void NsLayer::makePattern(const string &patId)
+/**
+ * Make a new pattern: in each replicate, a random set of units or, with
+ * orthogonalPatterns, the next units not used by any pattern yet
+ * @param patId Pattern ID
+ * @return the pattern's handle
+ */
+NsPatternHandle NsLayer::makePattern(const string &patId)
 {
-    ABORT_IF(definedPatterns.count(patId) != 0, "Duplicate pattern ID");
-    NsPattern p;
-    if (orthogonalPatterns) {
+    NsPatternHandle h = registerPattern(patId);
+    ABORT_IF(hasPattern(h), "Duplicate pattern ID");
+    vector<NsPattern> patterns;
+    if (params.orthogonalPatterns) {
+        NsPattern p;
         for (uint i = 0; i < k * units.size(); i++) {
             ABORT_IF(nextPatternUnit >= units.size(), "too many patterns");
             p.push_back(nextPatternUnit++);
         }
+        patterns.assign(numReplicates, p);
     } else {
-        p = Util::randUniqueUintList(k * units.size(), units.size());
+        for (uint r = 0; r < numReplicates; r++) {
+            patterns.push_back(replicateRandUniqueUintList(
+                r, k * units.size(), units.size()));
+        }
+    }
+    for (uint r = 0; r < numReplicates; r++) {
+        TRACE_DEBUG("{}.{}[{}] {}\n", id, patId, r, patternToStr(patterns[r]));
     }
-    definedPatterns.insert({patId, p});
-    definedPatternIds.push_back(patId);
+    definePattern(h, patterns);
+    return h;
+}
 
-    TRACE_DEBUG("{}.{} {}\n", id, patId, patternToStr(p));
+/**
+ * Define a pattern
+ * @param h Pattern handle
+ * @param patterns The pattern's units, per replicate
+ */
+void NsLayer::definePattern(NsPatternHandle h,
+                            const vector<NsPattern> &patterns)
+{
+    if (h >= definedPatterns.size()) {
+        definedPatterns.resize(h + 1);
+    }
+    vector<NsLayerPattern> &def = definedPatterns[h];
+    def.clear();
+    for (auto &p : patterns) {
+        def.push_back({ patternArena.copy(p),
+                        patternToMask(p, units.size(), patternArena) });
+    }
+    definedPatternHandles.push_back(h);
 }
 
-void NsLayer::setPattern(const NsPattern &pat)
+void NsLayer::setPattern(uint r, const ArenaArray<uint> &pat)
 {
     if (!isFrozen) {
-        clear();
+        clear(r);
         for (auto id : pat) {
-            units[id]->isActive = true;
+            units[id]->isActive[r] = true;
         }
     }
 }
 
+/**
+ * Activate each replicate's version of a pattern
+ */
+void NsLayer::setPattern(NsPatternHandle h)
+{
+    ABORT_IF(!hasPattern(h), "Layer {} has no pattern {}", id, h);
+    const vector<NsLayerPattern> &patterns = definedPatterns[h];
+    for (uint r = 0; r < numReplicates; r++) {
+        setPattern(r, patterns[r].units);
+    }
+}
+
 void NsLayer::setPattern(const string &patId)
 {
-    setPattern(definedPatterns.at(patId));
+    setPattern(findPattern(patId));
 }
 
+/**
+ * Forget all defined patterns, and release their storage in place
+ */
 void NsLayer::clearPatterns()
 {
-    definedPatternIds.clear();
-    definedPatterns.clear();
+    for (auto h : definedPatternHandles) {
+        definedPatterns[h].clear();
+    }
+    definedPatternHandles.clear();
+    patternArena.reset();
 }
 
 /**
- * Randomly select one of the trained patterns and activate it
+ * In each replicate, randomly select one of the trained patterns and
+ * activate it
+ * @return The selected patterns, per replicate
  */
-const string &NsLayer::setRandomPattern()
+vector<NsPatternHandle> NsLayer::setRandomPattern()
 {
-    uint i = Util::randInt(0, definedPatternIds.size());
-    const string &pid = definedPatternIds[i];
-    setPattern(pid);
-    TRACE_INFO("Layer {}, pattern {}", id, pid);
-    return pid;
+    vector<NsPatternHandle> handles;
+    for (uint r = 0; r < numReplicates; r++) {
+        uint i = replicateRandInt(r, 0, definedPatternHandles.size());
+        NsPatternHandle h = definedPatternHandles[i];
+        setPattern(r, definedPatterns[h][r].units);
+        TRACE_INFO("Layer {}, pattern {} [{}]", id, patternId(h), r);
+        handles.push_back(h);
+    }
+    return handles;
 }
 
 void NsLayer::clear()
+{
+    std::fill(activations.begin(), activations.end(), false);
+}
+
+void NsLayer::clear(uint r)
 {
     for(auto u : units) {
-        u->isActive = false;
+        u->isActive[r] = false;
     }
 }
 
@@ -95,17 +159,20 @@ void NsLayer::adjustInhibition()
 {
     ABORT_IF(isFrozen, "Makes no sense");
     int target = k * units.size();
-    int error = (int) getNumActive() - target;
+    for (uint r = 0; r < numReplicates; r++) {
+        int error = (int) getNumActive(r) - target;
 
-    // make an adjustment to the inhibition level
-    // in proportion to the magnitude of the error
+        // make an adjustment to the inhibition level
+        // in proportion to the magnitude of the error
 
-    inhibition = Util::bracket(
-        inhibition + (double) error / target * inhibIncr,
-        minInhibition,
-        maxInhibition);
+        inhibition[r] = Util::bracket(
+            inhibition[r] + (double) error / target * params.inhibIncr,
+            params.minInhibition,
+            params.maxInhibition);
 
-    TTRACE_DEBUG("inhib", "{} active: {}  inhib: {}", id, getNumActive(), inhibition);
+        TTRACE_DEBUG("inhib", "{}[{}] active: {}  inhib: {}",
+                     id, r, getNumActive(r), inhibition[r]);
+    }
 }
 
 /**
@@ -115,7 +182,9 @@ void NsLayer::randomize()
 {
     ABORT_IF(isFrozen, "Makes no sense");
     for(auto u : units) {
-        u->isActive = (Util::randDouble(0.0, 1.0) < k);
+        for (uint r = 0; r < numReplicates; r++) {
+            u->isActive[r] = (replicateRandDouble(r) < k);
+        }
     }
 }
 
@@ -170,11 +239,11 @@ void NsLayer::maintain()
     }
 }
 
-uint NsLayer::getNumActive() const
+uint NsLayer::getNumActive(uint r) const
 {
     uint numActive = 0;
     for(auto u : units) {
-        if (u->isActive) {
+        if (u->isActive[r]) {
             numActive++;
         }
     }
@@ -189,65 +258,156 @@ void NsLayer::printState() const
     }
 }
 
+/**
+ * Get the set of active units
+ * @param r Replicate
+ * @return the active units; valid until the next call
+ */
+const NsUnitMask &NsLayer::getActiveUnits(uint r) const
+{
+    activeUnits.assign(unitMaskWords(units.size()), 0);
+    for (uint i = 0; i < units.size(); i++) {
+        activeUnits[i / 64] |=
+            (uint64_t) (units[i]->isActive[r] != 0) << (i % 64);
+    }
+    return activeUnits;
+}
+
 /**
  * Count number of active target units
- * @param targetId ID of target pattern
+ * @param r Replicate
+ * @param target Target pattern
  * @return Count of targeted active units
  */
-uint NsLayer::getNumHits(const string &targetId) const
+uint NsLayer::getNumHits(uint r, NsPatternHandle target) const
 {
-    NsPattern target = definedPatterns.at(targetId);
-    uint ret = 0;
-    for (auto id : target) {
-        if(units[id]->isActive) ret++;
-    }
-    return ret;
+    return countCommonUnits(getActiveUnits(r), definedPatterns[target][r].mask);
+}
+
+/**
+ * Score a replicate's activations against a target pattern
+ * @param r Replicate
+ * @param target Target pattern, which must be defined in this layer
+ * @param targetSize Set to the number of units in the target pattern
+ * @param numHits Set to the number of active target units
+ * @param numExtras Set to the number of active units beyond numHits
+ */
+void NsLayer::getScore(uint r, NsPatternHandle target, uint &targetSize,
+                       uint &numHits, uint &numExtras) const
+{
+    const NsLayerPattern &pat = definedPatterns[target][r];
+    const NsUnitMask &active = getActiveUnits(r);
+    targetSize = pat.units.size();
+    numHits = countCommonUnits(active, pat.mask);
+    uint numActive = countUnits(active);
+    numExtras = numActive > numHits ? numActive - numHits : 0;
 }
 
 void NsLayer::printScoreHdr()
 {
-    fmt::print("time score condition layer target hits extras\n");
+    if (recordOutput) return;
+
+    const char *hdr = "time score condition layer target hits extras\n";
+    for (uint r = 0; r < numReplicates; r++) {
+        if (asyncOutput) {
+            log_literal(replicateOutput(r), hdr);
+        } else {
+            fmt::print(replicateOutput(r), hdr);
+        }
+    }
 }
 
 void NsLayer::printNumActiveHdr()
 {
-    infoTrace("time layer id numActive\n");
+    if (recordOutput) return;
+
+    const char *hdr = "time layer id numActive\n";
+    for (uint r = 0; r < numReplicates; r++) {
+        if (asyncOutput) {
+            if (TRACE_INFO_IS_ON) log_literal(replicateOutput(r), hdr);
+        } else {
+            infoTrace(replicateOutput(r), hdr);
+        }
+    }
 }
 
 void NsLayer::printNumActive() const
 {
-      infoTrace("{} layer {} {}\n", simTime, id, getNumActive());
+    if (recordOutput) {
+        uint32_t name = output_name(id);
+        for (uint r = 0; r < numReplicates; r++) {
+            output_record(r, NS_REC_NUM_ACTIVE, name, 0, 0, getNumActive(r));
+        }
+        return;
+    }
+    if (asyncOutput) {
+        if (!TRACE_INFO_IS_ON) return;
+        for (uint r = 0; r < numReplicates; r++) {
+            log_count(replicateOutput(r), simTime, "layer", &id,
+                      getNumActive(r));
+        }
+        return;
+    }
+    for (uint r = 0; r < numReplicates; r++) {
+        infoTrace(replicateOutput(r), "{} layer {} {}\n",
+                  simTime, id, getNumActive(r));
+    }
 }
 
-void NsLayer::printGrid(const string &tag, const string &targetId) const
+/**
+ * Print a replicate's score for a target pattern (if known) and, if
+ * printPatterns is set, its activations, to the replicate's output
+ */
+void NsLayer::printGrid(uint r, const string &tag,
+                        NsPatternHandle target) const
 {
-    bool targetKnown = (definedPatterns.count(targetId) != 0);
-
-    if (targetKnown) {
-        uint targetSize = definedPatterns.at(targetId).size();
-        uint numHits = getNumHits(targetId);
-        uint numExtras = getNumActive() > numHits ?
-            getNumActive() - numHits : 0;
-        fmt::print("{} score {} {} {} {} {}\n",
-                   simTime / 24., tag, id, targetSize, numHits, numExtras);
+    FILE *out = replicateOutput(r);
+
+    if (hasPattern(target)) {
+        uint targetSize, numHits, numExtras;
+        getScore(r, target, targetSize, numHits, numExtras);
+        if (recordOutput) {
+            output_record(r, NS_REC_SCORE, output_name(tag), output_name(id),
+                          0, targetSize, numHits, numExtras);
+        } else {
+            if (asyncOutput) {
+                log_score(out, simTime / 24., tag, &id,
+                          targetSize, numHits, numExtras);
+            } else {
+                fmt::print(out, "{} score {} {} {} {} {}\n", simTime / 24.,
+                           tag, id, targetSize, numHits, numExtras);
+            }
+        }
     } else {
-        if (printPatterns) {
-            infoTrace("{} {} {}\n", simTime / 24., tag, id);
+        if (params.printPatterns && TRACE_INFO_IS_ON) {
+            if (asyncOutput) {
+                log_tag(out, simTime / 24., tag, &id);
+            } else {
+                fmt::print(out, "{} {} {}\n", simTime / 24., tag, id);
+            }
         }
     }
 
-    if (printPatterns) {
-        infoTrace("+{}+\n", string(2 * width -1, '-'));
+    if (params.printPatterns && TRACE_INFO_IS_ON) {
+        // Draw the whole grid, then write it as one piece of text
+        fmt::memory_buffer grid;
+        fmt::format_to(grid, "+{:-<{}}+\n", "", 2 * width - 1);
         for (uint row = 0; row < height; row++) {
-            infoTrace("|");
+            grid.push_back('|');
             for (uint col = 0; col < width; col++) {
-                infoTrace("{}{}",
-                           units[row * width + col]->isActive ? '*' : ' ',
-                           (col < width - 1) ? " " : "");
+                grid.push_back(units[row * width + col]->isActive[r] ?
+                               '*' : ' ');
+                if (col < width - 1) grid.push_back(' ');
             }
-            infoTrace("|\n");
+            grid.push_back('|');
+            grid.push_back('\n');
+        }
+        fmt::format_to(grid, "+{:-<{}}+\n", "", 2 * width - 1);
+        if (asyncOutput) {
+            log_text(out, fmt::to_string(grid));
+        } else {
+            fwrite(grid.data(), 1, grid.size(), out);
         }
-        infoTrace("+{}+\n", string(2 * width -1, '-'));
     }
 }
 
@@ -15,12 +15,18 @@ using std::string;
 class NsLayer {
 public:
     NsLayer(const string &id, const string &type);
-    void makePattern(const string &patId);
+    NsPatternHandle makePattern(const string &patId);
+    void definePattern(NsPatternHandle h, const vector<NsPattern> &patterns);
+    bool hasPattern(NsPatternHandle h) const {
+        return h < definedPatterns.size() && !definedPatterns[h].empty();
+    }
     void setPattern(const string &patId);
-    void setPattern(const NsPattern &pat);
+    void setPattern(NsPatternHandle h);
+    void setPattern(uint r, const ArenaArray<uint> &pat);
     void clearPatterns();
-    const string &setRandomPattern();
+    vector<NsPatternHandle> setRandomPattern();
     void clear();
+    void clear(uint r);
     void randomize();
     void computeNewActivations();
     void applyNewActivations();
@@ -28,13 +34,16 @@ public:
     void setFrozen(bool state);
     void lesion();
     void maintain();
-    uint getNumActive() const;
+    uint getNumActive(uint r) const;
     static void printScoreHdr();
-    uint getNumHits(const string &targetId) const;
+    const NsUnitMask &getActiveUnits(uint r) const;
+    uint getNumHits(uint r, NsPatternHandle target) const;
+    void getScore(uint r, NsPatternHandle target, uint &targetSize,
+                  uint &numHits, uint &numExtras) const;
     static void printNumActiveHdr();
     void printNumActive() const;
     void printState() const;
-    void printGrid(const string &tag, const string &targetId) const;
+    void printGrid(uint r, const string &tag, NsPatternHandle target) const;
 
     void saveInhibition() { savedInhibition = inhibition; }
     void restoreInhibition() { inhibition = savedInhibition; }
@@ -42,24 +51,25 @@ public:
     string toStr(uint iLvl = 0, const string &iStr = "   ") const;
     const string id;
     const string type;
+    uint intID;                      // index in NsSystem::layers_vec
+    const NsLayerParams &params;
     const uint width;
     const uint height;
     const double k;
-    const double minInhibition;
-    const double maxInhibition;
-    const double initInhibition;
-    const double inhibIncr;
-    double inhibition;
-    double savedInhibition;
+    vector<double> inhibition;       // per replicate
+    vector<double> savedInhibition;  // per replicate
     bool isClamped;
     bool isFrozen;
     bool isLesioned;
     vector<NsUnit *> units;
-    bool orthogonalPatterns;
+    vector<NsUnit> unitSlab;         // the units, allocated in one block
+    vector<uint8_t> activations;     // per unit and replicate
+    vector<uint8_t> newActivations;  // per unit and replicate
     uint nextPatternUnit;
-    unordered_map<string, NsPattern> definedPatterns;
-    vector<string> definedPatternIds;
-    bool printPatterns;
+    vector<vector<NsLayerPattern>> definedPatterns; // per handle and replicate
+    vector<NsPatternHandle> definedPatternHandles;  // in order of definition
+    Arena patternArena;     // defined patterns, until clearPatterns()
+    mutable NsUnitMask activeUnits;
 };
 
 #endif
@@ -0,0 +1,422 @@
+#include <string.h>
+#include <errno.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "NsLog.hh"
+#include "NsGlobals.hh"
+#include "Trace.hh"
+
+bool asyncOutput = false;
+
+enum LogRecordType : uint8_t {
+    LOG_TEXT,
+    LOG_UNIT,
+    LOG_CONN,
+    LOG_COUNT,
+    LOG_LITERAL,
+    LOG_SCORE,
+    LOG_TAG
+};
+
+enum LogRecordFlags : uint8_t {
+    LOG_ACTIVE      = 1,
+    LOG_POTENTIATED = 2,
+    LOG_HEBBIAN     = 4
+};
+
+/**
+ * A log record: what to write, and where. For LOG_TEXT, text is owned
+ * by the record; id, tag and kind point to strings that outlive the run.
+ */
+struct LogRecord {
+    uint8_t type;
+    uint8_t flags;
+    uint32_t count;
+    FILE *out;
+    union {
+        string *text;
+        const string *id;
+    };
+    union {
+        const char *kind;
+        const string *tag;
+    };
+    double time;
+    double values[3];
+};
+
+/**
+ * Ring buffer of one logging thread. Only that thread advances head, and
+ * only the writer thread advances tail.
+ */
+struct LogRing {
+    LogRing(uint capacity) : recs(capacity), mask(capacity - 1) {}
+
+    std::vector<LogRecord> recs;
+    const uint64_t mask;
+    std::atomic<uint64_t> head { 0 };
+    std::atomic<uint64_t> tail { 0 };
+};
+
+static const size_t blockSize = 64 * 1024;
+
+static uint ringCapacity;
+static std::mutex ringsMutex;
+static std::vector<std::unique_ptr<LogRing>> rings;
+static thread_local LogRing *threadRing = NULL;
+
+static std::thread writer;
+static std::atomic<bool> stopWriter;
+static std::atomic<uint64_t> flushRequested;
+static std::atomic<uint64_t> flushDone;
+
+// Score conditions, which callers pass as temporaries, are kept here
+// until the writer thread is done with them
+//
+static std::mutex tagsMutex;
+static std::unordered_set<string> tags;
+
+// Output buffers of the writer thread, per output file
+//
+static std::vector<std::pair<FILE *, std::unique_ptr<fmt::memory_buffer>>>
+    buffers;
+
+/**
+ * Write an output buffer to its file
+ */
+static void writeBuffer(FILE *out, fmt::memory_buffer &buf)
+{
+    ABORT_IF(fwrite(buf.data(), 1, buf.size(), out) != buf.size(),
+             "Cannot write output: {}", strerror(errno));
+    buf.clear();
+}
+
+/**
+ * Get the output buffer of a file
+ */
+static fmt::memory_buffer &getBuffer(FILE *out)
+{
+    for (auto &b : buffers) {
+        if (b.first == out) {
+            return *b.second;
+        }
+    }
+    buffers.emplace_back(out, std::unique_ptr<fmt::memory_buffer>(
+                                  new fmt::memory_buffer));
+    return *buffers.back().second;
+}
+
+/**
+ * Format a log record into its file's output buffer, in the format of
+ * the corresponding synchronous output
+ */
+static void formatRecord(LogRecord &rec)
+{
+    fmt::memory_buffer &buf = getBuffer(rec.out);
+
+    switch (rec.type) {
+    case LOG_TEXT:
+        buf.append(rec.text->data(), rec.text->data() + rec.text->size());
+        delete rec.text;
+        break;
+    case LOG_UNIT:
+        fmt::format_to(buf, "{} unit {} {}\n",
+                       rec.time, *rec.id,
+                       (rec.flags & LOG_ACTIVE) ? 'a' : 'i');
+        break;
+    case LOG_CONN:
+        fmt::format_to(buf, "{} conn {} {:.1f} {} {} {} {}\n",
+                       rec.time, *rec.id,
+                       rec.values[0], rec.values[1], rec.values[2],
+                       (rec.flags & LOG_POTENTIATED) != 0,
+                       (rec.flags & LOG_HEBBIAN) != 0);
+        break;
+    case LOG_COUNT:
+        fmt::format_to(buf, "{} {} {} {}\n",
+                       (uint) rec.time, rec.kind, *rec.id, rec.count);
+        break;
+    case LOG_LITERAL:
+        buf.append(rec.kind, rec.kind + strlen(rec.kind));
+        break;
+    case LOG_SCORE:
+        fmt::format_to(buf, "{} score {} {} {} {} {}\n",
+                       rec.time, *rec.tag, *rec.id, (uint) rec.values[0],
+                       (uint) rec.values[1], (uint) rec.values[2]);
+        break;
+    case LOG_TAG:
+        fmt::format_to(buf, "{} {} {}\n", rec.time, *rec.tag, *rec.id);
+        break;
+    }
+
+    if (buf.size() >= blockSize) {
+        writeBuffer(rec.out, buf);
+    }
+}
+
+/**
+ * Format all records in a ring buffer
+ * @return Whether there were any
+ */
+static bool drainRing(LogRing &ring)
+{
+    uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    uint64_t head = ring.head.load(std::memory_order_acquire);
+    if (tail == head) return false;
+
+    for (; tail != head; tail++) {
+        formatRecord(ring.recs[tail & ring.mask]);
+    }
+    ring.tail.store(tail, std::memory_order_release);
+    return true;
+}
+
+/**
+ * Format the records of all ring buffers until they are empty
+ * @return Whether there were any
+ */
+static bool drainRings()
+{
+    bool drained = false;
+    bool more = true;
+    while (more) {
+        more = false;
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        for (auto &ring : rings) {
+            more |= drainRing(*ring);
+        }
+        drained |= more;
+    }
+    return drained;
+}
+
+/**
+ * Write and flush all output buffers
+ */
+static void writeBuffers()
+{
+    for (auto &b : buffers) {
+        writeBuffer(b.first, *b.second);
+        fflush(b.first);
+    }
+}
+
+/**
+ * Writer thread: format the logged records and write them out, until
+ * log_close() stops it
+ */
+static void writerMain()
+{
+    for (;;) {
+        uint64_t requested = flushRequested.load();
+        bool stopping = stopWriter.load();
+        bool drained = drainRings();
+        if (requested != flushDone.load(std::memory_order_relaxed)) {
+            writeBuffers();
+            flushDone.store(requested);
+        }
+        if (stopping) break;
+        if (!drained) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+    writeBuffers();
+}
+
+/**
+ * Get a copy of a tag that lives until log_close()
+ */
+static const string *internTag(const string &tag)
+{
+    std::lock_guard<std::mutex> lock(tagsMutex);
+    return &*tags.insert(tag).first;
+}
+
+/**
+ * Append a record to the calling thread's ring buffer, waiting while the
+ * ring buffer is full
+ */
+static void logRecord(const LogRecord &rec)
+{
+    if (threadRing == NULL) {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        rings.emplace_back(new LogRing(ringCapacity));
+        threadRing = rings.back().get();
+    }
+    LogRing &ring = *threadRing;
+
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    while (head - ring.tail.load(std::memory_order_acquire) > ring.mask) {
+        std::this_thread::yield();
+    }
+    ring.recs[head & ring.mask] = rec;
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+/**
+ * Start the writer thread, if asyncOutput is set. Must be called after
+ * replicates_init().
+ */
+void log_open()
+{
+    asyncOutput = props.getBool("asyncOutput", false);
+    uint bufferSize = props.getUint("asyncOutputBufferSize", 65536);
+    if (!asyncOutput) return;
+
+    ABORT_IF(bufferSize == 0, "asyncOutputBufferSize must be > 0");
+    for (ringCapacity = 1; ringCapacity < bufferSize; ringCapacity *= 2) ;
+
+    stopWriter = false;
+    flushRequested = 0;
+    flushDone = 0;
+    writer = std::thread(writerMain);
+    Trace::setFlushHook(log_flush);
+}
+
+/**
+ * Write out everything logged so far and stop the writer thread
+ */
+void log_close()
+{
+    if (!asyncOutput) return;
+
+    Trace::setFlushHook(NULL);
+    stopWriter = true;
+    writer.join();
+
+    rings.clear();
+    threadRing = NULL;
+    buffers.clear();
+    tags.clear();
+    asyncOutput = false;
+}
+
+/**
+ * Wait until everything logged so far has been written and flushed. Does
+ * nothing if called on the writer thread (e.g. by a trace message while
+ * it is writing).
+ */
+void log_flush()
+{
+    if (!asyncOutput || std::this_thread::get_id() == writer.get_id()) {
+        return;
+    }
+
+    uint64_t request = flushRequested.fetch_add(1) + 1;
+    while (flushDone.load() < request) {
+        std::this_thread::yield();
+    }
+}
+
+/**
+ * Log a message that has already been formatted
+ */
+void log_text(FILE *out, string &&text)
+{
+    LogRecord rec {};
+    rec.type = LOG_TEXT;
+    rec.out = out;
+    rec.text = new string(std::move(text));
+    logRecord(rec);
+}
+
+/**
+ * Log a unit's state, as NsUnit::printState() prints it
+ */
+void log_unit(FILE *out, double time, const string *id, bool active)
+{
+    LogRecord rec {};
+    rec.type = LOG_UNIT;
+    rec.flags = active ? LOG_ACTIVE : 0;
+    rec.out = out;
+    rec.id = id;
+    rec.time = time;
+    logRecord(rec);
+}
+
+/**
+ * Log a connection's state, as NsConnection::printState() prints it
+ */
+void log_conn(FILE *out, double time, const string *id, double psdSize,
+              double numCiAmpars, double numCpAmpars, bool isPotentiated,
+              bool isHebbian)
+{
+    LogRecord rec {};
+    rec.type = LOG_CONN;
+    rec.flags = (isPotentiated ? LOG_POTENTIATED : 0) |
+                (isHebbian ? LOG_HEBBIAN : 0);
+    rec.out = out;
+    rec.id = id;
+    rec.time = time;
+    rec.values[0] = psdSize;
+    rec.values[1] = numCiAmpars;
+    rec.values[2] = numCpAmpars;
+    logRecord(rec);
+}
+
+/**
+ * Log a count line ("<time> <kind> <id> <count>"), as
+ * NsLayer::printNumActive() and NsTract::printNumPotentiated() print them
+ */
+void log_count(FILE *out, uint time, const char *kind, const string *id,
+               uint count)
+{
+    LogRecord rec {};
+    rec.type = LOG_COUNT;
+    rec.count = count;
+    rec.out = out;
+    rec.id = id;
+    rec.kind = kind;
+    rec.time = time;
+    logRecord(rec);
+}
+
+/**
+ * Log a line of constant text, such as a header line
+ */
+void log_literal(FILE *out, const char *text)
+{
+    LogRecord rec {};
+    rec.type = LOG_LITERAL;
+    rec.out = out;
+    rec.kind = text;
+    logRecord(rec);
+}
+
+/**
+ * Log a score line, as NsLayer::printGrid() prints it
+ */
+void log_score(FILE *out, double time, const string &tag, const string *id,
+               uint targetSize, uint numHits, uint numExtras)
+{
+    LogRecord rec {};
+    rec.type = LOG_SCORE;
+    rec.out = out;
+    rec.id = id;
+    rec.tag = internTag(tag);
+    rec.time = time;
+    rec.values[0] = targetSize;
+    rec.values[1] = numHits;
+    rec.values[2] = numExtras;
+    logRecord(rec);
+}
+
+/**
+ * Log the "<time> <tag> <id>" line that precedes a grid without a target
+ * pattern, as NsLayer::printGrid() prints it
+ */
+void log_tag(FILE *out, double time, const string &tag, const string *id)
+{
+    LogRecord rec {};
+    rec.type = LOG_TAG;
+    rec.out = out;
+    rec.id = id;
+    rec.tag = internTag(tag);
+    rec.time = time;
+    logRecord(rec);
+}
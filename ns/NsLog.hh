@@ -0,0 +1,52 @@
+#ifndef NS_LOG_HH
+#define NS_LOG_HH
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+using std::string;
+
+/**
+ * Asynchronous output
+ *
+ * At trace level INFO, ns prints a line per unit and per connection at
+ * every time step, and formatting and writing them dominates the run
+ * time. With asyncOutput=true, the simulation instead appends compact
+ * binary log records to a lock-free ring buffer of its thread (one per
+ * thread that logs), and a writer thread formats them and writes them to
+ * their output files in blocks of about 64 KB. When a ring buffer is
+ * full, the thread that fills it waits for the writer to catch up.
+ *
+ * Records of one thread are written in the order they were logged.
+ * log_flush() returns once everything logged so far has been written and
+ * flushed. It is called before each trace message (see
+ * Trace::setFlushHook), so that trace messages, which are written
+ * directly, stay in order with the rest of the output, and so that the
+ * output up to a fatal error is not lost when TRACE_FATAL aborts.
+ *
+ * asyncOutputBufferSize sets the capacity of each ring buffer in records
+ * (default 65536, rounded up to a power of two).
+ *
+ * Output that ns writes often has its own record type (log_unit,
+ * log_conn, log_count, log_score, ...), which the writer thread formats.
+ * Only free-form trace text is formatted by the logging thread and passed
+ * on as a string (log_text).
+ */
+extern bool asyncOutput;
+
+void log_open();
+void log_close();
+void log_flush();
+void log_text(FILE *out, string &&text);
+void log_unit(FILE *out, double time, const string *id, bool active);
+void log_conn(FILE *out, double time, const string *id, double psdSize,
+              double numCiAmpars, double numCpAmpars, bool isPotentiated,
+              bool isHebbian);
+void log_count(FILE *out, uint time, const char *kind, const string *id,
+               uint count);
+void log_literal(FILE *out, const char *text);
+void log_score(FILE *out, double time, const string &tag, const string *id,
+               uint targetSize, uint numHits, uint numExtras);
+void log_tag(FILE *out, double time, const string &tag, const string *id);
+
+#endif
@@ -2,6 +2,7 @@
 using std::vector;
 
 #include <getopt.h>
+#include <float.h>
 #include <chrono>
 
 #include "Util.hh"
@@ -10,12 +11,23 @@ using std::vector;
 #include "NsSystem.hh"
 #include "NsTract.hh"
 #include "NsLayer.hh"
+#include "NsCheckpoint.hh"
+#include "NsBranch.hh"
+#include "NsScores.hh"
+#include "NsLog.hh"
+#include "NsSnapshot.hh"
 
 static NsSystem *nsSystem;
 
 static uint stopTime;     // hours
 static uint numBackgroundPatterns;
 
+static string checkpointFile;      // empty: no checkpoints
+static uint checkpointInterval;    // hours
+static uint nextCheckpointTime;    // hours
+static string restartFile;         // empty: start at simTime 0
+static double lastEventTime = -1;  // time of the last event processing
+
 /**
  * Print the system size (number of units and connections) and the system
  * state if the debug tags "psize" and "psys" are set, respectively.
@@ -70,238 +82,284 @@ static uint dhToH(string dh)
     return 24 * days + hours;
 }
 
-/**
- * struct used to schedule a time step change event
- */
-struct TimeStepChangeData {
-    uint timeStep;
-};
-
 /**
  * This function is called from the event scheduler.
  */
 static void changeTimeStep(
     double stime, 
     double now, 
-    TimeStepChangeData *data)
+    uint newTimeStep)
 {
     TRACE_INFO("Changing time step to {}: scheduled time={} now={}",
-               data->timeStep, stime, now);
-    timeStep = data->timeStep;
+               newTimeStep, stime, now);
+    timeStep = newTimeStep;
     nsSystem->calcRates();
-    delete data;
 }
 
-/**
- * struct used to schedule a reactivate event
- */
-struct ReactivateData {
-};
-
 /**
  * Reactivate
  * This function is called from the event scheduler.
  * @param stime Scheduled time for this event
  * @param now Current time
- * @param data Reactivation data
  */
 static void reactivate(
     double stime, 
-    double now, 
-    ReactivateData *data)
+    double now)
 {
     TRACE_INFO("Reactivating: scheduled time={} now={}", stime, now);
     nsSystem->reactivate();
-    delete data;
+    snapshots_event("reactivate");
 }
 
-/**
- * struct used to schedule a freezing/unfreezing event
- */
-struct FreezeData {
-    FreezeData(const string &layerId, bool state)
-        : layerId(layerId), state(state)
-    {}
-    const string &layerId;
-    bool state;
-};
-
 /**
  * Freeze/unfreeze a layer
  * This function is called from the event scheduler.
  * @param stime Scheduled time for this event
  * @param now Current time
- * @param data Freeze data
+ * @param layerId Layer ID
+ * @param state Whether to freeze (true) or unfreeze (false) the layer
  */
 static void setFrozen(
     double stime, 
     double now, 
-    FreezeData *data)
+    const string &layerId,
+    bool state)
 {
     TRACE_INFO("{} {}: scheduled time={} now={}",
-               data->state ? "Freezing" : "Unfreezing",
-               data->layerId, stime, now);
-
-    nsSystem->setFrozen(data->layerId, data->state);
+               state ? "Freezing" : "Unfreezing",
+               layerId, stime, now);
 
-    delete data;
+    nsSystem->setFrozen(layerId, state);
+    snapshots_event(fmt::format("{} {}", state ? "freeze" : "unfreeze",
+                                layerId));
 }
 
-/**
- * struct used to schedule a lesioning event
- */
-struct LesionData {
-    LesionData(const string &layerId)
-        : layerId(layerId)
-    {}
-    const string &layerId;
-};
-
 /**
  * Lesion a layer
  * This function is called from the event scheduler.
  * @param stime Scheduled time for this event
  * @param now Current time
- * @param data Lesion data
+ * @param layerId Layer ID
  */
 static void lesion(
     double stime, 
     double now, 
-    LesionData *data)
+    const string &layerId)
 {
     TRACE_INFO("Lesioning {}: scheduled time={} now={}",
-               data->layerId, stime, now);
+               layerId, stime, now);
 
-    nsSystem->lesion(data->layerId);
-
-    delete data;
+    nsSystem->lesion(layerId);
+    snapshots_event(fmt::format("lesion {}", layerId));
 }
 
-/**
- * struct used to schedule Psi on/off event
- */
-struct PsiData {
-    string layerId;
-    bool state;
-    PsiData(string layerId, bool state)
-        : layerId(layerId), state(state)
-    {}
-};
-
 /**
  * Toggle PSI on or off in the specified layer
  * This function is called from the event scheduler.
  * @param stime Scheduled time for this event
  * @param now Current time
- * @param data PSI event data
+ * @param layerId Layer ID
+ * @param state Whether to start (true) or stop (false) PSI
  */
 static void togglePsi(
     double stime, 
     double now, 
-    PsiData *data)
+    const string &layerId,
+    bool state)
 {
     TRACE_INFO("{} PSI in {}: scheduled time={} now={}",
-               (data->state ? "Starting" : "Stopping"),
-               data->layerId, stime, now);
-    nsSystem->togglePsi(data->layerId, data->state);
-    delete data;
+               (state ? "Starting" : "Stopping"),
+               layerId, stime, now);
+    nsSystem->togglePsi(layerId, state);
+    snapshots_event(fmt::format("psi {} {}", state ? "on" : "off",
+                                layerId));
 }
 
 /**
- * Schedule events to toggle PSI on or off in a specified layer
- * @param layerId Layer ID
- * @param psiTimes Vector of times at which to toggle PSI on or off
+ * Types of the events that can be specified in the props
  */
-void schedulePsiEvents(const string &layerId, const vector<string> psiTimes)
+enum NsEventType {
+    NS_EVENT_TIME_STEP,
+    NS_EVENT_REACTIVATE,
+    NS_EVENT_FREEZE,
+    NS_EVENT_LESION,
+    NS_EVENT_PSI,
+};
+
+/**
+ * An event as specified in the props
+ */
+struct NsEventSpec {
+    uint time;              // hours
+    NsEventType type;
+    const string *layerId;  // freeze, lesion and PSI events, else NULL
+    uint arg;               // new time step, or freeze/PSI on (1) or off (0)
+};
+
+/**
+ * Names of the props that specify events. Runs whose props differ only
+ * in these can share their history up to the first event in which they
+ * differ (see NsBranch.hh).
+ */
+static const vector<string> eventPropNames = {
+    "timeStepChanges",
+    "reactivateTimes",
+    "hpcFreezeTimes",
+    "accFreezeTimes",
+    "hpcLesionTime",
+    "accLesionTime",
+    "hpcPsiTimes",
+    "accPsiTimes",
+    "sc0PsiTimes",
+    "sc1PsiTimes",
+};
+
+/**
+ * Add events that alternately turn something on and off
+ * @param specs Event list to add to
+ * @param type Event type
+ * @param layerId Layer ID, which must outlive the events
+ * @param times Vector of times at which to toggle
+ */
+static void addToggleEventSpecs(
+    vector<NsEventSpec> &specs,
+    NsEventType type,
+    const string &layerId,
+    const vector<string> &times)
 {
-    for (uint i = 0; i <  psiTimes.size(); i++) {
-        PsiData *pd = new PsiData(layerId, Util::isEven(i));
-        Sched::scheduleEvent(
-            dhToH(psiTimes[i]),
-            (Sched::VoidPtrCallback) togglePsi, pd);
+    for (uint i = 0; i < times.size(); i++) {
+        specs.push_back(
+            { dhToH(times[i]), type, &layerId, Util::isEven(i) });
     }
 }
 
 /**
- * Schedule events
+ * Get the events specified by a set of props
+ * @param p Props
+ * @return the events, in the order in which they are to be scheduled
  */
-static void scheduleEvents()
+static vector<NsEventSpec> getEventSpecs(Props &p)
 {
-    // Schedule timeStep changes
+    vector<NsEventSpec> specs;
+    vector<string> none;
+
+    // timeStep changes
     //
     vector<string> timeStepChanges = 
-        props.getStringVector("timeStepChanges", vector<string>());
+        p.getStringVector("timeStepChanges", none);
     ABORT_IF(Util::isOdd(timeStepChanges.size()),
              "timeStepChanges must have even number of elements");
     for (uint i = 0; i <  timeStepChanges.size(); i += 2) {
-        TimeStepChangeData *tscd = new TimeStepChangeData();
-        tscd->timeStep = strtoul(timeStepChanges[i + 1].c_str(), NULL, 10);
-        Sched::scheduleEvent(
-            dhToH(timeStepChanges[i]),
-            (Sched::VoidPtrCallback) changeTimeStep, tscd);
-    }
-
-    // schedule reactivations
-    //
-    vector<string> reactivateTimes = 
-        props.getStringVector("reactivateTimes", vector<string>());
-    for (uint i = 0; i <  reactivateTimes.size(); i++) {
-        ReactivateData *rd = new ReactivateData();
-        Sched::scheduleEvent(
-            dhToH(reactivateTimes[i]),
-            (Sched::VoidPtrCallback) reactivate, rd);
+        uint step = strtoul(timeStepChanges[i + 1].c_str(), NULL, 10);
+        specs.push_back(
+            { dhToH(timeStepChanges[i]), NS_EVENT_TIME_STEP, NULL, step });
     }
 
-    // schedule HPC freezing/unfreezing
+    // reactivations
     //
-    vector<string> hpcFreezeTimes = 
-        props.getStringVector("hpcFreezeTimes", vector<string>());
-    for (uint i = 0; i <  hpcFreezeTimes.size(); i++) {
-        FreezeData *ld = new FreezeData(hpcLayerId, Util::isEven(i));
-        Sched::scheduleEvent(
-            dhToH(hpcFreezeTimes[i]),
-            (Sched::VoidPtrCallback) setFrozen, ld);
+    for (auto &t : p.getStringVector("reactivateTimes", none)) {
+        specs.push_back({ dhToH(t), NS_EVENT_REACTIVATE, NULL, 0 });
     }
 
-    // schedule ACC freezing/unfreezing
+    // HPC and ACC freezing/unfreezing
     //
-    vector<string> accFreezeTimes = 
-        props.getStringVector("accFreezeTimes", vector<string>());
-    for (uint i = 0; i <  accFreezeTimes.size(); i++) {
-        FreezeData *ld = new FreezeData(accLayerId, Util::isEven(i));
-        Sched::scheduleEvent(
-            dhToH(accFreezeTimes[i]),
-            (Sched::VoidPtrCallback) setFrozen, ld);
-    }
+    addToggleEventSpecs(specs, NS_EVENT_FREEZE, hpcLayerId,
+                        p.getStringVector("hpcFreezeTimes", none));
+    addToggleEventSpecs(specs, NS_EVENT_FREEZE, accLayerId,
+                        p.getStringVector("accFreezeTimes", none));
 
-    // schedule HPC lesioning
+    // HPC and ACC lesioning
     //
-    string hpcLesionTime = props.getString("hpcLesionTime", "");
+    string hpcLesionTime = p.getString("hpcLesionTime", "");
     if (!hpcLesionTime.empty()) {
-        LesionData *ld = new LesionData(hpcLayerId);
-        Sched::scheduleEvent(
-            dhToH(hpcLesionTime),
-            (Sched::VoidPtrCallback) lesion, ld);
+        specs.push_back(
+            { dhToH(hpcLesionTime), NS_EVENT_LESION, &hpcLayerId, 0 });
     }
-
-    // schedule ACC lesioning
-    //
-    string accLesionTime = props.getString("accLesionTime", "");
+    string accLesionTime = p.getString("accLesionTime", "");
     if (!accLesionTime.empty()) {
-        LesionData *ld = new LesionData(accLayerId);
-        Sched::scheduleEvent(
-            dhToH(accLesionTime),
-            (Sched::VoidPtrCallback) lesion, ld);
+        specs.push_back(
+            { dhToH(accLesionTime), NS_EVENT_LESION, &accLayerId, 0 });
     }
 
-    // Schedule PSI infusions
+    // PSI infusions
     //
-    vector<string> none; // default: no PSI events
-    schedulePsiEvents(hpcLayerId, props.getStringVector("hpcPsiTimes", none));
-    schedulePsiEvents(accLayerId, props.getStringVector("accPsiTimes", none));
-    schedulePsiEvents(sc0LayerId, props.getStringVector("sc0PsiTimes", none));
-    schedulePsiEvents(sc1LayerId, props.getStringVector("sc1PsiTimes", none));
+    addToggleEventSpecs(specs, NS_EVENT_PSI, hpcLayerId,
+                        p.getStringVector("hpcPsiTimes", none));
+    addToggleEventSpecs(specs, NS_EVENT_PSI, accLayerId,
+                        p.getStringVector("accPsiTimes", none));
+    addToggleEventSpecs(specs, NS_EVENT_PSI, sc0LayerId,
+                        p.getStringVector("sc0PsiTimes", none));
+    addToggleEventSpecs(specs, NS_EVENT_PSI, sc1LayerId,
+                        p.getStringVector("sc1PsiTimes", none));
+
+    return specs;
+}
+
+/**
+ * Schedule an event. The actions capture only a pointer to the layer ID
+ * and a number, so that the scheduler can store them without allocating.
+ * @param e Event specification
+ */
+static void scheduleEvent(const NsEventSpec &e)
+{
+    const string *layerId = e.layerId;
+    uint arg = e.arg;
+
+    switch (e.type) {
+    case NS_EVENT_TIME_STEP:
+        Sched::schedule(e.time, [arg](double stime, double now) {
+            changeTimeStep(stime, now, arg);
+        });
+        break;
+    case NS_EVENT_REACTIVATE:
+        Sched::schedule(e.time, reactivate);
+        break;
+    case NS_EVENT_FREEZE:
+        Sched::schedule(e.time, [layerId, arg](double stime, double now) {
+            setFrozen(stime, now, *layerId, arg);
+        });
+        break;
+    case NS_EVENT_LESION:
+        Sched::schedule(e.time, [layerId](double stime, double now) {
+            lesion(stime, now, *layerId);
+        });
+        break;
+    case NS_EVENT_PSI:
+        Sched::schedule(e.time, [layerId, arg](double stime, double now) {
+            togglePsi(stime, now, *layerId, arg);
+        });
+        break;
+    }
+}
+
+/**
+ * Schedule the events specified by a set of props
+ * @param p Props
+ * @param after Only schedule the events after this time (hours)
+ */
+static void scheduleEvents(Props &p, double after = -1)
+{
+    for (auto &e : getEventSpecs(p)) {
+        if (e.time > after) {
+            scheduleEvent(e);
+        }
+    }
+}
 
+/**
+ * Get the events specified by a set of props as branch events, i.e.
+ * their times and strings that tell them apart
+ * @param p Props
+ */
+static vector<NsBranchEvent> getBranchEvents(Props &p)
+{
+    vector<NsBranchEvent> events;
+    for (auto &e : getEventSpecs(p)) {
+        events.push_back(
+            { e.time, fmt::format("{} {} {}", e.type,
+                                   e.layerId ? *e.layerId : "", e.arg) });
+    }
+    return events;
 }
 
 /**
@@ -325,12 +383,30 @@ static void presentPattern(const string &id)
     nsSystem->printGrids(fmt::format("Pattern {}", id));
 }
 
+/**
+ * Process the events scheduled up to simTime. When running a branch
+ * file, first branch off the variants whose events differ from this
+ * process's up to simTime, and reschedule the events if this process
+ * is one of the new branches.
+ */
+static void processEvents()
+{
+    double after;
+    Props *variantProps = branch_point(simTime, after);
+    if (variantProps != NULL) {
+        Sched::discardEvents(DBL_MAX);
+        scheduleEvents(*variantProps, after);
+    }
+    Sched::processEvents(simTime);
+    lastEventTime = simTime;
+}
+
 /**
  * Execute a time step of simulation
  */
 static void iterate()
 {
-    Sched::processEvents(simTime);
+    processEvents();
     nsSystem->runBackgroundProcesses();
     simTime += timeStep;
 }
@@ -341,13 +417,18 @@ static void iterate()
  */
 void test()
 {
+    NsLayer *sc1Layer = nsSystem->getLayer(sc1LayerId);
+    NsPatternHandle target = findPattern("CS-US");
+
     nsSystem->test(sc0LayerId, "CS-US", "intact");
+    scores_add(NS_SCORE_INTACT, sc1Layer, target);
 
     bool accWasFrozen = nsSystem->getLayer(accLayerId)->isFrozen;
     if (!accWasFrozen) {
         nsSystem->setFrozen(accLayerId, true);
     }
     nsSystem->test(sc0LayerId, "CS-US", "acc-frozen");
+    scores_add(NS_SCORE_ACC_FROZEN, sc1Layer, target);
     if (!accWasFrozen) {
         nsSystem->setFrozen(accLayerId, false);
     }
@@ -357,39 +438,65 @@ void test()
         nsSystem->setFrozen(hpcLayerId, true);
     }
     nsSystem->test(sc0LayerId, "CS-US", "hpc-frozen");
+    scores_add(NS_SCORE_HPC_FROZEN, sc1Layer, target);
     if (!hpcWasFrozen) {
         nsSystem->setFrozen(hpcLayerId, false);
     }
 }
 
+/**
+ * Write a checkpoint if one is due, i.e. if a multiple of
+ * checkpointInterval has been reached, or at the end of the run.
+ */
+static void checkpointIfDue()
+{
+    if (checkpointFile.empty()) return;
+
+    if (simTime >= nextCheckpointTime || simTime >= stopTime) {
+        checkpoint_write(nsSystem, checkpointFile, lastEventTime);
+        while (nextCheckpointTime <= simTime) {
+            nextCheckpointTime += checkpointInterval;
+        }
+    }
+}
+
 /**
  * Run the simulation
+ * @param restarted Whether the system state was restored from a
+ *        checkpoint, rather than to be trained from scratch
  */
-static void run()
+static void run(bool restarted)
 {
-    simTime = 0;
-    nsSystem->calcRates();
+    if (!restarted) {
+        simTime = 0;
+        nsSystem->calcRates();
     
-    // Process events scheduled for time=0, if any.
-    //
-    Sched::processEvents(simTime);
+        // Process events scheduled for time=0, if any.
+        //
+        processEvents();
+
+        // Present background pattens if defined
+        //
+        for (uint i = 0; i < numBackgroundPatterns; i++) {
+            presentPattern(fmt::format("dummy-{}", i));
+            nsSystem->train();
+            iterate();
+        }
 
-    // Present background pattens if defined
-    //
-    for (uint i = 0; i < numBackgroundPatterns; i++) {
-        presentPattern(fmt::format("dummy-{}", i));
+        // Present the training (CS-US) pattern
+        //
+        presentPattern("CS-US");
         nsSystem->train();
-        iterate();
-    }
-
-    // Present the training (CS-US) pattern
-    //
-    presentPattern("CS-US");
-    nsSystem->train();
 
-    // Print the initial system state
-    //
-    printSystem();
+        // Print the initial system state
+        //
+        printSystem();
+        snapshots_due();
+    } else {
+        snapshots_skip();
+    }
+    nextCheckpointTime = (simTime / checkpointInterval + 1) *
+        checkpointInterval;
 
     // Print state headers
     //
@@ -401,6 +508,8 @@ static void run()
         iterate();
         if (TRACE_INFO_IS_ON) nsSystem->printState();
         test();
+        snapshots_due();
+        checkpointIfDue();
     }
 }
 
@@ -417,14 +526,16 @@ const int STR  = Util::OPTARG_STR;
 bool   help            = false;
 const char *traceLevel = "undefined";
 const char *traceTags  = "undefined";
+const char *branchFile = NULL;
 
 char *pname;
 vector<Util::ParseOptSpec> optSpecs = {
     { "tl",       STR,  &traceLevel,    "traceLevel", ""                  },
     { "tt",       STR,  &traceTags,     "traceTags",  ""                  },
+    { "branch",   STR,  &branchFile,    "branchFile", ""                  },
     { "help",     NONE, &help,          "",           ""                  },
 };
-vector<string>nonFlags = { "[propname=value...] propsFilePath" };
+vector<string>nonFlags = { "[propname=value...] propsFilePath|outDir" };
 
 /**
  * Construct a syntax string for use in an invocation error message
@@ -505,6 +616,14 @@ int main(int argc, char *argv[])
         props.setString(cmdLineProps[i].name, cmdLineProps[i].value, true);
     }
 
+    // With -branch, the argument is the output directory, and this
+    // process runs (the first of) one family of the branch file's variants
+    //
+    if (branchFile != NULL) {
+        propsFilePath = branch_start(branchFile, propsFilePath, props,
+                                     eventPropNames, getBranchEvents);
+    }
+
     // Load properties from the props file
     //
     props.readProps(propsFilePath);
@@ -536,15 +655,35 @@ int main(int argc, char *argv[])
         Trace::setTraceTag(tag);
     }
 
-    // Print out the property value
+    // Print out the property value. When branching, it is written to
+    // each variant's output by branch_finish()
     //
-    fmt::print("===================================\n");
-    fmt::print("{}", props.toString());
-    fmt::print("===================================\n");
+    if (branchFile == NULL) {
+        fmt::print("===================================\n");
+        fmt::print("{}", props.toString());
+        fmt::print("===================================\n");
+    }
 
-    // Create the system
+    // Set up the replicates' random number streams and outputs
+    //
+    replicates_init();
+    ABORT_IF(branchFile != NULL && numReplicates != 1,
+             "-branch requires replicates=1");
+    output_open();
+    ABORT_IF(branchFile != NULL && recordOutput,
+             "-branch cannot be combined with recordOutput");
+    scores_init();
+    ABORT_IF(branchFile != NULL && scoreOutput,
+             "-branch cannot be combined with scoreOutput");
+    log_open();
+    ABORT_IF(branchFile != NULL && asyncOutput,
+             "-branch cannot be combined with asyncOutput");
+
+    // Resolve the model parameters, and create the system
     //
-    nsSystem = new NsSystem(props);
+    auto time_before_build = std::chrono::system_clock::now();
+    params_init();
+    nsSystem = new NsSystem(params_system());
 
     // Initialize the simulation time step to 24h; It may be changed
     // dynamically during the simulation, as specified by the
@@ -559,25 +698,74 @@ int main(int argc, char *argv[])
     // Initialize the system and schedule events
     //
     buildSystem();
+    auto time_after_build = std::chrono::system_clock::now();
     printSystem();
-    scheduleEvents();
+    scheduleEvents(props);
+
+    // Connection state snapshots, at the times in snapshotTimes
+    // (days[:hours]) and, with snapshotEvents, after events
+    //
+    vector<uint> snapshotTimes;
+    for (auto &t : props.getStringVector("snapshotTimes", {})) {
+        snapshotTimes.push_back(dhToH(t));
+    }
+    snapshots_open(nsSystem, snapshotTimes);
+    ABORT_IF(branchFile != NULL && snapshotOutput,
+             "-branch cannot be combined with snapshotOutput");
+
+    // Checkpointing: write checkpoints to checkpointFile every
+    // checkpointInterval (days[:hours]) of simulated time and at the end
+    // of the run; start from the checkpoint in restartFile, if any.
+    //
+    checkpointFile = props.getString("checkpointFile", "");
+    checkpointInterval = dhToH(props.getString("checkpointInterval", "1"));
+    ABORT_IF(checkpointInterval == 0, "checkpointInterval must be > 0");
+    restartFile = props.getString("restartFile", "");
+    ABORT_IF(branchFile != NULL &&
+             !(checkpointFile.empty() && restartFile.empty()),
+             "-branch cannot be combined with checkpointFile or restartFile");
 
     props.reportUnused(true);
 
+    if (!restartFile.empty()) {
+        checkpoint_read(nsSystem, restartFile);
+    }
+
     // Run the simulation
     //
 
     auto time_before_run = std::chrono::system_clock::now();
 
-    run();
+    run(!restartFile.empty());
 
     auto time_after_run = std::chrono::system_clock::now();
 
+    log_close();
+
     std::chrono::duration<double> elapsed_time_setup = time_after_run - time_before_setup;
     std::chrono::duration<double> elapsed_time_run = time_after_run - time_before_run;
+    std::chrono::duration<double> elapsed_time_build = time_after_build - time_before_build;
+
+    if (recordOutput) {
+        for (uint r = 0; r < numReplicates; r++) {
+            output_record(r, NS_REC_TIMING, 0, 0, 0,
+                          elapsed_time_setup.count(),
+                          elapsed_time_run.count(),
+                          elapsed_time_build.count());
+        }
+    } else {
+        fmt::print("timing: {} {} {}\n",
+                   elapsed_time_setup.count(),
+                   elapsed_time_run.count(),
+                   elapsed_time_build.count());
+    }
 
-    fmt::print("timing: {} {}\n",
-               elapsed_time_setup.count(),
-               elapsed_time_run.count());
+    snapshots_close();
+    scores_close();
+    output_close();
+    replicates_close();
 
+    if (branchFile != NULL) {
+        return branch_finish();
+    }
 }
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <vector>
+#include <unordered_map>
+
+#include "NsOutput.hh"
+#include "NsGlobals.hh"
+#include "NsReplicates.hh"
+#include "Trace.hh"
+
+bool recordOutput = false;
+
+static std::vector<FILE *> recordFiles;     // per replicate
+static std::unordered_map<string, uint32_t> names;
+
+/**
+ * Write records to all replicates' record files
+ */
+static void writeAll(const void *buf, size_t size)
+{
+    for (auto f : recordFiles) {
+        ABORT_IF(fwrite(buf, 1, size, f) != size,
+                 "Cannot write record file: {}", strerror(errno));
+    }
+}
+
+/**
+ * Open the record files, if recordOutput is set. Must be called after
+ * replicates_init().
+ */
+void output_open()
+{
+    recordOutput = props.getBool("recordOutput", false);
+    if (!recordOutput) return;
+
+    string prefix = props.getString("replicateOutputPrefix", "");
+    string recordFile = props.getString("recordFile", "ns.rec");
+    for (uint r = 0; r < numReplicates; r++) {
+        string path = prefix.empty() ? recordFile
+                                     : fmt::format("{}{}.rec", prefix, r);
+        FILE *f = fopen(path.c_str(), "w");
+        ABORT_IF(f == NULL, "Cannot create {}", path);
+
+        NsRecordFileHeader hdr;
+        memcpy(hdr.magic, "NSRO", 4);
+        hdr.version = recordFileVersion;
+        hdr.recordSize = sizeof(NsRecord);
+        hdr.replicate = r;
+        hdr.numRanks = 1;
+        ABORT_IF(fwrite(&hdr, sizeof(hdr), 1, f) != 1,
+                 "Cannot write {}", path);
+        recordFiles.push_back(f);
+    }
+}
+
+/**
+ * Get the index of a name, writing an NS_REC_NAME record for it to all
+ * record files if it is new
+ */
+uint32_t output_name(const string &name)
+{
+    auto it = names.find(name);
+    if (it != names.end()) {
+        return it->second;
+    }
+    uint32_t id = names.size();
+    names.insert({name, id});
+
+    NsRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.type = NS_REC_NAME;
+    rec.id = id;
+    rec.id2 = name.size();
+    writeAll(&rec, sizeof(rec));
+
+    uint numRecs = (name.size() + sizeof(NsRecord) - 1) / sizeof(NsRecord);
+    std::vector<char> bytes(numRecs * sizeof(NsRecord), 0);
+    memcpy(bytes.data(), name.data(), name.size());
+    writeAll(bytes.data(), bytes.size());
+
+    return id;
+}
+
+/**
+ * Write a record to a replicate's record file
+ */
+void output_record(uint r, NsRecordType type, uint32_t id, uint32_t id2,
+                   uint32_t id3, double v0, double v1, double v2,
+                   uint16_t flags)
+{
+    NsRecord rec;
+    rec.type = type;
+    rec.flags = flags;
+    rec.id = id;
+    rec.id2 = id2;
+    rec.id3 = id3;
+    rec.time = simTime / 24.;
+    rec.values[0] = v0;
+    rec.values[1] = v1;
+    rec.values[2] = v2;
+    ABORT_IF(fwrite(&rec, sizeof(rec), 1, recordFiles[r]) != 1,
+             "Cannot write record file: {}", strerror(errno));
+}
+
+/**
+ * Close the record files
+ */
+void output_close()
+{
+    for (auto f : recordFiles) {
+        fclose(f);
+    }
+    recordFiles.clear();
+}
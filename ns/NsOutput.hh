@@ -0,0 +1,82 @@
+#ifndef NS_OUTPUT_HH
+#define NS_OUTPUT_HH
+
+#include <stdint.h>
+#include <string>
+using std::string;
+
+/**
+ * Binary run output
+ *
+ * By default, ns reports scores, layer and tract summaries, unit and
+ * connection state and timings as text lines, which scripts such as
+ * multi_ns then parse again. With recordOutput=true, these go instead to
+ * a binary record file per replicate: <replicateOutputPrefix><r>.rec if
+ * the replicates write to files, otherwise recordFile (default ns.rec).
+ * Trace messages and, with printPatterns, the activation grids remain text.
+ *
+ * The file starts with an NsRecordFileHeader, followed by NsRecords.
+ * Strings such as conditions and layer IDs are stored once, in an
+ * NS_REC_NAME record that precedes the first record that refers to them,
+ * and are referred to by their index. The name's bytes follow its
+ * NS_REC_NAME record, padded to a whole number of records.
+ *
+ * All times are simulation times in days. The MPI engines write the same
+ * records to their shared <prefix>.rec (see their NsOutput.hh), so
+ * NsRecordReader reads the record files of all engines, and the nsrec
+ * tool prints them in the text format.
+ */
+
+enum NsRecordType {
+    NS_REC_NAME            = 1, // id: name index; id2: length in bytes
+    NS_REC_SCORE           = 2, // id: condition; id2: layer; values: target
+                                // size, hits, extras
+    NS_REC_NUM_ACTIVE      = 3, // id: layer; values[0]: active units
+    NS_REC_NUM_POTENTIATED = 4, // id: tract; values[0]: potentiated
+                                // connections
+    NS_REC_TIMING          = 5, // id: MPI rank (0 for ns); values: total,
+                                // run and network construction (ns) or
+                                // setup (MPI engines) time in seconds
+    NS_REC_UNIT            = 6, // id: layer; id2: unit index;
+                                // values[0]: active
+    NS_REC_CONN            = 7  // id: tract; id2, id3: from-unit and
+                                // to-unit indices; values: PSD size,
+                                // CI-AMPARs, CP-AMPARs;
+                                // flags: NS_REC_POTENTIATED, NS_REC_HEBBIAN
+};
+
+enum NsRecordFlags {
+    NS_REC_POTENTIATED = 1,
+    NS_REC_HEBBIAN     = 2
+};
+
+static const uint32_t recordFileVersion = 2;
+
+struct NsRecordFileHeader {
+    char     magic[4];    // "NSRO"
+    uint32_t version;
+    uint32_t recordSize;  // sizeof(NsRecord)
+    uint32_t replicate;
+    uint32_t numRanks;    // 1 for ns, number of ranks for the MPI engines
+};
+
+struct NsRecord {
+    uint16_t type;
+    uint16_t flags;
+    uint32_t id;
+    uint32_t id2;
+    uint32_t id3;
+    double   time;        // simTime in days
+    double   values[3];
+};
+
+extern bool recordOutput;
+
+void output_open();
+uint32_t output_name(const string &name);
+void output_record(uint r, NsRecordType type, uint32_t id, uint32_t id2,
+                   uint32_t id3, double v0, double v1 = 0.0,
+                   double v2 = 0.0, uint16_t flags = 0);
+void output_close();
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef NS_PARAMS_HH
+#define NS_PARAMS_HH
+
+#include <string>
+using std::string;
+
+/**
+ * Model parameters
+ *
+ * The props are looked up by name, so reading them in the constructors
+ * of the model's objects costs a string search per value per object,
+ * e.g. per unit. Instead, each set of parameters below is resolved from
+ * the props once, including values given by expressions or in included
+ * props files, range checked, and shared by reference by the objects
+ * that use it:
+ *
+ *  - NsUnitParams, NsConnectionParams and NsSystemParams are global and
+ *    resolved by params_init(), which must be called after the props
+ *    have been read and before the system is created,
+ *  - NsLayerParams are resolved per layer ID (<id>.width, ...), and
+ *    NsTractParams per tract type (<type>.acqLearnRate, ...), the first
+ *    time they are requested.
+ */
+
+struct NsUnitParams {
+    double actFuncK;
+    double actThreshold;
+};
+
+struct NsLayerParams {
+    uint   width;
+    uint   height;
+    double k;
+    double minInhibition;
+    double maxInhibition;
+    double initInhibition;
+    double inhibIncr;
+    bool   orthogonalPatterns;
+    bool   printPatterns;
+};
+
+struct NsTractParams {
+    double acqLearnRate;
+    double reactE3Level;            // E3 level after reactivation
+    double consLearnRate01h;
+    double psdDecayRate01h;
+    double cpAmparRemovalRate01h;
+    double ciAmparInsertionRate01h;
+    double ciAmparRemovalRate01h;
+    double baseDepotProb01h;
+    double maxE3DepotProb01h;       // when e3Level = 1.0
+    double e3DecayRate01h;
+    double maxPotProb01h;
+};
+
+struct NsConnectionParams {
+    double minPsdSize;
+    double maxPsdSize;
+    double minNumCiAmpars;
+    double minNumCpAmpars;
+    double potProbK;
+    double potProbHalf;
+};
+
+struct NsSystemParams {
+    uint trainNumStimCycles;
+    uint consNumStimCycles;
+    uint reactNumStimCycles;
+    uint numSettleCycles;
+};
+
+void params_init();
+const NsUnitParams &params_unit();
+const NsLayerParams &params_layer(const string &id);
+const NsTractParams &params_tract(const string &type);
+const NsConnectionParams &params_connection();
+const NsSystemParams &params_system();
+
+#endif
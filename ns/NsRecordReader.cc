@@ -0,0 +1,60 @@
+#include <string.h>
+
+#include "NsRecordReader.hh"
+#include "Trace.hh"
+
+/**
+ * Open a record file and check its header
+ * @param path Record file path
+ */
+NsRecordReader::NsRecordReader(const string &path)
+    : path(path)
+{
+    f = fopen(path.c_str(), "r");
+    ABORT_IF(f == NULL, "Cannot open {}", path);
+    ABORT_IF(fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+             memcmp(hdr.magic, "NSRO", 4) != 0,
+             "{} is not an ns record file", path);
+    ABORT_IF(hdr.version != recordFileVersion,
+             "{} has version {}, expected {}",
+             path, hdr.version, recordFileVersion);
+    ABORT_IF(hdr.recordSize != sizeof(NsRecord),
+             "{} has records of {} bytes, expected {}",
+             path, hdr.recordSize, sizeof(NsRecord));
+}
+
+NsRecordReader::~NsRecordReader()
+{
+    fclose(f);
+}
+
+/**
+ * Read the next data record
+ * @param rec Set to the record
+ * @return false at the end of the file
+ */
+bool NsRecordReader::next(NsRecord &rec)
+{
+    while (fread(&rec, sizeof(rec), 1, f) == 1) {
+        if (rec.type != NS_REC_NAME) {
+            return true;
+        }
+        ABORT_IF(rec.id != names.size(), "{}: name {} out of order",
+                 path, rec.id);
+        uint numRecs = (rec.id2 + sizeof(NsRecord) - 1) / sizeof(NsRecord);
+        vector<char> bytes(numRecs * sizeof(NsRecord));
+        ABORT_IF(fread(bytes.data(), 1, bytes.size(), f) != bytes.size(),
+                 "{}: truncated name record", path);
+        names.push_back(string(bytes.data(), rec.id2));
+    }
+    return false;
+}
+
+/**
+ * Get a name by its index
+ */
+const string &NsRecordReader::name(uint32_t id) const
+{
+    ABORT_IF(id >= names.size(), "{}: undefined name {}", path, id);
+    return names[id];
+}
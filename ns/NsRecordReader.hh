@@ -0,0 +1,43 @@
+#ifndef NS_RECORD_READER_HH
+#define NS_RECORD_READER_HH
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+using std::vector;
+using std::string;
+
+#include "NsOutput.hh"
+
+/**
+ * Reader of the record files written with recordOutput=true and of the
+ * MPI engines' <prefix>.rec files (see NsOutput.hh). Name records are
+ * consumed by the reader, which returns only the data records, whose name
+ * indices can be resolved with name().
+ *
+ *     NsRecordReader reader(path);
+ *     NsRecord rec;
+ *     while (reader.next(rec)) {
+ *         if (rec.type == NS_REC_SCORE) {
+ *             ... reader.name(rec.id), reader.name(rec.id2) ...
+ *         }
+ *     }
+ */
+class NsRecordReader {
+public:
+    NsRecordReader(const string &path);
+    ~NsRecordReader();
+
+    bool next(NsRecord &rec);
+    const string &name(uint32_t id) const;
+    uint getReplicate() const { return hdr.replicate; }
+    uint getNumRanks() const { return hdr.numRanks; }
+
+private:
+    string path;
+    FILE *f;
+    NsRecordFileHeader hdr;
+    vector<string> names;
+};
+
+#endif
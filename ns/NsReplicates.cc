@@ -0,0 +1,133 @@
+#include <random>
+#include <sstream>
+
+#include "NsReplicates.hh"
+#include "NsGlobals.hh"
+#include "Util.hh"
+#include "Trace.hh"
+
+uint numReplicates = 1;
+
+static std::vector<std::mt19937_64> streams;
+static std::vector<FILE *> outputs;
+
+/**
+ * Set up the random number streams and output files of all replicates,
+ * as specified by the 'replicates' and 'replicateOutputPrefix' properties
+ */
+void replicates_init()
+{
+    numReplicates = props.getUint("replicates", 1);
+    string prefix = props.getString("replicateOutputPrefix", "");
+    ABORT_IF(numReplicates == 0, "replicates must be at least 1");
+    ABORT_IF(numReplicates > 1 && prefix.empty(),
+             "replicates > 1 requires replicateOutputPrefix");
+
+    for (uint r = 0; r < numReplicates; r++) {
+        if (numReplicates == 1 && prefix.empty()) {
+            outputs.push_back(stdout);
+        } else {
+            string path = fmt::format("{}{}.raw", prefix, r);
+            FILE *f = fopen(path.c_str(), "w");
+            ABORT_IF(f == NULL, "Cannot create {}", path);
+            outputs.push_back(f);
+        }
+        streams.push_back(std::mt19937_64(
+            Util::randInt(0, RAND_MAX) ^ ((uint64_t) r << 32)));
+    }
+}
+
+/**
+ * Close the replicates' output files
+ */
+void replicates_close()
+{
+    for (auto f : outputs) {
+        if (f != stdout) {
+            fclose(f);
+        }
+    }
+    outputs.clear();
+}
+
+FILE *replicateOutput(uint r)
+{
+    return outputs[r];
+}
+
+/**
+ * Generate a random double in [0, 1[ from a replicate's stream
+ */
+double replicateRandDouble(uint r)
+{
+    if (numReplicates == 1) {
+        return Util::randDouble(0.0, 1.0);
+    }
+    return std::generate_canonical<double, 53>(streams[r]);
+}
+
+/**
+ * Generate a random integer in [min, max[ from a replicate's stream
+ */
+int replicateRandInt(uint r, int min, int max)
+{
+    if (numReplicates == 1) {
+        return Util::randInt(min, max);
+    }
+    return min + (int) ((max - min) * replicateRandDouble(r));
+}
+
+/**
+ * Create a random set of n unique uints in the range [0, max[ from a
+ * replicate's stream
+ */
+NsPattern replicateRandUniqueUintList(uint r, uint n, uint max)
+{
+    if (numReplicates == 1) {
+        return Util::randUniqueUintList(n, max);
+    }
+    ABORT_IF(n > max, "Can't pick {} unique values out of {}", n, max);
+    NsPattern all(max);
+    for (uint i = 0; i < max; i++) {
+        all[i] = i;
+    }
+    for (uint i = 0; i < n; i++) {
+        std::swap(all[i], all[replicateRandInt(r, i, max)]);
+    }
+    all.resize(n);
+    return all;
+}
+
+/**
+ * Get the state of all random number generators used by the replicates:
+ * that of Util, followed by that of each replicate's stream
+ */
+vector<string> replicates_getRandState()
+{
+    vector<string> state = { Util::getRandState() };
+    for (auto &s : streams) {
+        std::ostringstream os;
+        os << s;
+        state.push_back(os.str());
+    }
+    return state;
+}
+
+/**
+ * Restore a state obtained from replicates_getRandState
+ * @return false, leaving the generators untouched, if the state is
+ *         that of a different number of streams
+ */
+bool replicates_setRandState(const vector<string> &state)
+{
+    if (state.size() != streams.size() + 1) {
+        return false;
+    }
+    Util::setRandState(state[0]);
+    for (uint r = 0; r < streams.size(); r++) {
+        std::istringstream is(state[r + 1]);
+        is >> streams[r];
+        ABORT_IF(is.fail(), "Bad random state for replicate {}", r);
+    }
+    return true;
+}
@@ -0,0 +1,40 @@
+#ifndef NS_REPLICATES_HH
+#define NS_REPLICATES_HH
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+using std::vector;
+using std::string;
+
+#include "NsPattern.hh"
+
+/**
+ * Replicate batching
+ *
+ * With the 'replicates' property set to R > 1, one ns process simulates R
+ * independent replicates of the same props file. The topology and the
+ * event schedule are built once and shared; everything that differs
+ * between replicates (unit activations, layer inhibition, patterns and
+ * connection state) is stored replicate-major, i.e. as R consecutive
+ * values per unit or connection, so that the per-replicate loops in the
+ * inner kernels are contiguous and can be vectorized.
+ *
+ * Each replicate draws from its own random number stream and writes its
+ * scores, in the usual format, to <replicateOutputPrefix><r>.raw.
+ *
+ * With R = 1 (the default), the random numbers come from Util and the
+ * output goes to stdout, exactly as before.
+ */
+extern uint numReplicates;
+
+void replicates_init();
+void replicates_close();
+FILE *replicateOutput(uint r);
+double replicateRandDouble(uint r);
+int replicateRandInt(uint r, int min, int max);
+NsPattern replicateRandUniqueUintList(uint r, uint n, uint max);
+vector<string> replicates_getRandState();
+bool replicates_setRandState(const vector<string> &state);
+
+#endif
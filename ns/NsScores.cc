@@ -0,0 +1,157 @@
+#include <math.h>
+#include <algorithm>
+
+#include "NsScores.hh"
+#include "NsGlobals.hh"
+#include "NsReplicates.hh"
+#include "Trace.hh"
+
+bool scoreOutput = false;
+
+static double extraPenalty;
+static vector<FILE *> scoreFiles;           // per replicate
+static FILE *statsFile = NULL;
+
+// Columns of the current test's row, per replicate: hits, extras and
+// score of each condition
+//
+static const uint numScoreCols = 3 * NS_NUM_SCORE_CONDITIONS;
+static vector<vector<double>> row;
+static uint numAdded;
+
+static const char *conditionNames[NS_NUM_SCORE_CONDITIONS] = {
+    "intact", "hpc", "acc"
+};
+
+/**
+ * Open the score tables, if scoreOutput is set. Must be called after
+ * replicates_init().
+ */
+void scores_init()
+{
+    scoreOutput = props.getBool("scoreOutput", false);
+    extraPenalty = props.getDouble("extraPenalty", 0.5);
+    if (!scoreOutput) return;
+
+    string prefix = props.getString("replicateOutputPrefix", "");
+    string scoreFile = props.getString("scoreFile", "ns.out");
+    for (uint r = 0; r < numReplicates; r++) {
+        string path = prefix.empty() ? scoreFile
+                                     : fmt::format("{}{}.out", prefix, r);
+        FILE *f = fopen(path.c_str(), "w");
+        ABORT_IF(f == NULL, "Cannot create {}", path);
+        fmt::print(f, "time");
+        for (uint c = 0; c < NS_NUM_SCORE_CONDITIONS; c++) {
+            fmt::print(f, "{}{}_hits {}_extras {}_score",
+                       c == 0 ? " " : "\t", conditionNames[c],
+                       conditionNames[c], conditionNames[c]);
+        }
+        fmt::print(f, "\n");
+        scoreFiles.push_back(f);
+    }
+
+    if (numReplicates > 1) {
+        string path = prefix + "stats.out";
+        statsFile = fopen(path.c_str(), "w");
+        ABORT_IF(statsFile == NULL, "Cannot create {}", path);
+        fmt::print(statsFile, "time");
+        for (const char *statPrefix : { "", "S_", "E_" }) {
+            for (uint c = 0; c < NS_NUM_SCORE_CONDITIONS; c++) {
+                for (const char *col : { "hits", "extras", "score" }) {
+                    fmt::print(statsFile, "\t{}{}_{}",
+                               statPrefix, conditionNames[c], col);
+                }
+            }
+        }
+        fmt::print(statsFile, "\n");
+    }
+
+    row.assign(numReplicates, vector<double>(numScoreCols, 0.0));
+    numAdded = 0;
+}
+
+/**
+ * Write the mean, sample standard deviation and standard error of each
+ * column of the current row over the replicates
+ */
+static void writeStats()
+{
+    uint n = numReplicates;
+    vector<double> mean(numScoreCols), stdev(numScoreCols);
+    for (uint c = 0; c < numScoreCols; c++) {
+        double sum = 0.0;
+        double sqsum = 0.0;
+        for (uint r = 0; r < n; r++) {
+            sum += row[r][c];
+            sqsum += row[r][c] * row[r][c];
+        }
+        mean[c] = sum / n;
+        stdev[c] = sqrt(std::max(sqsum / n - mean[c] * mean[c], 0.0) *
+                        n / (n - 1));
+    }
+
+    fmt::print(statsFile, "{:.2f}", simTime / 24.);
+    for (uint c = 0; c < numScoreCols; c++) {
+        fmt::print(statsFile, "\t{:.2f}", mean[c]);
+    }
+    for (uint c = 0; c < numScoreCols; c++) {
+        fmt::print(statsFile, "\t{:.2f}", stdev[c]);
+    }
+    for (uint c = 0; c < numScoreCols; c++) {
+        fmt::print(statsFile, "\t{:.2f}", stdev[c] / sqrt(n));
+    }
+    fmt::print(statsFile, "\n");
+}
+
+/**
+ * Score the activations of all replicates of a layer against a target
+ * pattern under a test condition. Once all conditions of a test have been
+ * scored, write the test's row to the score tables.
+ * @param cond Test condition
+ * @param layer Layer to score
+ * @param target Target pattern
+ */
+void scores_add(NsScoreCondition cond, const NsLayer *layer,
+                NsPatternHandle target)
+{
+    if (!scoreOutput || !layer->hasPattern(target)) return;
+
+    for (uint r = 0; r < numReplicates; r++) {
+        uint targetSize, numHits, numExtras;
+        layer->getScore(r, target, targetSize, numHits, numExtras);
+        double score = (numHits - extraPenalty * numExtras) / targetSize;
+        row[r][3 * cond] = numHits;
+        row[r][3 * cond + 1] = numExtras;
+        row[r][3 * cond + 2] = std::max(score, 0.0);
+    }
+    if (++numAdded < NS_NUM_SCORE_CONDITIONS) return;
+    numAdded = 0;
+
+    for (uint r = 0; r < numReplicates; r++) {
+        FILE *f = scoreFiles[r];
+        fmt::print(f, "{}", simTime / 24.);
+        for (uint c = 0; c < numScoreCols; c++) {
+            fmt::print(f, "{}{:g}", (c > 0 && c % 3 == 0) ? "\t" : " ",
+                       row[r][c]);
+        }
+        fmt::print(f, "\n");
+    }
+    if (statsFile != NULL) {
+        writeStats();
+    }
+}
+
+/**
+ * Close the score tables
+ */
+void scores_close()
+{
+    for (auto f : scoreFiles) {
+        fclose(f);
+    }
+    scoreFiles.clear();
+    if (statsFile != NULL) {
+        fclose(statsFile);
+        statsFile = NULL;
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef NS_SCORES_HH
+#define NS_SCORES_HH
+
+#include "NsLayer.hh"
+#include "NsPattern.hh"
+
+/**
+ * Recall scores
+ *
+ * Each test cues the CS pattern in SC0 under three conditions (intact,
+ * HPC frozen, ACC frozen) and compares the pattern retrieved in SC1 with
+ * the US pattern. With scoreOutput=true, ns scores each condition itself,
+ *
+ *     score = max(0, (hits - extraPenalty * extras) / targetSize)
+ *
+ * (extraPenalty defaults to 0.5) and writes a row per test to a score
+ * table per replicate, <replicateOutputPrefix><r>.out if the replicates
+ * write to files, otherwise scoreFile (default ns.out):
+ *
+ *     time intact_hits intact_extras intact_score hpc_hits hpc_extras
+ *     hpc_score acc_hits acc_extras acc_score
+ *
+ * With replicates > 1, it also writes <replicateOutputPrefix>stats.out
+ * with the mean, sample standard deviation (S_ columns) and standard
+ * error (E_ columns) of the score columns over the replicates, as
+ * 'mat -hdr -ind stats' does for score tables of separate runs.
+ */
+enum NsScoreCondition {
+    NS_SCORE_INTACT,
+    NS_SCORE_HPC_FROZEN,
+    NS_SCORE_ACC_FROZEN,
+    NS_NUM_SCORE_CONDITIONS
+};
+
+extern bool scoreOutput;
+
+void scores_init();
+void scores_add(NsScoreCondition cond, const NsLayer *layer,
+                NsPatternHandle target);
+void scores_close();
+
+#endif
@@ -0,0 +1,208 @@
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include <zlib.h>
+
+#include "NsSnapshot.hh"
+#include "NsSystem.hh"
+#include "Trace.hh"
+
+bool snapshotOutput = false;
+
+static const NsSystem *snapSystem = NULL;
+static FILE *snapshotFile = NULL;
+static string snapshotPath;
+static bool snapshotEvents;
+static vector<uint> pendingTimes;           // ascending, hours
+
+// Per tract: the raw arrays of the previous snapshot, and buffers
+//
+static vector<vector<uint8_t>> previous;
+static vector<uint8_t> delta;
+static vector<uint8_t> shuffled;
+static vector<uint8_t> compressed;
+
+/**
+ * Write to the snapshot file
+ */
+static void writeBytes(const void *buf, size_t size)
+{
+    ABORT_IF(fwrite(buf, 1, size, snapshotFile) != size,
+             "Cannot write {}: {}", snapshotPath, strerror(errno));
+}
+
+/**
+ * Open the snapshot file and write its header, if snapshotOutput is set
+ * @param sys The system, whose tracts have been created
+ * @param times Times (hours) at which to take snapshots
+ */
+void snapshots_open(const NsSystem *sys, const vector<uint> &times)
+{
+    snapshotOutput = props.getBool("snapshotOutput", false);
+    snapshotPath = props.getString("snapshotFile", "ns.snap");
+    snapshotEvents = props.getBool("snapshotEvents", false);
+    if (!snapshotOutput) return;
+
+    snapSystem = sys;
+    pendingTimes = times;
+    std::sort(pendingTimes.begin(), pendingTimes.end());
+
+    snapshotFile = fopen(snapshotPath.c_str(), "w");
+    ABORT_IF(snapshotFile == NULL, "Cannot create {}", snapshotPath);
+
+    NsSnapshotFileHeader hdr;
+    memcpy(hdr.magic, "NSSN", 4);
+    hdr.version = snapshotFileVersion;
+    hdr.numReplicates = numReplicates;
+    hdr.numTracts = snapSystem->tracts_vec.size();
+    writeBytes(&hdr, sizeof(hdr));
+
+    for (auto t : snapSystem->tracts_vec) {
+        ABORT_IF(t->connections.size() !=
+                 t->fromLayer->units.size() * t->toLayer->units.size(),
+                 "Tract {} is not fully connected", t->id);
+        NsSnapshotTract st;
+        memset(&st, 0, sizeof(st));
+        st.idLength = t->id.size();
+        st.fromLayerSize = t->fromLayer->units.size();
+        st.toLayerSize = t->toLayer->units.size();
+        writeBytes(&st, sizeof(st));
+        writeBytes(t->id.data(), t->id.size());
+    }
+
+    previous.assign(snapSystem->tracts_vec.size(), vector<uint8_t>());
+}
+
+/**
+ * Write the snapshot block of a tract
+ */
+static void writeTract(uint i, const NsTract *t)
+{
+    size_t n = t->connections.size() * numReplicates;
+    size_t rawSize = 3 * n * sizeof(double) + n;
+
+    // Copy the state into delta, and XOR it with the previous snapshot
+    //
+    delta.resize(rawSize);
+    uint8_t *p = delta.data();
+    for (auto v : { &t->psdSize, &t->numCiAmpars, &t->numCpAmpars }) {
+        memcpy(p, v->data(), n * sizeof(double));
+        p += n * sizeof(double);
+    }
+    for (auto c : t->connections) {
+        for (uint r = 0; r < numReplicates; r++) {
+            *p++ = (c->isPotentiated[r] ? NS_SNAP_POTENTIATED : 0) |
+                   (c->isHebbian(r) ? NS_SNAP_HEBBIAN : 0);
+        }
+    }
+
+    vector<uint8_t> &prev = previous[i];
+    if (prev.empty()) {
+        prev = delta;
+    } else {
+        for (size_t b = 0; b < rawSize; b++) {
+            uint8_t cur = delta[b];
+            delta[b] ^= prev[b];
+            prev[b] = cur;
+        }
+    }
+
+    // Transpose the bytes of each double array
+    //
+    shuffled.resize(rawSize);
+    for (uint a = 0; a < 3; a++) {
+        const uint8_t *src = delta.data() + a * n * sizeof(double);
+        uint8_t *dst = shuffled.data() + a * n * sizeof(double);
+        for (size_t j = 0; j < n; j++) {
+            for (uint k = 0; k < sizeof(double); k++) {
+                dst[k * n + j] = src[j * sizeof(double) + k];
+            }
+        }
+    }
+    memcpy(shuffled.data() + 3 * n * sizeof(double),
+           delta.data() + 3 * n * sizeof(double), n);
+
+    uLongf compressedSize = compressBound(rawSize);
+    compressed.resize(compressedSize);
+    int err = compress2(compressed.data(), &compressedSize,
+                        shuffled.data(), rawSize, Z_DEFAULT_COMPRESSION);
+    ABORT_IF(err != Z_OK, "Cannot compress snapshot of {}: zlib error {}",
+             t->id, err);
+
+    NsSnapshotBlock block;
+    block.rawSize = rawSize;
+    block.compressedSize = compressedSize;
+    writeBytes(&block, sizeof(block));
+    writeBytes(compressed.data(), compressedSize);
+}
+
+/**
+ * Write a snapshot of all tracts
+ * @param label What triggered it
+ */
+static void takeSnapshot(const string &label)
+{
+    NsSnapshotHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, "SNAP", 4);
+    hdr.simTime = simTime;
+    hdr.labelLength = label.size();
+    writeBytes(&hdr, sizeof(hdr));
+    writeBytes(label.data(), label.size());
+
+    for (uint i = 0; i < snapSystem->tracts_vec.size(); i++) {
+        writeTract(i, snapSystem->tracts_vec[i]);
+    }
+    TRACE_DEBUG("Snapshot ({}) at simTime {}", label, simTime);
+}
+
+/**
+ * Drop the snapshot times that have already been reached, e.g. when
+ * restarting from a checkpoint
+ */
+void snapshots_skip()
+{
+    if (!snapshotOutput) return;
+
+    auto end = std::upper_bound(pendingTimes.begin(), pendingTimes.end(),
+                                simTime);
+    pendingTimes.erase(pendingTimes.begin(), end);
+}
+
+/**
+ * Take a snapshot if simTime has reached one or more of the pending
+ * snapshot times
+ */
+void snapshots_due()
+{
+    if (!snapshotOutput || pendingTimes.empty() ||
+        pendingTimes.front() > simTime)
+    {
+        return;
+    }
+    takeSnapshot("time");
+    snapshots_skip();
+}
+
+/**
+ * Take a snapshot after an event, if snapshotEvents is set
+ * @param event Description of the event
+ */
+void snapshots_event(const string &event)
+{
+    if (!snapshotOutput || !snapshotEvents) return;
+
+    takeSnapshot(event);
+}
+
+/**
+ * Close the snapshot file
+ */
+void snapshots_close()
+{
+    if (snapshotFile == NULL) return;
+
+    fclose(snapshotFile);
+    snapshotFile = NULL;
+    previous.clear();
+}
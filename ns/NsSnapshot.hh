@@ -0,0 +1,86 @@
+#ifndef NS_SNAPSHOT_HH
+#define NS_SNAPSHOT_HH
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+
+class NsSystem;
+
+/**
+ * Connection state snapshots
+ *
+ * With snapshotOutput=true, ns writes the state of all connections of
+ * every tract to snapshotFile (default ns.snap):
+ *
+ *  - at the times in snapshotTimes (days[:hours]), or rather at the end
+ *    of the first time step that reaches each of them, and
+ *  - with snapshotEvents=true, after each reactivation, freeze, lesion and
+ *    PSI event.
+ *
+ * Snapshots are compact enough to be taken often, unlike the per-step
+ * "conn" lines of trace level INFO. Each array of a snapshot is XORed
+ * with the same array of the previous snapshot, so that values that did
+ * not change become zero bytes. The bytes of each XORed array are then
+ * transposed (all first bytes of its values, then all second bytes, ...)
+ * to group the zero and the slowly varying bytes, and the arrays are
+ * deflated (zlib). The file consists of
+ *
+ *   NsSnapshotFileHeader
+ *   NsSnapshotTract tracts[numTracts], each followed by the tract ID
+ *   snapshots, each
+ *     NsSnapshotHeader, followed by the label ("time" or the event)
+ *     NsSnapshotBlock per tract, followed by compressedSize bytes
+ *
+ * A block holds, uncompressed, four arrays of numConnections *
+ * numReplicates values in the tract's in-memory order (connection
+ * fromIndex * toLayerSize + toIndex, replicates consecutive): psdSize,
+ * numCiAmpars and numCpAmpars (double) and flags (uint8_t, see
+ * NsSnapshotFlags). NsSnapshotReader decodes snapshot files, and the
+ * nssnap tool converts them to NumPy (.npy) arrays.
+ */
+
+enum NsSnapshotFlags {
+    NS_SNAP_POTENTIATED = 1,
+    NS_SNAP_HEBBIAN     = 2
+};
+
+static const uint32_t snapshotFileVersion = 1;
+
+struct NsSnapshotFileHeader {
+    char     magic[4];        // "NSSN"
+    uint32_t version;
+    uint32_t numReplicates;
+    uint32_t numTracts;
+};
+
+struct NsSnapshotTract {
+    uint32_t idLength;
+    uint32_t fromLayerSize;
+    uint32_t toLayerSize;
+    uint32_t pad;
+};
+
+struct NsSnapshotHeader {
+    char     magic[4];        // "SNAP"
+    uint32_t simTime;         // hours
+    uint32_t labelLength;
+    uint32_t pad;
+};
+
+struct NsSnapshotBlock {
+    uint64_t rawSize;
+    uint64_t compressedSize;
+};
+
+extern bool snapshotOutput;
+
+void snapshots_open(const NsSystem *system, const vector<uint> &times);
+void snapshots_skip();
+void snapshots_due();
+void snapshots_event(const string &event);
+void snapshots_close();
+
+#endif
@@ -0,0 +1,113 @@
+#include <string.h>
+#include <zlib.h>
+
+#include "NsSnapshotReader.hh"
+#include "Trace.hh"
+
+/**
+ * Open a snapshot file and read its header and tract table
+ * @param path Snapshot file path
+ */
+NsSnapshotReader::NsSnapshotReader(const string &path)
+    : path(path)
+{
+    f = fopen(path.c_str(), "r");
+    ABORT_IF(f == NULL, "Cannot open {}", path);
+    ABORT_IF(fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+             memcmp(hdr.magic, "NSSN", 4) != 0,
+             "{} is not an ns snapshot file", path);
+    ABORT_IF(hdr.version != snapshotFileVersion,
+             "{} has version {}, expected {}",
+             path, hdr.version, snapshotFileVersion);
+
+    for (uint t = 0; t < hdr.numTracts; t++) {
+        NsSnapshotTract st;
+        read(&st, sizeof(st));
+        string id(st.idLength, ' ');
+        read(&id[0], st.idLength);
+        tracts.push_back({ id, st.fromLayerSize, st.toLayerSize });
+    }
+    previous.resize(hdr.numTracts);
+}
+
+NsSnapshotReader::~NsSnapshotReader()
+{
+    fclose(f);
+}
+
+/**
+ * Read from the snapshot file, aborting if it is truncated
+ */
+void NsSnapshotReader::read(void *buf, size_t size)
+{
+    ABORT_IF(fread(buf, 1, size, f) != size, "{} is truncated", path);
+}
+
+/**
+ * Read and decode the next snapshot
+ * @param snap Set to the snapshot
+ * @return false at the end of the file
+ */
+bool NsSnapshotReader::next(Snapshot &snap)
+{
+    NsSnapshotHeader sh;
+    if (fread(&sh, sizeof(sh), 1, f) != 1) {
+        return false;
+    }
+    ABORT_IF(memcmp(sh.magic, "SNAP", 4) != 0,
+             "{}: bad snapshot header", path);
+    snap.simTime = sh.simTime;
+    snap.label.assign(sh.labelLength, ' ');
+    read(&snap.label[0], sh.labelLength);
+    snap.tracts.resize(tracts.size());
+
+    for (uint t = 0; t < tracts.size(); t++) {
+        size_t n = (size_t) tracts[t].fromLayerSize *
+            tracts[t].toLayerSize * hdr.numReplicates;
+        size_t rawSize = 3 * n * sizeof(double) + n;
+
+        NsSnapshotBlock block;
+        read(&block, sizeof(block));
+        ABORT_IF(block.rawSize != rawSize,
+                 "{}: snapshot of {} has {} bytes, expected {}",
+                 path, tracts[t].id, block.rawSize, rawSize);
+        compressed.resize(block.compressedSize);
+        read(compressed.data(), block.compressedSize);
+
+        shuffled.resize(rawSize);
+        uLongf size = rawSize;
+        int err = uncompress(shuffled.data(), &size,
+                             compressed.data(), block.compressedSize);
+        ABORT_IF(err != Z_OK || size != rawSize,
+                 "{}: cannot decompress snapshot of {}: zlib error {}",
+                 path, tracts[t].id, err);
+
+        // Undo the byte transposition and the XOR with the previous
+        // snapshot (all zeros before the first one)
+        //
+        vector<uint8_t> &raw = previous[t];
+        raw.resize(rawSize, 0);
+        for (uint a = 0; a < 3; a++) {
+            const uint8_t *src = shuffled.data() + a * n * sizeof(double);
+            uint8_t *dst = raw.data() + a * n * sizeof(double);
+            for (size_t j = 0; j < n; j++) {
+                for (uint k = 0; k < sizeof(double); k++) {
+                    dst[j * sizeof(double) + k] ^= src[k * n + j];
+                }
+            }
+        }
+        for (size_t j = 3 * n * sizeof(double); j < rawSize; j++) {
+            raw[j] ^= shuffled[j];
+        }
+
+        TractState &ts = snap.tracts[t];
+        const uint8_t *p = raw.data();
+        for (auto v : { &ts.psdSize, &ts.numCiAmpars, &ts.numCpAmpars }) {
+            v->resize(n);
+            memcpy(v->data(), p, n * sizeof(double));
+            p += n * sizeof(double);
+        }
+        ts.flags.assign(p, p + n);
+    }
+    return true;
+}
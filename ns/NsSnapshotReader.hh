@@ -0,0 +1,65 @@
+#ifndef NS_SNAPSHOT_READER_HH
+#define NS_SNAPSHOT_READER_HH
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+using std::vector;
+using std::string;
+
+#include "NsSnapshot.hh"
+
+/**
+ * Reader of the snapshot files written with snapshotOutput=true (see
+ * NsSnapshot.hh). next() decodes the next snapshot into the per-tract
+ * arrays of a Snapshot, undoing the compression.
+ *
+ *     NsSnapshotReader reader(path);
+ *     NsSnapshotReader::Snapshot snap;
+ *     while (reader.next(snap)) {
+ *         for (uint t = 0; t < reader.tracts.size(); t++) {
+ *             ... snap.tracts[t].psdSize[c * numReplicates + r] ...
+ *         }
+ *     }
+ */
+class NsSnapshotReader {
+public:
+    struct Tract {
+        string id;
+        uint fromLayerSize;
+        uint toLayerSize;
+    };
+
+    struct TractState {
+        vector<double> psdSize;
+        vector<double> numCiAmpars;
+        vector<double> numCpAmpars;
+        vector<uint8_t> flags;          // NsSnapshotFlags
+    };
+
+    struct Snapshot {
+        uint simTime;                   // hours
+        string label;
+        vector<TractState> tracts;
+    };
+
+    NsSnapshotReader(const string &path);
+    ~NsSnapshotReader();
+
+    bool next(Snapshot &snap);
+    uint getNumReplicates() const { return hdr.numReplicates; }
+
+    vector<Tract> tracts;
+
+private:
+    void read(void *buf, size_t size);
+
+    string path;
+    FILE *f;
+    NsSnapshotFileHeader hdr;
+    vector<vector<uint8_t>> previous;   // per tract, raw arrays
+    vector<uint8_t> compressed;
+    vector<uint8_t> shuffled;
+};
+
+#endif
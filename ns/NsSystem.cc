@@ -2,13 +2,13 @@
 
 /**
  * Constructor
- * @param props Properties
+ * @param params Parameters
  */
-NsSystem::NsSystem(Props &props)
-    : trainNumStimCycles(props.getUint("trainNumStimCycles")),
-      consNumStimCycles(props.getUint("consNumStimCycles")),
-      reactNumStimCycles(props.getUint("reactNumStimCycles")),
-      numSettleCycles(props.getUint("numSettleCycles"))
+NsSystem::NsSystem(const NsSystemParams &params)
+    : trainNumStimCycles(params.trainNumStimCycles),
+      consNumStimCycles(params.consNumStimCycles),
+      reactNumStimCycles(params.reactNumStimCycles),
+      numSettleCycles(params.numSettleCycles)
 {
 }
 
@@ -21,6 +21,10 @@ void NsSystem::addLayer(const string &id, const string &type)
     NsLayer *layer = new NsLayer(id, type);
     std::pair<string, NsLayer *> pair(id, layer);
     layers.insert(pair);
+    layer->intID = layers_vec.size();
+    layers_vec.push_back(layer);
+    inTracts.push_back(vector<NsTract *>());
+    outTracts.push_back(vector<NsTract *>());
 }
 
 /**
@@ -42,6 +46,10 @@ void NsSystem::addTract(const string &fromLayerId,
         new NsTract(id, fromLayer, toLayer, type);
     std::pair<string, NsTract *> pair(id, tract);
     tracts.insert(pair);
+    tract->intID = tracts_vec.size();
+    tracts_vec.push_back(tract);
+    inTracts[toLayer->intID].push_back(tract);
+    outTracts[fromLayer->intID].push_back(tract);
 }
 
 /**
@@ -63,8 +71,8 @@ void NsSystem::addBiTract(const string &layer1Id, const string &layer2Id,
  */
 void NsSystem::calcRates()
 {
-    for (auto &t : tracts) {
-        t.second->calcRates();
+    for (auto t : tracts_vec) {
+        t->calcRates();
     }
 }
 
@@ -73,8 +81,8 @@ void NsSystem::calcRates()
  */
 void NsSystem::acquire(uint numStimCycles, const char *tag)
 {
-    for (auto &t : tracts) {
-        t.second->acquire(numStimCycles, tag);
+    for (auto t : tracts_vec) {
+        t->acquire(numStimCycles, tag);
     }
 }
 
@@ -86,15 +94,15 @@ void NsSystem::acquire(uint numStimCycles, const char *tag)
 void NsSystem::settle()
 {
     for (uint c = 0; c < numSettleCycles; c++) {
-        for (auto &l : layers) {
-            if (!l.second->isFrozen) {
-                l.second->computeNewActivations();
+        for (auto l : layers_vec) {
+            if (!l->isFrozen) {
+                l->computeNewActivations();
             }
         }
-        for (auto &l : layers) {
-            if (!l.second->isFrozen) {
-                l.second->applyNewActivations();
-                l.second->adjustInhibition();
+        for (auto l : layers_vec) {
+            if (!l->isFrozen) {
+                l->applyNewActivations();
+                l->adjustInhibition();
             }
         }
     }
@@ -127,12 +135,12 @@ void NsSystem::consolidate()
     // Activate and clamp a randomly chosen defined pattern in
     // the HPC layer
     //
-    const string &hpcPid = hpcLayer->setRandomPattern();
+    vector<NsPatternHandle> hpcPids = hpcLayer->setRandomPattern();
     hpcLayer->isClamped = true;
 
 #else
     // Randomize the HPC layer
-    const string &hpcPid = "";
+    vector<NsPatternHandle> hpcPids(numReplicates, noPattern);
     hpcLayer->randomize();
 #endif
 
@@ -140,12 +148,12 @@ void NsSystem::consolidate()
 
     settle();
 
-    printGrids("cons-settled", hpcPid);
+    printGrids("cons-settled", hpcPids);
     
     // Learn the pattern settled into: PSD growth
     //
-    for (auto &t : tracts) {
-        t.second->consolidate(consNumStimCycles);
+    for (auto t : tracts_vec) {
+        t->consolidate(consNumStimCycles);
     }
 }
 
@@ -154,11 +162,11 @@ void NsSystem::consolidate()
  */
 void NsSystem::maintain()
 {
-    for (auto &t : tracts) {
-        t.second->maintain();
+    for (auto t : tracts_vec) {
+        t->maintain();
     }
-    for (auto &l : layers) {
-        l.second->maintain();
+    for (auto l : layers_vec) {
+        l->maintain();
     }
 }
 
@@ -167,9 +175,9 @@ void NsSystem::maintain()
  */
 void NsSystem::clear()
 {
-    for (auto &l : layers) {
-        l.second->clear();
-        l.second->isClamped = false;
+    for (auto l : layers_vec) {
+        l->clear();
+        l->isClamped = false;
     }
 }
 
@@ -212,8 +220,9 @@ void NsSystem::retrieve(const string &cueLayerId,
 
     // Set and clamp the specified pattern in the cue layer
     //
+    NsPatternHandle target = findPattern(patternId);
     NsLayer *cueLayer = layers.at(cueLayerId);
-    cueLayer->setPattern(patternId);
+    cueLayer->setPattern(target);
     cueLayer->isClamped = true;
 
     printGrids(fmt::format("{}-present", condition));
@@ -221,7 +230,7 @@ void NsSystem::retrieve(const string &cueLayerId,
     // Cycle until settled
     //
     settle();
-    printGrids(fmt::format("{}-settled", condition), patternId);
+    printGrids(fmt::format("{}-settled", condition), target);
 }
 
 /**
@@ -236,8 +245,8 @@ void NsSystem::test(const string &cueLayerId, const string &patternId,
 {
     // Record inhibition levels before the test
     //
-    for (auto l : layers) {
-        l.second->saveInhibition();
+    for (auto l : layers_vec) {
+        l->saveInhibition();
     }
 
     // Do the test
@@ -247,8 +256,8 @@ void NsSystem::test(const string &cueLayerId, const string &patternId,
     // Restore inhibition levels, in order to leave the system unaffected by
     // the test.
     //
-    for (auto l : layers) {
-        l.second->restoreInhibition();
+    for (auto l : layers_vec) {
+        l->restoreInhibition();
     }
 }
 
@@ -272,8 +281,8 @@ void NsSystem::reactivate()
 
     // Execute reactivation logic in all tracts
     //
-    for (auto &t : tracts) {
-        t.second->reactivate();
+    for (auto t : tracts_vec) {
+        t->reactivate();
     }
 
     // Patterns should disappear from HPC layer's (really, any layer's)
@@ -295,16 +304,17 @@ void NsSystem::reactivate()
 }
 
 /**
- * Toggle PSI on or off in all tracts that terminate on the
+ * Toggle PSI on or off in all tracts that start or terminate on the
  * specified layer.
  */
 void NsSystem::togglePsi(string layerId, bool state)
 {
     NsLayer *layer = getLayer(layerId);
-    for (auto &t : tracts) {
-        if (t.second->fromLayer == layer || t.second->toLayer == layer) {
-            t.second->togglePsi(state);
-        }
+    for (auto t : inTracts[layer->intID]) {
+        t->togglePsi(state);
+    }
+    for (auto t : outTracts[layer->intID]) {
+        t->togglePsi(state);
     }
 }
 
@@ -319,36 +329,50 @@ void NsSystem::printStateHdrs()
 
 void NsSystem::printState() const
 {
-    for (auto &l : layers) {
-        l.second->printState();
+    for (auto l : layers_vec) {
+        l->printState();
+    }
+    for (auto t : tracts_vec) {
+        t->printState();
     }
-    for (auto &t : tracts) {
-        t.second->printState();
+}
+
+void NsSystem::printGrids(const string &tag, NsPatternHandle target) const
+{
+    for (uint r = 0; r < numReplicates; r++) {
+        for (auto l : layers_vec) {
+            l->printGrid(r, tag, target);
+        }
     }
 }
 
+/**
+ * Print the grids of all layers, with a different target per replicate
+ */
 void NsSystem::printGrids(const string &tag,
-                          const string &targetId) const
+                          const vector<NsPatternHandle> &targets) const
 {
-    for (auto &l : layers) {
-        l.second->printGrid(tag, targetId);
+    for (uint r = 0; r < numReplicates; r++) {
+        for (auto l : layers_vec) {
+            l->printGrid(r, tag, targets[r]);
+        }
     }
 }
 
 void NsSystem::printSize()
 {
     uint tot = 0;
-    for (auto &l : layers) {
-        uint n = l.second->units.size();
-        infoTrace("Layer {}: {} units\n", l.second->id, n);
+    for (auto l : layers_vec) {
+        uint n = l->units.size();
+        infoTrace("Layer {}: {} units\n", l->id, n);
         tot += n;
     }
     infoTrace("Total: {} units\n", tot);
 
     tot = 0;
-    for (auto &t : tracts) {
-        uint n = t.second->connections.size();
-        infoTrace("Tract {}: {} connections\n", t.second->id, n);
+    for (auto t : tracts_vec) {
+        uint n = t->connections.size();
+        infoTrace("Tract {}: {} connections\n", t->id, n);
         tot += n;
     }
     infoTrace("Total: {} connections\n", tot);
@@ -358,11 +382,11 @@ void NsSystem::printSize()
 string NsSystem::toStr(uint iLvl, const string &iStr) const
 {
     string ret = Util::repeatStr(iStr, iLvl) + "NsSystem:";
-    for (auto &l : layers) {
-        ret += "\n" + l.second->toStr(iLvl + 1, iStr);
+    for (auto l : layers_vec) {
+        ret += "\n" + l->toStr(iLvl + 1, iStr);
     }
-    for (auto &t : tracts) {
-        ret += "\n" + t.second->toStr(iLvl + 1, iStr);
+    for (auto t : tracts_vec) {
+        ret += "\n" + t->toStr(iLvl + 1, iStr);
     }
 
     return ret;
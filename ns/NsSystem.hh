@@ -11,6 +11,10 @@ using std::unordered_map;
 #include "NsLayer.hh"
 #include "NsTract.hh"
 #include "NsPattern.hh"
+#include "NsReplicates.hh"
+#include "NsOutput.hh"
+#include "NsLog.hh"
+#include "NsParams.hh"
 
 
 static const string hpcLayerId = "HPC";
@@ -24,6 +28,19 @@ static const string ncTractTypeId  = "nc";
 static const string hpcLayerTypeId = "hpc";
 static const string ncLayerTypeId  = "nc";
 
+/**
+ * Write a trace message to an output, through the asynchronous log if
+ * asyncOutput is set
+ */
+inline void traceOutput(FILE *out, const char *fmt, fmt::format_args args)
+{
+    if (asyncOutput) {
+        log_text(out, fmt::vformat(fmt, args));
+    } else {
+        fmt::vprint(out, fmt, args);
+    }
+}
+
 /**
  * Output trace message (without locator) if traceLevel is
  * INFO or lower
@@ -32,7 +49,19 @@ template <typename... Args>
 void infoTrace(const char *fmt, Args ... args)
 {
     if (TRACE_INFO_IS_ON) {
-        fmt::vprint(stdout, fmt, fmt::make_format_args(args...));
+        traceOutput(stdout, fmt, fmt::make_format_args(args...));
+    }
+}
+
+/**
+ * Output trace message (without locator) to a replicate's output if
+ * traceLevel is INFO or lower
+ */
+template <typename... Args>
+void infoTrace(FILE *out, const char *fmt, Args ... args)
+{
+    if (TRACE_INFO_IS_ON) {
+        traceOutput(out, fmt, fmt::make_format_args(args...));
     }
 }
 
@@ -44,7 +73,7 @@ template <typename... Args>
 void info1Trace(const char *fmt, Args ... args)
 {
     if (TRACE_INFO1_IS_ON) {
-        fmt::vprint(stdout, fmt, fmt::make_format_args(args...));
+        traceOutput(stdout, fmt, fmt::make_format_args(args...));
     }
 }
 
@@ -56,7 +85,7 @@ template <typename... Args>
 void debugTrace(const char *fmt, Args ... args)
 {
     if (TRACE_DEBUG_IS_ON) {
-        fmt::vprint(stdout, fmt, fmt::make_format_args(args...));
+        traceOutput(stdout, fmt, fmt::make_format_args(args...));
     }
 }
 
@@ -64,7 +93,7 @@ void debugTrace(const char *fmt, Args ... args)
 class NsSystem {
 public:
     NsSystem() {}
-    NsSystem(Props &props);
+    NsSystem(const NsSystemParams &params);
 
     void addLayer(const string &id, const string &type);
     void addTract(const string &fromLayerId, const string &toLayerId,
@@ -97,17 +126,33 @@ public:
     void togglePsi(string layerId, bool state);
     static void printStateHdrs();
     void printState() const;
-    void printGrids(const string &tag, const string &targetId = "") const;
+    void printGrids(const string &tag,
+                    NsPatternHandle target = noPattern) const;
+    void printGrids(const string &tag,
+                    const vector<NsPatternHandle> &targets) const;
 
     NsLayer *getLayer(const string &id) { return layers.at(id); }
+    NsLayer *getLayer(uint intID) { return layers_vec[intID]; }
     NsTract *getTract(const string &id) { return tracts.at(id); }
+    NsTract *getTract(uint intID) { return tracts_vec[intID]; }
 
     void printSize();
     string toStr(uint iLvl = 0, const string &iStr = "   ") const;
 
+    // Layers and tracts by ID, for lookups when events are scheduled
+    //
     unordered_map<string, NsLayer *> layers;
     unordered_map<string, NsTract *> tracts;
 
+    // Layers and tracts by intID, i.e. in order of creation, and the
+    // tracts to and from each layer. All phases iterate these, so that
+    // random numbers are drawn in the same order in every run.
+    //
+    vector<NsLayer *> layers_vec;
+    vector<NsTract *> tracts_vec;
+    vector<vector<NsTract *>> inTracts;     // per layer intID
+    vector<vector<NsTract *>> outTracts;    // per layer intID
+
     uint trainNumStimCycles;
     uint consNumStimCycles;
     uint reactNumStimCycles;
@@ -5,48 +5,43 @@
 #include "NsTract.hh"
 
 
-#define CHECK_RANGE(val, min, max) \
-    ABORT_UNLESS(Util::isInRange(val, min, max), \
-                 "bad value for '{}': {}", #val, val)
-
-
 NsTract::NsTract(const string &id,
                  NsLayer *fromLayer,
                  NsLayer *toLayer,
                  const string &type)
-    : id(id), type(type), fromLayer(fromLayer), toLayer(toLayer),
+    : id(id), type(type), params(params_tract(type)),
+      fromLayer(fromLayer), toLayer(toLayer),
       e3Level(0), lastE3Level(DBL_MAX), lastTimeStep(UINT_MAX)
 {
-    acqLearnRate            = props.getDouble(type + '.' + "acqLearnRate");
-    reactE3Level            = props.getDouble(type + '.' + "reactE3Level");
-    consLearnRate01h        = props.getDouble(type + '.' + "consLearnRate01h");
-    psdDecayRate01h         = props.getDouble(type + '.' + "psdDecayRate01h");
-    cpAmparRemovalRate01h   = props.getDouble(type + '.' + "cpAmparRemovalRate01h");
-    ciAmparInsertionRate01h = props.getDouble(type + '.' + "ciAmparInsertionRate01h");
-    ciAmparRemovalRate01h   = props.getDouble(type + '.' + "ciAmparRemovalRate01h");
-    baseDepotProb01h        = props.getDouble(type + '.' + "baseDepotProb01h");
-    maxE3DepotProb01h       = props.getDouble(type + '.' + "maxE3DepotProb01h");
-    e3DecayRate01h          = props.getDouble(type + '.' + "e3DecayRate01h");
-    maxPotProb01h           = props.getDouble(type + '.' + "maxPotProb01h");
-    
-    
-    // Sanity check
+    // Each unit of fromLayer connects to each unit of toLayer but itself.
+    // The connections and their state are allocated in single blocks, and
+    // the state is initialized in bulk
     //
-    CHECK_RANGE(acqLearnRate,            0.0, 1.0);
-    CHECK_RANGE(reactE3Level,            0.0, 1.0);
-    CHECK_RANGE(consLearnRate01h,        0.0, 1.0);
-    CHECK_RANGE(psdDecayRate01h,         0.0, 1.0);
-    CHECK_RANGE(cpAmparRemovalRate01h,   0.0, 1.0);
-    CHECK_RANGE(ciAmparRemovalRate01h,   0.0, 1.0);
-    CHECK_RANGE(baseDepotProb01h,        0.0, 1.0);
-    CHECK_RANGE(e3DecayRate01h,          0.0, 1.0);
-    CHECK_RANGE(maxE3DepotProb01h,       0.0, 1.0);
-    CHECK_RANGE(maxPotProb01h,           0.0, 1.0);
+    uint fromSize = fromLayer->units.size();
+    uint numConnections = fromSize * toLayer->units.size();
+    if (fromLayer == toLayer) {
+        numConnections -= fromSize;
+    }
 
+    const NsConnectionParams &cp = params_connection();
+    uint stateSize = numConnections * numReplicates;
+    isPotentiated.assign(stateSize, false);
+    psdSize.assign(stateSize, cp.minPsdSize);
+    numCiAmpars.assign(stateSize, cp.minNumCiAmpars);
+    numCpAmpars.assign(stateSize, cp.minNumCpAmpars);
+
+    connectionSlab.reserve(numConnections);
+    connections.reserve(numConnections);
+    for (auto tu : toLayer->units) {
+        tu->inConnections.reserve(tu->inConnections.size() + fromSize);
+    }
+    uint i = 0;
     for (auto fu : fromLayer->units) {
         for (auto tu : toLayer->units) {
             if (fu != tu) {
-                connections.push_back(new NsConnection(this, fu, tu));
+                connectionSlab.emplace_back(this, i++, fu, tu);
+                connections.push_back(&connectionSlab.back());
+                tu->inConnections.push_back(&connectionSlab.back());
             }
         }
     }
@@ -103,17 +98,17 @@ static double calcConstantRate(double rateA, double intervalA, double intervalB)
  */
 void NsTract::calcRates()
 {
-    consLearnRate        = calcExpDecayRate(consLearnRate01h, 1.0, timeStep);
-    psdDecayRate         = calcExpDecayRate(psdDecayRate01h, 1.0, timeStep);
-    cpAmparRemovalRate   = calcExpDecayRate(cpAmparRemovalRate01h, 1.0,
+    consLearnRate        = calcExpDecayRate(params.consLearnRate01h, 1.0, timeStep);
+    psdDecayRate         = calcExpDecayRate(params.psdDecayRate01h, 1.0, timeStep);
+    cpAmparRemovalRate   = calcExpDecayRate(params.cpAmparRemovalRate01h, 1.0,
                                             timeStep);
-    ciAmparInsertionRate = calcConstantRate(ciAmparInsertionRate01h, 1.0,
+    ciAmparInsertionRate = calcConstantRate(params.ciAmparInsertionRate01h, 1.0,
                                           timeStep);
-    ciAmparRemovalRate   = calcExpDecayRate(ciAmparRemovalRate01h, 1.0,
+    ciAmparRemovalRate   = calcExpDecayRate(params.ciAmparRemovalRate01h, 1.0,
                                             timeStep);
-    baseDepotProb        = calcProb(baseDepotProb01h, 1.0, timeStep);
-    e3DecayRate          = calcExpDecayRate(e3DecayRate01h, 1.0, timeStep);
-    maxPotProb           = calcProb(maxPotProb01h, 1.0, timeStep);
+    baseDepotProb        = calcProb(params.baseDepotProb01h, 1.0, timeStep);
+    e3DecayRate          = calcExpDecayRate(params.e3DecayRate01h, 1.0, timeStep);
+    maxPotProb           = calcProb(params.maxPotProb01h, 1.0, timeStep);
     calcDepotProb();
 }
 
@@ -129,7 +124,7 @@ inline void NsTract::calcDepotProb()
     // Don't waste time if nothing changed
     //
     if (e3Level != lastE3Level || timeStep != lastTimeStep) {
-        double e3DepotProb01h = maxE3DepotProb01h * e3Level;
+        double e3DepotProb01h = params.maxE3DepotProb01h * e3Level;
         e3DepotProb = calcProb(e3DepotProb01h, 1.0, timeStep);
         depotProb = baseDepotProb + e3DepotProb - baseDepotProb * e3DepotProb;
 
@@ -150,7 +145,7 @@ void NsTract::stimulate(double learnRate, uint numStimCycles,
 
 void NsTract::acquire(uint numStimCycles, const char *tag)
 {
-    stimulate(acqLearnRate, numStimCycles, tag);
+    stimulate(params.acqLearnRate, numStimCycles, tag);
 }
 
 void NsTract::consolidate(uint numStimCycles)
@@ -174,8 +169,10 @@ void NsTract::amparTrafficking()
 void NsTract::depotentiateSome()
 {
     for (auto c: connections) {
-        if (c->isPotentiated && (Util::randDouble(0.0, 1.0) < depotProb)) {
-            c->depotentiate("random");
+        for (uint r = 0; r < numReplicates; r++) {
+            if (c->isPotentiated[r] && (replicateRandDouble(r) < depotProb)) {
+                c->depotentiate(r, "random");
+            }
         }
     }
 }
@@ -219,12 +216,14 @@ void NsTract::reactivate()
     //   terminating on the units selected in makePattern below? i.e. units
     //   activated by reactivation.
     //
-    e3Level = reactE3Level;
+    e3Level = params.reactE3Level;
     calcDepotProb();
 
     for (auto c: connections) {
-        if (c->fromUnit->isActive && c->toUnit->isActive) {
-            c->reactivate();
+        for (uint r = 0; r < numReplicates; r++) {
+            if (c->isHebbian(r)) {
+                c->reactivate(r);
+            }
         }
     }
 }
@@ -232,13 +231,14 @@ void NsTract::reactivate()
 
 /**
  * Count number of potentiated connections in the tract
+ * @param r Replicate
  * @return The count
  */
-uint NsTract::getNumPotentiated() const
+uint NsTract::getNumPotentiated(uint r) const
 {
     uint ret = 0;
     for (auto c: connections) {
-        if (c->isPotentiated) ret++;
+        if (c->isPotentiated[r]) ret++;
     }
     return ret;
 }
@@ -248,7 +248,16 @@ uint NsTract::getNumPotentiated() const
  */
 void NsTract::printNumPotentiatedHdr()
 {
-    infoTrace("time tract id numPotentiated\n");
+    if (recordOutput) return;
+
+    const char *hdr = "time tract id numPotentiated\n";
+    for (uint r = 0; r < numReplicates; r++) {
+        if (asyncOutput) {
+            if (TRACE_INFO_IS_ON) log_literal(replicateOutput(r), hdr);
+        } else {
+            infoTrace(replicateOutput(r), hdr);
+        }
+    }
 }
 
 /**
@@ -256,7 +265,26 @@ void NsTract::printNumPotentiatedHdr()
  */
 void NsTract::printNumPotentiated() const
 {
-    infoTrace("{} tract {} {}\n", simTime, id, getNumPotentiated());
+    if (recordOutput) {
+        uint32_t name = output_name(id);
+        for (uint r = 0; r < numReplicates; r++) {
+            output_record(r, NS_REC_NUM_POTENTIATED, name, 0, 0,
+                          getNumPotentiated(r));
+        }
+        return;
+    }
+    if (asyncOutput) {
+        if (!TRACE_INFO_IS_ON) return;
+        for (uint r = 0; r < numReplicates; r++) {
+            log_count(replicateOutput(r), simTime, "tract", &id,
+                      getNumPotentiated(r));
+        }
+        return;
+    }
+    for (uint r = 0; r < numReplicates; r++) {
+        infoTrace(replicateOutput(r), "{} tract {} {}\n",
+                  simTime, id, getNumPotentiated(r));
+    }
 }
 
 /**
@@ -278,7 +306,7 @@ string NsTract::toStr(uint iLvl, const string &iStr) const
     string ret = fmt::format("{}NsTract[{}]: ",
                              Util::repeatStr(iStr, iLvl), id);
     ret += fmt::format("\n{}acqLearnRate={}",
-                       Util::repeatStr(iStr, iLvl + 1), acqLearnRate);
+                       Util::repeatStr(iStr, iLvl + 1), params.acqLearnRate);
     ret += fmt::format("\n{}consLearnRate={}",
                        Util::repeatStr(iStr, iLvl + 1), consLearnRate);
 
@@ -2,33 +2,35 @@
 #include "NsUnit.hh"
 #include "MathUtil.hh"
 
-NsUnit::NsUnit(const NsLayer *layer, uint index)
+NsUnit::NsUnit(const NsLayer *layer, uint index,
+               uint8_t *isActive, uint8_t *newIsActive)
     : layer(layer), 
+      index(index),
       id(layer->id + "." + fmt::format("{:02}", index)),
-      actFuncK(props.getDouble("actFuncK")),
-      actThreshold(props.getDouble("actThreshold")),
+      params(params_unit()),
       isFrozen(false),
-      isActive(false),
-      newIsActive(false),
-      lastNetInput(0.0)
+      isActive(isActive),
+      newIsActive(newIsActive),
+      lastNetInput(numReplicates, 0.0)
 {}
 
 /**
  * Probability of activation is a sigmoid function of net input
+ * @param r Replicate
  * @param netInput Net input
  */
-bool NsUnit::activationFunction(double netInput)
+bool NsUnit::activationFunction(uint r, double netInput)
 {
-    if (netInput <= actThreshold) return false;
+    if (netInput <= params.actThreshold) return false;
 
     double probOfActivation =
-        MathUtil::asigmoid(netInput, actFuncK, layer->inhibition);
+        MathUtil::asigmoid(netInput, params.actFuncK, layer->inhibition[r]);
     //infoTrace("XXX {}\n", netInput);
 
-    double ret = Util::randDouble(0.0, 1.0) < probOfActivation;
+    double ret = replicateRandDouble(r) < probOfActivation;
 
     //fmt::print("activationFunction: {} {}\n",
-    //           netInput - layer->inhibition, ret);
+    //           netInput - layer->inhibition[r], ret);
     
     return ret;
 }
@@ -37,51 +39,76 @@ bool NsUnit::activationFunction(double netInput)
  * Calculate net input as sum of the weights of those inbound connection
  * whose sending units are active, i.e. count "true" activity level as 1 and
  * "false" as zero. Then use activationFunction to determine the unit's new
- * activation state and store it in newIsActive.
+ * activation state and store it in newIsActive. The net input of all
+ * replicates is accumulated together, one connection at a time.
  */
 void NsUnit::computeNewActivation()
 {
     if (isFrozen) {
-        newIsActive = false;
+        for (uint r = 0; r < numReplicates; r++) {
+            newIsActive[r] = false;
+        }
     } else {
         // Calculate net input
         //
-        double netInput = 0.0;
-        uint numActiveInputs = 0;
+        double *netInput = lastNetInput.data();
+        for (uint r = 0; r < numReplicates; r++) {
+            netInput[r] = 0.0;
+        }
+#if NORMALIZE
+        vector<uint> numActiveInputs(numReplicates, 0);
+#endif
         for (auto c : inConnections) {
-            if (c->fromUnit->isActive && c->getStrength() > 0.0) {
-                netInput += c->getStrength();
-                numActiveInputs++;
+            const uint8_t *fromIsActive = c->fromIsActive;
+            const double *ci = c->numCiAmpars;
+            const double *cp = c->numCpAmpars;
+            for (uint r = 0; r < numReplicates; r++) {
+                if (fromIsActive[r]) {
+                    double strength = NsConnection::strength(ci[r], cp[r]);
+                    if (strength > 0.0) {
+                        netInput[r] += strength;
+#if NORMALIZE
+                        numActiveInputs[r]++;
+#endif
+                    }
+                }
             }
         }
+        for (uint r = 0; r < numReplicates; r++) {
 #if NORMALIZE
-        // TODO: this didn't work, because it kills everything when there
-        // are many connections. -- It would be nice to find another way to
-        // handle different system sizes without twiddling parameters.
+            // TODO: this didn't work, because it kills everything when
+            // there are many connections. -- It would be nice to find
+            // another way to handle different system sizes without
+            // twiddling parameters.
 
-        // Normalize the input to the [0, 1] range. (This reflects the idea
-        // of homeostatic synaptic plasticity, a.k.a. synaptic scaling)
-        //
-        netInput *= (double) numActiveInputs / inConnections.size();
+            // Normalize the input to the [0, 1] range. (This reflects the
+            // idea of homeostatic synaptic plasticity, a.k.a. synaptic
+            // scaling)
+            //
+            netInput[r] *= (double) numActiveInputs[r] / inConnections.size();
 #endif
-        // Use the activation function to decide whether to become/remain
-        // active
-        //
-        newIsActive = activationFunction(netInput);
-        lastNetInput = netInput;
+            // Use the activation function to decide whether to
+            // become/remain active
+            //
+            newIsActive[r] = activationFunction(r, netInput[r]);
+        }
     }
 }
 
 void NsUnit::applyNewActivation()
 {
-    isActive = newIsActive;
+    for (uint r = 0; r < numReplicates; r++) {
+        isActive[r] = newIsActive[r];
+    }
 }
 
 void NsUnit::setFrozen(bool state)
 {
     isFrozen = state;
     if (isFrozen) {
-        isActive = false;
+        for (uint r = 0; r < numReplicates; r++) {
+            isActive[r] = false;
+        }
     }
 }
 
@@ -91,17 +118,40 @@ void NsUnit::maintain()
 
 void NsUnit::printStateHdr()
 {
+    if (recordOutput) return;
+
     infoTrace("time unit ID ACTIVE\n");
 }
 
 void NsUnit::printState() const
 {
-    infoTrace("{} unit {} {}\n", simTime / 24., id, isActive ? 'a' : 'i');
+    if (recordOutput) {
+        uint32_t name = output_name(layer->id);
+        for (uint r = 0; r < numReplicates; r++) {
+            output_record(r, NS_REC_UNIT, name, index, 0, isActive[r] != 0);
+        }
+        return;
+    }
+    if (asyncOutput) {
+        if (!TRACE_INFO_IS_ON) return;
+        for (uint r = 0; r < numReplicates; r++) {
+            log_unit(replicateOutput(r), simTime / 24., &id, isActive[r]);
+        }
+        return;
+    }
+    for (uint r = 0; r < numReplicates; r++) {
+        infoTrace(replicateOutput(r), "{} unit {} {}\n",
+                  simTime / 24., id, isActive[r] ? 'a' : 'i');
+    }
 }
 
 string NsUnit::toStr(uint iLvl, const string &iStr) const
 {
+    string active;
+    for (uint r = 0; r < numReplicates; r++) {
+        active += isActive[r] ? 'a' : 'i';
+    }
     return fmt::format("{}[{} {}]",
                        Util::repeatStr(iStr, iLvl),
-                       id, isActive ? 'a' : 'i');
+                       id, active);
 }
@@ -2,17 +2,27 @@
 #define NS_UNIT_HH
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <string>
+#include <vector>
+
+#include "NsParams.hh"
 
 using std::string;
+using std::vector;
 
 class NsLayer;
 class NsConnection;
 
+/**
+ * A unit. Its activation state, one value per replicate, lives in its
+ * layer's activation arrays (see NsReplicates.hh).
+ */
 class NsUnit {
 public:
-    NsUnit(const NsLayer *layer, uint index);
-    bool activationFunction(double netInput);
+    NsUnit(const NsLayer *layer, uint index,
+           uint8_t *isActive, uint8_t *newIsActive);
+    bool activationFunction(uint r, double netInput);
     void computeNewActivation();
     void applyNewActivation();
     void setFrozen(bool state);
@@ -22,13 +32,13 @@ public:
     string toStr(uint iLvl = 0, const string &iStr = "   ") const;
 
     const NsLayer *layer;
+    const uint index;
     const string id;
-    double actFuncK;
-    double actThreshold;
+    const NsUnitParams &params;
     bool isFrozen;
-    bool isActive;
-    bool newIsActive;
-    double lastNetInput;
+    uint8_t *isActive;            // per replicate
+    uint8_t *newIsActive;         // per replicate
+    vector<double> lastNetInput;  // per replicate
     vector<NsConnection *> inConnections;
 };
 
@@ -0,0 +1,130 @@
+/**
+ * @file nsrec.cc
+ *
+ * Print ns record files (see NsOutput.hh), including those of the MPI
+ * engines, in the format of ns's text output, optionally only the records
+ * of one type
+ */
+
+#include <unistd.h>
+#include <vector>
+#include <string>
+using std::string;
+#include <fmt/format.h>
+#include "Util.hh"
+#include "NsRecordReader.hh"
+
+// A few abbreviations
+
+const int NONE = Util::OPTARG_NONE;
+const int STR  = Util::OPTARG_STR;
+
+bool   help            = false;
+
+static const char *typeName = NULL;  // default is all types
+
+static const std::vector<std::pair<string, NsRecordType>> typeNames = {
+    { "score",          NS_REC_SCORE },
+    { "layer",          NS_REC_NUM_ACTIVE },
+    { "tract",          NS_REC_NUM_POTENTIATED },
+    { "timing",         NS_REC_TIMING },
+    { "unit",           NS_REC_UNIT },
+    { "conn",           NS_REC_CONN }
+};
+
+/**
+ * Print a record as ns prints it in text mode
+ */
+static void printRecord(const NsRecordReader &reader, const NsRecord &rec)
+{
+    switch (rec.type) {
+    case NS_REC_SCORE:
+        fmt::print("{} score {} {} {} {} {}\n",
+                   rec.time, reader.name(rec.id), reader.name(rec.id2),
+                   (uint) rec.values[0], (uint) rec.values[1],
+                   (uint) rec.values[2]);
+        break;
+    case NS_REC_NUM_ACTIVE:
+        fmt::print("{} layer {} {}\n",
+                   (uint) (rec.time * 24 + 0.5), reader.name(rec.id),
+                   (uint) rec.values[0]);
+        break;
+    case NS_REC_NUM_POTENTIATED:
+        fmt::print("{} tract {} {}\n",
+                   (uint) (rec.time * 24 + 0.5), reader.name(rec.id),
+                   (uint) rec.values[0]);
+        break;
+    case NS_REC_TIMING:
+        if (reader.getNumRanks() > 1) {
+            fmt::print("rank {} ", rec.id);
+        }
+        fmt::print("timing: {} {} {}\n",
+                   rec.values[0], rec.values[1], rec.values[2]);
+        break;
+    case NS_REC_UNIT:
+        fmt::print("{} unit {}.{:02} {}\n",
+                   rec.time, reader.name(rec.id), rec.id2,
+                   rec.values[0] != 0 ? 'a' : 'i');
+        break;
+    case NS_REC_CONN: {
+        const string &tract = reader.name(rec.id);
+        size_t dash = tract.find('-');
+        fmt::print("{} conn {}.{:02}-{}.{:02} {:.1f} {} {} {} {}\n",
+                   rec.time, tract.substr(0, dash), rec.id2,
+                   tract.substr(dash + 1), rec.id3,
+                   rec.values[0], rec.values[1], rec.values[2],
+                   (rec.flags & NS_REC_POTENTIATED) != 0,
+                   (rec.flags & NS_REC_HEBBIAN) != 0);
+        break;
+    }
+    default:
+        fmt::print(stderr, "Unknown record type {}\n", rec.type);
+        exit(1);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    char *pname = argv[0];
+
+    std::vector<Util::ParseOptSpec> optSpecs = {
+      { "type", STR,  &typeName, "record_type",
+        "score, layer, tract, timing, unit or conn; default: all" },
+      { "help", NONE, &help,     "", "" }};
+
+    if (parseOpts(argc, argv, optSpecs) != 0 ||
+        optind == argc ||
+        help)
+    {
+        std::vector<string> nonFlags = { "record_file [record_file ...]" };
+        Util::usageExit(
+            parseOptsUsage(
+                pname, optSpecs, true,
+                nonFlags).c_str(), NULL);
+    }
+
+    int type = 0;
+    if (typeName != NULL) {
+        for (auto &tn : typeNames) {
+            if (tn.first == typeName) {
+                type = tn.second;
+            }
+        }
+        if (type == 0) {
+            fmt::print(stderr, "Unknown record type: {}\n", typeName);
+            exit(1);
+        }
+    }
+
+    for (; optind < argc; optind++) {
+        NsRecordReader reader(argv[optind]);
+        NsRecord rec;
+        while (reader.next(rec)) {
+            if (type == 0 || rec.type == type) {
+                printRecord(reader, rec);
+            }
+        }
+    }
+
+    return 0;
+}
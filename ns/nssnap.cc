@@ -0,0 +1,181 @@
+/**
+ * @file nssnap.cc
+ *
+ * Convert ns snapshot files (see NsSnapshot.hh) to NumPy arrays, or list
+ * the snapshots they contain
+ */
+
+#include <unistd.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <string.h>
+#include <vector>
+#include <string>
+using std::string;
+#include <fmt/format.h>
+#include "Util.hh"
+#include "NsSnapshotReader.hh"
+
+// A few abbreviations
+
+const int NONE = Util::OPTARG_NONE;
+const int STR  = Util::OPTARG_STR;
+
+bool   help            = false;
+bool   list            = false;
+
+static const char *outDir = ".";
+
+/**
+ * A .npy file whose first dimension (the number of snapshots) grows as
+ * snapshots are appended, and is written to the header by close()
+ */
+class NpyFile {
+public:
+    NpyFile(const string &path, const char *descr,
+            const std::vector<uint> &shape)
+        : path(path), descr(descr), shape(shape)
+    {
+        f = fopen(path.c_str(), "w");
+        if (f == NULL) {
+            fmt::print(stderr, "Cannot create {}: {}\n",
+                       path, strerror(errno));
+            exit(1);
+        }
+        writeHeader(0);
+    }
+
+    void append(const void *data, size_t size)
+    {
+        if (fwrite(data, 1, size, f) != size) {
+            fmt::print(stderr, "Cannot write {}: {}\n",
+                       path, strerror(errno));
+            exit(1);
+        }
+    }
+
+    void close(uint numSnapshots)
+    {
+        rewind(f);
+        writeHeader(numSnapshots);
+        fclose(f);
+    }
+
+private:
+    // The header is padded to a fixed size, so that it can be rewritten
+    // in place
+    //
+    static const size_t headerSize = 128;
+
+    void writeHeader(uint numSnapshots)
+    {
+        string dims = fmt::format("{},", numSnapshots);
+        for (auto d : shape) {
+            dims += fmt::format(" {},", d);
+        }
+        string dict = fmt::format(
+            "{{'descr': '{}', 'fortran_order': False, 'shape': ({}), }}",
+            descr, dims);
+        size_t dictSize = headerSize - 10;
+        dict.resize(dictSize - 1, ' ');
+        dict += '\n';
+
+        uint8_t preamble[10] = { 0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0,
+                                 (uint8_t) (dictSize & 0xff),
+                                 (uint8_t) (dictSize >> 8) };
+        append(preamble, sizeof(preamble));
+        append(dict.data(), dict.size());
+    }
+
+    string path;
+    const char *descr;
+    std::vector<uint> shape;
+    FILE *f;
+};
+
+int main(int argc, char *argv[])
+{
+    char *pname = argv[0];
+
+    std::vector<Util::ParseOptSpec> optSpecs = {
+      { "o",    STR,  &outDir, "out_dir", "default: ." },
+      { "list", NONE, &list,   "",        "only list the snapshots" },
+      { "help", NONE, &help,   "",        "" }};
+
+    if (parseOpts(argc, argv, optSpecs) != 0 ||
+        optind != argc - 1 ||
+        help)
+    {
+        std::vector<string> nonFlags = { "snapshot_file" };
+        Util::usageExit(
+            parseOptsUsage(
+                pname, optSpecs, true,
+                nonFlags).c_str(), NULL);
+    }
+
+    NsSnapshotReader reader(argv[optind]);
+    NsSnapshotReader::Snapshot snap;
+    uint numReplicates = reader.getNumReplicates();
+
+    if (list) {
+        while (reader.next(snap)) {
+            fmt::print("{} {}\n", snap.simTime / 24., snap.label);
+        }
+        return 0;
+    }
+
+    if (mkdir(outDir, 0777) != 0 && errno != EEXIST) {
+        fmt::print(stderr, "Cannot create {}: {}\n", outDir, strerror(errno));
+        exit(1);
+    }
+
+    // Per tract: psdSize, numCiAmpars, numCpAmpars, flags
+    //
+    std::vector<NpyFile *> files;
+    for (auto &t : reader.tracts) {
+        std::vector<uint> shape =
+            { t.fromLayerSize, t.toLayerSize, numReplicates };
+        for (const char *field : { "psdSize", "numCiAmpars", "numCpAmpars" }) {
+            files.push_back(new NpyFile(
+                fmt::format("{}/{}.{}.npy", outDir, t.id, field),
+                "<f8", shape));
+        }
+        files.push_back(new NpyFile(
+            fmt::format("{}/{}.flags.npy", outDir, t.id), "|u1", shape));
+    }
+    NpyFile times(fmt::format("{}/times.npy", outDir), "<u4", {});
+    string labelsPath = fmt::format("{}/labels.txt", outDir);
+    FILE *labels = fopen(labelsPath.c_str(), "w");
+    if (labels == NULL) {
+        fmt::print(stderr, "Cannot create {}: {}\n",
+                   labelsPath, strerror(errno));
+        exit(1);
+    }
+
+    uint numSnapshots = 0;
+    while (reader.next(snap)) {
+        uint32_t simTime = snap.simTime;
+        times.append(&simTime, sizeof(simTime));
+        fmt::print(labels, "{}\n", snap.label);
+        for (uint t = 0; t < reader.tracts.size(); t++) {
+            auto &ts = snap.tracts[t];
+            size_t n = ts.flags.size();
+            files[4 * t]->append(ts.psdSize.data(), n * sizeof(double));
+            files[4 * t + 1]->append(ts.numCiAmpars.data(),
+                                     n * sizeof(double));
+            files[4 * t + 2]->append(ts.numCpAmpars.data(),
+                                     n * sizeof(double));
+            files[4 * t + 3]->append(ts.flags.data(), n);
+        }
+        numSnapshots++;
+    }
+
+    for (auto f : files) {
+        f->close(numSnapshots);
+        delete f;
+    }
+    times.close(numSnapshots);
+    fclose(labels);
+
+    return 0;
+}
@@ -0,0 +1,449 @@
+#include <algorithm>
+#include <string.h>
+#include <mpi.h>
+
+#include "NsSystem.hh"
+#include "NsBalancer.hh"
+#include "NsGlobals.hh"
+
+/**
+ * Implementation of the NsBalancer class
+ */
+
+NsBalancer::NsBalancer(NsSystem *system, double minGain)
+    : system(system),
+      minGain(minGain),
+      numMigrations(0),
+      migrationTime(0.0)
+{
+    uint numLayers = system->layers_vec.size();
+    fanIn.resize(numLayers, 0);
+
+    // The system's inbound tract lists are in creation order, which is
+    // the same on all ranks, so packed unit state can be unpacked on any
+    // rank.
+    //
+    for (auto t : system->tracts_vec) {
+        fanIn[t->toLayer->intID] += t->fromLayer->size;
+    }
+
+    countOwnedConnections();
+    resetCosts();
+}
+
+/**
+ * Record time spent computing new activations in a layer
+ */
+void NsBalancer::addSettleCost(const NsLayer *layer, double seconds)
+{
+    settleTime[layer->intID] += seconds;
+    settleConns[layer->intID] += ownedConns[layer->intID];
+}
+
+/**
+ * Record time spent in maintenance of a tract
+ */
+void NsBalancer::addMaintainCost(const NsTract *tract, double seconds)
+{
+    maintainTime[tract->toLayer->intID] += seconds;
+    maintainConns[tract->toLayer->intID] += tract->connections.size();
+}
+
+void NsBalancer::resetCosts()
+{
+    uint numLayers = system->layers_vec.size();
+    settleTime.assign(numLayers, 0.0);
+    settleConns.assign(numLayers, 0.0);
+    maintainTime.assign(numLayers, 0.0);
+    maintainConns.assign(numLayers, 0.0);
+}
+
+void NsBalancer::countOwnedConnections()
+{
+    ownedConns.assign(system->layers_vec.size(), 0.0);
+    for (auto l : system->layers_vec) {
+        for (auto u : l->units) {
+            ownedConns[l->intID] += u->inConnections.size();
+        }
+    }
+}
+
+/**
+ * Estimate the cost of each layer's units for the coming interval, from
+ * the per-connection cost of settling and maintenance measured (over all
+ * ranks) during the previous interval. Frozen layers are not settled, so
+ * their units only carry the maintenance cost.
+ */
+vector<double> NsBalancer::estimateUnitCosts()
+{
+    uint numLayers = system->layers_vec.size();
+    double sums[4] = { 0.0, 0.0, 0.0, 0.0 };
+    for (uint l = 0; l < numLayers; l++) {
+        sums[0] += settleTime[l];
+        sums[1] += settleConns[l];
+        sums[2] += maintainTime[l];
+        sums[3] += maintainConns[l];
+    }
+    MPI_Allreduce(MPI_IN_PLACE, sums, 4, MPI_DOUBLE, MPI_SUM, sim_comm);
+
+    double settleCost = sums[1] > 0 ? sums[0] / sums[1] : 0.0;
+    double maintainCost = sums[3] > 0 ? sums[2] / sums[3] : 0.0;
+    if (settleCost == 0.0 && maintainCost == 0.0) {
+        // Nothing measured: weigh units by fan-in only
+        //
+        settleCost = 1.0;
+    }
+
+    vector<double> unitCosts(numLayers);
+    double maxCost = 0.0;
+    for (auto l : system->layers_vec) {
+        double perConn = maintainCost + (l->isFrozen ? 0.0 : settleCost);
+        unitCosts[l->intID] = fanIn[l->intID] * perConn;
+        maxCost = Util::max(maxCost, unitCosts[l->intID]);
+    }
+
+    // Keep a small floor, so that units that are (nearly) free to host
+    // are still spread over the ranks rather than piled onto one.
+    //
+    for (auto &c : unitCosts) {
+        c = Util::max(c, 1e-3 * maxCost);
+    }
+    return unitCosts;
+}
+
+void NsBalancer::getCurrentPartition(Partition &counts, Partition &displs) const
+{
+    counts.clear();
+    displs.clear();
+    for (auto l : system->layers_vec) {
+        counts.push_back(l->owner_counts);
+        displs.push_back(l->owner_displacements);
+    }
+}
+
+void NsBalancer::getBasePartition(Partition &counts, Partition &displs) const
+{
+    uint numLayers = system->layers_vec.size();
+    counts.assign(numLayers, vector<int>());
+    displs.assign(numLayers, vector<int>());
+    for (uint l = 0; l < numLayers; l++) {
+        base_partition(l, counts[l], displs[l]);
+    }
+}
+
+/**
+ * Partition the units of all layers, taken in layer order, into
+ * world_size contiguous ranges of (approximately) equal cost. Each
+ * layer's units thus end up in contiguous, rank-ordered ranges.
+ */
+void NsBalancer::getCostPartition(const vector<double> &unitCosts,
+                                  Partition &counts, Partition &displs) const
+{
+    uint numLayers = system->layers_vec.size();
+    double totalCost = 0.0;
+    for (auto l : system->layers_vec) {
+        totalCost += l->size * unitCosts[l->intID];
+    }
+    double target = totalCost / world_size;
+
+    counts.assign(numLayers, vector<int>(world_size, 0));
+    displs.assign(numLayers, vector<int>(world_size, 0));
+
+    double acc = 0.0;
+    for (auto l : system->layers_vec) {
+        double c = unitCosts[l->intID];
+        for (uint i = 0; i < l->size; i++) {
+            int r = Util::min((int) ((acc + 0.5 * c) / target), world_size - 1);
+            counts[l->intID][r]++;
+            acc += c;
+        }
+        for (int r = 1; r < world_size; r++) {
+            displs[l->intID][r] =
+                displs[l->intID][r - 1] + counts[l->intID][r - 1];
+        }
+    }
+}
+
+double NsBalancer::predictMaxCost(const vector<double> &unitCosts,
+                                  const Partition &counts) const
+{
+    double maxCost = 0.0;
+    for (int r = 0; r < world_size; r++) {
+        double cost = 0.0;
+        for (uint l = 0; l < counts.size(); l++) {
+            cost += counts[l][r] * unitCosts[l];
+        }
+        maxCost = Util::max(maxCost, cost);
+    }
+    return maxCost;
+}
+
+/**
+ * Called (collectively) at event boundaries. If any layer is frozen,
+ * redistribute units in proportion to their estimated cost, provided
+ * the predicted gain is worth it; otherwise return to the layer-based
+ * distribution.
+ */
+void NsBalancer::rebalance()
+{
+    vector<double> unitCosts = estimateUnitCosts();
+    resetCosts();
+
+    bool anyFrozen = false;
+    for (auto l : system->layers_vec) {
+        anyFrozen |= l->isFrozen;
+    }
+
+    Partition counts, displs;
+    if (anyFrozen) {
+        getCostPartition(unitCosts, counts, displs);
+
+        Partition currCounts, currDispls;
+        getCurrentPartition(currCounts, currDispls);
+        double currCost = predictMaxCost(unitCosts, currCounts);
+        double newCost = predictMaxCost(unitCosts, counts);
+        if (currCounts == counts || newCost > (1.0 - minGain) * currCost) {
+            return;
+        }
+        TRACE_INFO("Rebalancing: predicted cost {} --> {}", currCost, newCost);
+    } else {
+        if (!rebalanced) {
+            return;
+        }
+        getBasePartition(counts, displs);
+        TRACE_INFO("Rebalancing: restoring layer-based distribution");
+    }
+
+    double startTime = MPI_Wtime();
+    migrate(counts, displs);
+    migrationTime += MPI_Wtime() - startTime;
+    numMigrations++;
+}
+
+/**
+ * Append a unit's state, and the state of its inbound connections (per
+ * inbound tract), to a send buffer.
+ */
+void NsBalancer::packUnit(const NsUnit *unit, vector<char> &buf) const
+{
+    auto append = [&buf](const void *p, size_t n) {
+        const char *c = (const char *) p;
+        buf.insert(buf.end(), c, c + n);
+    };
+
+    int layerId = unit->layer->intID;
+    NsUnitState us = unit->getState();
+    append(&layerId, sizeof(layerId));
+    append(&us, sizeof(us));
+
+    for (auto t : system->inTracts[layerId]) {
+        uint n = 0;
+        for (auto c : unit->inConnections) {
+            if (c->getTract() == t) n++;
+        }
+        append(&n, sizeof(n));
+        for (auto c : unit->inConnections) {
+            if (c->getTract() == t) {
+                NsConnectionState cs = c->getState();
+                append(&cs, sizeof(cs));
+            }
+        }
+    }
+}
+
+/**
+ * Create units and their inbound connections from a buffer of packed
+ * unit states.
+ */
+void NsBalancer::unpackUnits(const vector<char> &buf)
+{
+    size_t pos = 0;
+    auto extract = [&buf, &pos](void *p, size_t n) {
+        memcpy(p, &buf[pos], n);
+        pos += n;
+    };
+
+    while (pos < buf.size()) {
+        int layerId;
+        NsUnitState us;
+        extract(&layerId, sizeof(layerId));
+        extract(&us, sizeof(us));
+
+        NsLayer *layer = system->layers_vec[layerId];
+        NsUnit *unit = new NsUnit(layer, us.index,
+                                  layer->global_displacement + us.index);
+        unit->setState(us);
+        layer->units.push_back(unit);
+
+        for (auto t : system->inTracts[layerId]) {
+            uint n;
+            extract(&n, sizeof(n));
+            for (uint i = 0; i < n; i++) {
+                NsConnectionState cs;
+                extract(&cs, sizeof(cs));
+                NsConnection *c = new NsConnection(t, cs.fromIndex, unit);
+                c->setState(cs);
+                t->connections.push_back(c);
+            }
+        }
+    }
+}
+
+/**
+ * Move units (with their inbound connections) to the ranks that own them
+ * in the new partition, then make all activations consistent with it.
+ */
+void NsBalancer::migrate(const Partition &counts, const Partition &displs)
+{
+    auto ownerOf = [&counts, &displs](int layerId, uint index) {
+        int r = 0;
+        while ((uint) (displs[layerId][r] + counts[layerId][r]) <= index) {
+            r++;
+        }
+        return r;
+    };
+
+    // Coming from the layer-based distribution, only a layer's own ranks
+    // have tracked its inhibition level; everyone needs it from now on.
+    //
+    if (!rebalanced) {
+        for (auto l : system->layers_vec) {
+            double inhib[2] = { l->inhibition, l->savedInhibition };
+            MPI_Bcast(inhib, 2, MPI_DOUBLE, l->intID, sim_comm);
+            l->inhibition = inhib[0];
+            l->savedInhibition = inhib[1];
+        }
+    }
+
+    // Pack departing units and drop them
+    //
+    vector<vector<char>> sendBufs(world_size);
+    vector<NsUnit *> departedUnits;
+    for (auto l : system->layers_vec) {
+        vector<NsUnit *> staying;
+        for (auto u : l->units) {
+            int dest = ownerOf(l->intID, u->index);
+            if (dest == world_rank) {
+                staying.push_back(u);
+            } else {
+                packUnit(u, sendBufs[dest]);
+                departedUnits.push_back(u);
+            }
+        }
+        l->units.swap(staying);
+    }
+
+    // Units and connections built with the system live in their layer's
+    // and tract's slabs, which are only freed at exit
+    //
+    for (auto t : system->tracts_vec) {
+        vector<NsConnection *> &conns = t->connections;
+        NsLayer *toLayer = t->toLayer;
+        auto departed = [&](NsConnection *c) {
+            if (ownerOf(toLayer->intID, c->toUnit->index) == world_rank) {
+                return false;
+            }
+            if (!t->isInSlab(c)) {
+                delete c;
+            }
+            return true;
+        };
+        conns.erase(std::remove_if(conns.begin(), conns.end(), departed),
+                    conns.end());
+    }
+    for (auto u : departedUnits) {
+        if (!u->layer->isInSlab(u)) {
+            delete u;
+        }
+    }
+
+    // Exchange
+    //
+    vector<int> sendCounts(world_size), recvCounts(world_size);
+    vector<int> sendDispls(world_size, 0), recvDispls(world_size, 0);
+    for (int r = 0; r < world_size; r++) {
+        sendCounts[r] = sendBufs[r].size();
+    }
+    MPI_Alltoall(&sendCounts[0], 1, MPI_INT, &recvCounts[0], 1, MPI_INT,
+                 sim_comm);
+
+    vector<char> sendBuf, recvBuf;
+    for (int r = 0; r < world_size; r++) {
+        sendDispls[r] = sendBuf.size();
+        sendBuf.insert(sendBuf.end(), sendBufs[r].begin(), sendBufs[r].end());
+        recvDispls[r] = (r == 0) ? 0 : recvDispls[r - 1] + recvCounts[r - 1];
+    }
+    recvBuf.resize(recvDispls[world_size - 1] + recvCounts[world_size - 1]);
+    MPI_Alltoallv(sendBuf.data(), &sendCounts[0], &sendDispls[0], MPI_BYTE,
+                  recvBuf.data(), &recvCounts[0], &recvDispls[0], MPI_BYTE,
+                  sim_comm);
+
+    unpackUnits(recvBuf);
+
+    // Restore construction order
+    //
+    for (auto l : system->layers_vec) {
+        std::sort(l->units.begin(), l->units.end(),
+                  [](const NsUnit *a, const NsUnit *b) {
+                      return a->index < b->index;
+                  });
+        l->owner_counts = counts[l->intID];
+        l->owner_displacements = displs[l->intID];
+    }
+    for (auto t : system->tracts_vec) {
+        vector<NsConnection *> &conns = t->connections;
+        std::sort(conns.begin(), conns.end(),
+                  [](const NsConnection *a, const NsConnection *b) {
+                      return a->fromIndex != b->fromIndex ?
+                          a->fromIndex < b->fromIndex :
+                          a->toUnit->index < b->toUnit->index;
+                  });
+    }
+
+    Partition baseCounts, baseDispls;
+    getBasePartition(baseCounts, baseDispls);
+    rebalanced = (counts != baseCounts);
+
+    countOwnedConnections();
+
+    // Bring every rank's copy of every layer up to date
+    //
+    for (auto l : system->layers_vec) {
+        MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL,
+                       l->activations, &l->owner_counts[0],
+                       &l->owner_displacements[0], MPI_UINT8_T,
+                       sim_comm);
+    }
+}
+
+/**
+ * Exchange activations of all active layers among all ranks. Used instead
+ * of the layer-to-layer exchange while units are rebalanced.
+ */
+void NsBalancer::synchronize()
+{
+    for (auto l : system->layers_vec) {
+        if (!l->isFrozen) {
+            MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL,
+                           l->activations, &l->owner_counts[0],
+                           &l->owner_displacements[0], MPI_UINT8_T,
+                           sim_comm);
+        }
+    }
+}
+
+/**
+ * Print, on rank 0, the number of redistributions and the slowest and
+ * the average time the ranks spent on them. Collective over sim_comm.
+ */
+void NsBalancer::printStats() const
+{
+    double maxTime = 0.0;
+    double sumTime = 0.0;
+    MPI_Reduce(&migrationTime, &maxTime, 1, MPI_DOUBLE, MPI_MAX, 0, sim_comm);
+    MPI_Reduce(&migrationTime, &sumTime, 1, MPI_DOUBLE, MPI_SUM, 0, sim_comm);
+    if (world_rank == 0) {
+        fmt::print("rebalance: {} {} {}\n",
+                   numMigrations, maxTime, sumTime / world_size);
+    }
+}
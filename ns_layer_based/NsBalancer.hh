@@ -0,0 +1,65 @@
+#ifndef NS_BALANCER_HH
+#define NS_BALANCER_HH
+
+#include <vector>
+using std::vector;
+
+#include "NsLayer.hh"
+#include "NsTract.hh"
+
+class NsSystem;
+
+/**
+ * Redistributes units, and the state of their inbound connections,
+ * between ranks when layers are frozen or lesioned, so that ranks whose
+ * own layer has nothing to compute share the work of the active layers.
+ *
+ * The cost of a unit is estimated from its fan-in and from the time spent
+ * per connection in settling and maintenance during the previous interval
+ * (i.e. since the last call to rebalance()).
+ */
+class NsBalancer {
+public:
+    NsBalancer(NsSystem *system, double minGain);
+
+    void addSettleCost(const NsLayer *layer, double seconds);
+    void addMaintainCost(const NsTract *tract, double seconds);
+
+    void rebalance();
+    void synchronize();
+    void printStats() const;
+
+private:
+    typedef vector<vector<int>> Partition;
+
+    void getCurrentPartition(Partition &counts, Partition &displs) const;
+    void getBasePartition(Partition &counts, Partition &displs) const;
+    void getCostPartition(const vector<double> &unitCosts,
+                          Partition &counts, Partition &displs) const;
+    double predictMaxCost(const vector<double> &unitCosts,
+                          const Partition &counts) const;
+    vector<double> estimateUnitCosts();
+    void migrate(const Partition &counts, const Partition &displs);
+    void packUnit(const NsUnit *unit, vector<char> &buf) const;
+    void unpackUnits(const vector<char> &buf);
+    void countOwnedConnections();
+    void resetCosts();
+
+    NsSystem *system;
+    const double minGain;
+
+    vector<uint> fanIn;                 // inbound connections per unit
+    vector<double> ownedConns;          // owned inbound connections
+
+    // Cost measurements for the current interval, per layer
+    //
+    vector<double> settleTime;
+    vector<double> settleConns;
+    vector<double> maintainTime;
+    vector<double> maintainConns;
+
+    uint numMigrations;
+    double migrationTime;
+};
+
+#endif
@@ -5,30 +5,39 @@
 #include "NsSystem.hh"
 #include "NsConnection.hh"
 #include "NsGlobals.hh"
+#include "NsOutput.hh"
 
 /*
  * Constructor
  */
 NsConnection::NsConnection(const NsTract *tract,
-                           const uint from_gid,
-                           const uint from_layer_id,
+                           const uint fromIndex,
                            NsUnit *toUnit)
     : forceStaticInit(initializeStatics()),
       isPotentiated(false),
+      fromIndex(fromIndex),
       toUnit(toUnit),
       tract(tract),
-      id(fmt::format("{}->{}", from_gid, toUnit->id)),
       psdSize(minPsdSize),
       numCiAmpars(minNumCiAmpars),
       numCpAmpars(minNumCpAmpars),
       psiIsOn(false)
 {
     toUnit->inConnections.push_back(this);
-    fromUnitIsActive = &(tract->fromLayer->activations[from_layer_id]);
-    auto it = gid_id_map.find(from_gid);
-    if (it != gid_id_map.end()) {
-        id = fmt::format("{}->{}", it->second, toUnit->id);
-    }
+    fromUnitIsActive = &(tract->fromLayer->activations[fromIndex]);
+}
+
+/**
+ * Compute the connection's id ("<from unit>-><to unit>")
+ */
+string NsConnection::getId() const
+{
+    return unit_id(getFromGid()) + "->" + toUnit->id;
+}
+
+uint NsConnection::getFromGid() const
+{
+    return tract->fromLayer->global_displacement + fromIndex;
 }
 
 /*
@@ -44,8 +53,8 @@ double NsConnection::potProbHalf;
 /**
  * Initialize static member variables This needs to happen before regular
  * member variables are initialized in the constructor, but can't be done by
- * static member initializers because it must happen after props have been
- * initialized, which happens in main().
+ * static member initializers because it must happen after the parameters
+ * have been resolved, which happens in main().
  * 
  * Hence the 'forceStaticInit' member variable that forces this function to
  * be called before any other member variables are initialized.
@@ -54,12 +63,13 @@ bool NsConnection::initializeStatics()
 {
     static bool staticsInitialized = false;
     if (!staticsInitialized) {
-        minPsdSize = props.getDouble("minPsdSize");
-        maxPsdSize = props.getDouble("maxPsdSize");
-        minNumCiAmpars = props.getDouble("minNumCiAmpars");
-        minNumCpAmpars = props.getDouble("minNumCpAmpars");
-        potProbK = props.getDouble("potProbK");
-        potProbHalf = props.getDouble("potProbHalf");
+        const NsConnectionParams &p = params_connection();
+        minPsdSize = p.minPsdSize;
+        maxPsdSize = p.maxPsdSize;
+        minNumCiAmpars = p.minNumCiAmpars;
+        minNumCpAmpars = p.minNumCpAmpars;
+        potProbK = p.potProbK;
+        potProbHalf = p.potProbHalf;
         staticsInitialized = true;
     }
     return true;
@@ -73,9 +83,11 @@ void NsConnection::potentiate(const char *tag)
 {
     isPotentiated = true;
 
-    infoTrace("{:.1f} potentiating {} ({}) [{}]\n",
-              (double) simTime / 24.,
-              id, tag, toUnit->lastNetInput);
+    if (TRACE_INFO_IS_ON) {
+        infoTrace("{:.1f} potentiating {} ({}) [{}]\n",
+                  (double) simTime / 24.,
+                  getId(), tag, toUnit->lastNetInput);
+    }
 }
 
 /**
@@ -87,9 +99,11 @@ void NsConnection::depotentiate(const char *tag)
     isPotentiated = false;
     setNumCiAmpars(minNumCiAmpars);
 
-    infoTrace("{:.1f} depotentiating {} ({}) [{}]\n",
-              (double) simTime / 24.,
-              id, tag, getStrength());
+    if (TRACE_INFO_IS_ON) {
+        infoTrace("{:.1f} depotentiating {} ({}) [{}]\n",
+                  (double) simTime / 24.,
+                  getId(), tag, getStrength());
+    }
 }
 
 /**
@@ -192,22 +206,48 @@ double  NsConnection::getStrength() const
     return (numCiAmpars + numCpAmpars) / maxPsdSize /*maxPsdSize*/;
 }
 
-void NsConnection::printStateHdr()
+/**
+ * Snapshot of the connection's mutable state
+ */
+NsConnectionState NsConnection::getState() const
+{
+    NsConnectionState state;
+    state.fromIndex = fromIndex;
+    state.psdSize = psdSize;
+    state.numCiAmpars = numCiAmpars;
+    state.numCpAmpars = numCpAmpars;
+    state.isPotentiated = isPotentiated;
+    state.psiIsOn = psiIsOn;
+    return state;
+}
+
+/**
+ * Restore the connection's mutable state from a snapshot
+ */
+void NsConnection::setState(const NsConnectionState &state)
 {
-    infoTrace("time conn ID PSD-SIZE CI-AMPARS CP-AMPARS Potentiated Hebbian\n");
+    psdSize = state.psdSize;
+    numCiAmpars = state.numCiAmpars;
+    numCpAmpars = state.numCpAmpars;
+    isPotentiated = state.isPotentiated;
+    psiIsOn = state.psiIsOn;
 }
 
+/**
+ * Write the connection's state to the record file
+ */
 void NsConnection::printState() const
 {
-    infoTrace("{} conn {} {:.1f} {} {} {} {}\n",
-               simTime / 24., id, 
-              psdSize, numCiAmpars, numCpAmpars, isPotentiated, isHebbian());
+    uint16_t flags = (isPotentiated ? NS_REC_POTENTIATED : 0) |
+                     (isHebbian() ? NS_REC_HEBBIAN : 0);
+    output_record(NS_REC_CONN, output_name(tract->id), fromIndex,
+                  toUnit->index, psdSize, numCiAmpars, numCpAmpars, flags);
 }
 
 string NsConnection::toStr(uint iLvl, const string &iStr) const
 {
     return fmt::format("{}{} psd={} ci={} cp={}",
                        Util::repeatStr(iStr, iLvl),
-                       id,
+                       getId(),
                        psdSize, numCiAmpars, numCpAmpars);
 }
@@ -7,27 +7,45 @@
 
 class NsTract;
 
+/**
+ * Mutable per-connection state, in a form that can be copied
+ * between ranks when units are redistributed.
+ */
+struct NsConnectionState {
+    uint    fromIndex;
+    double  psdSize;
+    double  numCiAmpars;
+    double  numCpAmpars;
+    uint8_t isPotentiated;
+    uint8_t psiIsOn;
+};
+
 class NsConnection {
 private:
     bool forceStaticInit;
 public:
-    NsConnection(const NsTract *tract, const uint from_gid, const uint from_layer_id, NsUnit *to);
+    NsConnection(const NsTract *tract, const uint fromIndex, NsUnit *to);
     void stimulate(double learnRate, uint numStimCycles, const char *tag);
     void amparTrafficking(double cpAmparRemovalRate,
                           double ciAmparInsertionRate,
                           double ciAmparRemovalRate);
 
-    static void printStateHdr();
     void depotentiate(const char *tag);
     void togglePsi(bool state) { psiIsOn = state; }
     void reactivate();
     double getStrength() const;
     void printState() const;
     string toStr(uint iLvl = 0, const string &iStr = "   ") const;
+    string getId() const;
+    uint getFromGid() const;
     bool isHebbian() const { return *fromUnitIsActive && *(toUnit->isActive); }
+    NsConnectionState getState() const;
+    void setState(const NsConnectionState &state);
+    const NsTract *getTract() const { return tract; }
 
     bool isPotentiated;
     uint8_t *fromUnitIsActive;
+    uint fromIndex;
     NsUnit *toUnit;
 
 private:
@@ -37,7 +55,7 @@ private:
     void setNumCiAmpars(double n)
     {
         TRACE_DEBUG("simTime: {} {}.numCiAmpars {:5.2f} --> {:5.2f}\n",
-                    simTime, id, numCiAmpars, n);
+                    simTime, getId(), numCiAmpars, n);
         ABORT_IF(n < minNumCiAmpars || isnan(n), "Oops");
         numCiAmpars = n;
     }
@@ -45,7 +63,7 @@ private:
     void setNumCpAmpars(double n)
     {
         TRACE_DEBUG("simTime: {} {}.numCpAmpars {:5.2f} --> {:5.2f}\n",
-                    simTime, id, numCpAmpars, n);
+                    simTime, getId(), numCpAmpars, n);
         ABORT_IF(n < minNumCpAmpars || isnan(n), "Oops");
         numCpAmpars = n;
     }
@@ -53,7 +71,6 @@ private:
     void learn(double learnRate, uint numStimCycles, const char *tag);
 
     const  NsTract *tract;
-    string  id;
     double         psdSize;
     double         numCiAmpars;
     double         numCpAmpars;
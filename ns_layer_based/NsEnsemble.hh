@@ -0,0 +1,38 @@
+#ifndef NS_ENSEMBLE_HH
+#define NS_ENSEMBLE_HH
+
+#include <string>
+#include <vector>
+
+/**
+ * Ensemble runs
+ *
+ * With -ens <ensembleFile>, a single ns job runs a whole set of
+ * simulations at once. Each line of the ensemble file names a props file
+ * and, optionally, the number of replicates to run with it (default 1):
+ *
+ *     # props file                      replicates
+ *     props/ns_40a_freeze_hpc_3d.props  10
+ *
+ * MPI_COMM_WORLD is split into one block of consecutive ranks per run, all
+ * of the same size, and each block runs its simulation on sim_comm as if
+ * it had been launched on its own. Replicate i of props/<name>.props
+ * writes its output with the prefix <outDir>/<name>/<i>, the layout used
+ * by multi_ns_parallel. At the end, world rank 0 writes a summary of all
+ * runs to <outDir>/ensemble.out.
+ */
+struct NsEnsembleRun {
+    std::string propsPath;
+    std::string name;      // props file name without directory and suffix
+    unsigned replicate;
+};
+
+std::vector<NsEnsembleRun> ensemble_read(const char *path);
+int ensemble_split(const std::vector<NsEnsembleRun> &runs);
+std::string ensemble_output_prefix(const std::string &outDir,
+                                   const NsEnsembleRun &run);
+void ensemble_report(const std::string &outDir,
+                     const std::vector<NsEnsembleRun> &runs,
+                     double setupTime, double runTime);
+
+#endif
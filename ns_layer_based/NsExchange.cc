@@ -0,0 +1,255 @@
+#include "NsExchange.hh"
+#include "NsGlobals.hh"
+#include "Trace.hh"
+
+NsRmaMode rma_mode = NS_RMA_OFF;
+
+/**
+ * Set rma_mode from the rmaSync property (off, put or get)
+ */
+void init_rma_mode()
+{
+    string mode = props.getString("rmaSync", "off");
+    if (mode == "off") {
+        rma_mode = NS_RMA_OFF;
+    } else if (mode == "put") {
+        rma_mode = NS_RMA_PUT;
+    } else if (mode == "get") {
+        rma_mode = NS_RMA_GET;
+    } else {
+        TRACE_FATAL("Bad rmaSync value: {}", mode);
+    }
+}
+
+const char *rma_mode_name(NsRmaMode mode)
+{
+    switch (mode) {
+    case NS_RMA_OFF: return "off";
+    case NS_RMA_PUT: return "rma-put";
+    case NS_RMA_GET: return "rma-get";
+    }
+    return "?";
+}
+
+/**
+ * Implementation of the NsExchange class
+ */
+
+NsExchange::NsExchange(const vector<NsLayer *> &layers)
+    : layers(layers),
+      graphComm(MPI_COMM_NULL),
+      isCommitted(false),
+      rmaWin(MPI_WIN_NULL),
+      neighborGroup(MPI_GROUP_NULL)
+{
+}
+
+/**
+ * Register a pair of layers connected by tracts. Must be called with
+ * the same pairs on all ranks, before the first exchange().
+ */
+void NsExchange::addLayerPair(int layer1, int layer2)
+{
+    ABORT_IF(isCommitted, "Layer pair added after first exchange");
+    isAdjacent.resize(layers.size(), false);
+    if (layer_id == layer1) {
+        isAdjacent[layer2] = true;
+    } else if (layer_id == layer2) {
+        isAdjacent[layer1] = true;
+    }
+}
+
+/**
+ * Create the graph communicator, whose neighbors (in both directions)
+ * are all ranks of the layers adjacent to this rank's layer
+ */
+void NsExchange::commit()
+{
+    for (int r = 0; r < world_size; r++) {
+        int l = r % 4;
+        if (l != layer_id && isAdjacent[l]) {
+            neighbors.push_back(r);
+            neighborLayers.push_back(l);
+        }
+    }
+    MPI_Dist_graph_create_adjacent(
+        sim_comm,
+        neighbors.size(), neighbors.data(), MPI_UNWEIGHTED,
+        neighbors.size(), neighbors.data(), MPI_UNWEIGHTED,
+        MPI_INFO_NULL, 0, &graphComm);
+
+    if (rma_mode != NS_RMA_OFF) {
+        commitRma();
+    }
+    isCommitted = true;
+}
+
+/**
+ * Create the window for the one-sided exchange and look up the remote
+ * addresses of the slices to put or get
+ */
+void NsExchange::commitRma()
+{
+    MPI_Win_create_dynamic(MPI_INFO_NULL, sim_comm, &rmaWin);
+    vector<MPI_Aint> addrs(layers.size(), 0);
+    for (uint l = 0; l < layers.size(); l++) {
+        if (layers[l]->activations_on_rank) {
+            MPI_Win_attach(rmaWin, layers[l]->activations, layers[l]->size);
+            MPI_Get_address(layers[l]->activations, &addrs[l]);
+        }
+    }
+    vector<MPI_Aint> allAddrs(layers.size() * world_size);
+    MPI_Allgather(addrs.data(), layers.size(), MPI_AINT,
+                  allAddrs.data(), layers.size(), MPI_AINT, sim_comm);
+
+    NsLayer *own = layers[layer_id];
+    for (uint i = 0; i < neighbors.size(); i++) {
+        int r = neighbors[i];
+        NsLayer *other = layers[neighborLayers[i]];
+        putTargets.push_back(MPI_Aint_add(
+            allAddrs[r * layers.size() + layer_id],
+            own->owner_displacements[world_rank]));
+        getTargets.push_back(MPI_Aint_add(
+            allAddrs[r * layers.size() + neighborLayers[i]],
+            other->owner_displacements[r]));
+    }
+
+    MPI_Group simGroup;
+    MPI_Comm_group(sim_comm, &simGroup);
+    MPI_Group_incl(simGroup, neighbors.size(), neighbors.data(),
+                   &neighborGroup);
+    MPI_Group_free(&simGroup);
+}
+
+/**
+ * Absolute address of p, the displacement of p from MPI_BOTTOM
+ */
+MPI_Aint NsExchange::address(const uint8_t *p)
+{
+    MPI_Aint addr;
+    MPI_Get_address(p, &addr);
+    return addr;
+}
+
+/**
+ * Get the plan for the current set of frozen layers
+ */
+NsExchange::Plan &NsExchange::getPlan()
+{
+    uint frozenMask = 0;
+    for (uint l = 0; l < layers.size(); l++) {
+        if (layers[l]->isFrozen) {
+            frozenMask |= 1 << l;
+        }
+    }
+
+    auto it = plans.find(frozenMask);
+    if (it == plans.end()) {
+        Plan plan;
+        NsLayer *own = layers[layer_id];
+        MPI_Aint sendDispl = address(
+            own->activations + own->owner_displacements[world_rank]);
+        for (uint i = 0; i < neighbors.size(); i++) {
+            NsLayer *other = layers[neighborLayers[i]];
+            bool active = !(own->isFrozen || other->isFrozen);
+            int r = neighbors[i];
+
+            plan.sendCounts.push_back(active ? own->owner_counts[world_rank] : 0);
+            plan.sendDispls.push_back(sendDispl);
+            plan.sendTypes.push_back(MPI_UINT8_T);
+            plan.recvCounts.push_back(active ? other->owner_counts[r] : 0);
+            plan.recvDispls.push_back(address(
+                other->activations + other->owner_displacements[r]));
+            plan.recvTypes.push_back(MPI_UINT8_T);
+        }
+        plan.isPlanned = false;
+        it = plans.insert({frozenMask, plan}).first;
+    }
+
+    Plan &plan = it->second;
+    if (sync_mode != NS_SYNC_OFF && rma_mode == NS_RMA_OFF &&
+        !plan.isPlanned) {
+        plan_neighbor_alltoallw(MPI_BOTTOM, plan.sendCounts.data(),
+                                plan.sendDispls.data(), plan.sendTypes.data(),
+                                MPI_BOTTOM, plan.recvCounts.data(),
+                                plan.recvDispls.data(), plan.recvTypes.data(),
+                                graphComm, plan.requests);
+        plan.isPlanned = true;
+    }
+    return plan;
+}
+
+/**
+ * Exchange activations with all adjacent layers. Must be called by
+ * all ranks.
+ */
+void NsExchange::exchange()
+{
+    if (!isCommitted) {
+        commit();
+    }
+    Plan &plan = getPlan();
+    if (rma_mode != NS_RMA_OFF) {
+        exchangeRma(plan);
+    } else if (sync_mode != NS_SYNC_OFF) {
+        plan_start(plan.requests);
+        MPI_Waitall(plan.requests.size(), plan.requests.data(),
+                    MPI_STATUSES_IGNORE);
+    } else {
+        MPI_Neighbor_alltoallw(MPI_BOTTOM, plan.sendCounts.data(),
+                               plan.sendDispls.data(), plan.sendTypes.data(),
+                               MPI_BOTTOM, plan.recvCounts.data(),
+                               plan.recvDispls.data(), plan.recvTypes.data(),
+                               graphComm);
+    }
+}
+
+/**
+ * Exchange activations with one-sided communication. Each neighbor's
+ * window is exposed and accessed in one epoch; the transfers are those
+ * of the plan, so that nothing moves from or to frozen layers, from
+ * and to the plan's absolute addresses. The window cannot be posted with MPI_MODE_NOSTORE, since each rank
+ * updates its own activations in it between exchanges.
+ */
+void NsExchange::exchangeRma(const Plan &plan)
+{
+    int exposure = (rma_mode == NS_RMA_PUT) ? 0 : MPI_MODE_NOPUT;
+    MPI_Win_post(neighborGroup, exposure, rmaWin);
+    MPI_Win_start(neighborGroup, 0, rmaWin);
+    for (uint i = 0; i < neighbors.size(); i++) {
+        if (rma_mode == NS_RMA_PUT && plan.sendCounts[i] > 0) {
+            MPI_Put((void *) plan.sendDispls[i], plan.sendCounts[i],
+                    MPI_UINT8_T, neighbors[i], putTargets[i],
+                    plan.sendCounts[i], MPI_UINT8_T, rmaWin);
+        } else if (rma_mode == NS_RMA_GET && plan.recvCounts[i] > 0) {
+            MPI_Get((void *) plan.recvDispls[i], plan.recvCounts[i],
+                    MPI_UINT8_T, neighbors[i], getTargets[i],
+                    plan.recvCounts[i], MPI_UINT8_T, rmaWin);
+        }
+    }
+    MPI_Win_complete(rmaWin);
+    MPI_Win_wait(rmaWin);
+}
+
+/**
+ * Release the persistent requests, the window and the graph communicator
+ */
+void NsExchange::free()
+{
+    if (rmaWin != MPI_WIN_NULL) {
+        for (auto l : layers) {
+            if (l->activations_on_rank) {
+                MPI_Win_detach(rmaWin, l->activations);
+            }
+        }
+        MPI_Win_free(&rmaWin);
+        MPI_Group_free(&neighborGroup);
+    }
+    for (auto &p : plans) {
+        plan_free(p.second.requests);
+    }
+    plans.clear();
+    if (graphComm != MPI_COMM_NULL) {
+        MPI_Comm_free(&graphComm);
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef NS_EXCHANGE_HH
+#define NS_EXCHANGE_HH
+
+#include <vector>
+#include <unordered_map>
+#include <mpi.h>
+using std::vector;
+using std::unordered_map;
+
+#include "NsLayer.hh"
+#include "NsPersistent.hh"
+
+/**
+ * Aggregated activation exchange between layers
+ *
+ * Every rank delivers its slice of its layer's activations to all ranks
+ * of the layers connected to it by a tract, and receives their slices,
+ * in a single neighborhood collective (MPI_Neighbor_alltoallw) on a
+ * distributed graph communicator. The slices are sent from and received
+ * directly into the layers' activation arrays, addressed absolutely from
+ * MPI_BOTTOM, so that no buffer argument aliases another.
+ *
+ * Tracts from or to frozen layers are skipped. The counts for each
+ * combination of frozen layers form a gather plan that is built on
+ * first use, along with a persistent request if sync_mode asks for one.
+ *
+ * Alternatively (rmaSync property), the slices are moved with one-sided
+ * MPI_Put (each rank writes its slice into its neighbors' arrays) or
+ * MPI_Get (each rank reads its neighbors' slices) in a
+ * post-start-complete-wait epoch among the neighbors, through a dynamic
+ * window to which all activation arrays are attached. This takes
+ * precedence over sync_mode.
+ */
+enum NsRmaMode {
+    NS_RMA_OFF,
+    NS_RMA_PUT,
+    NS_RMA_GET
+};
+
+extern NsRmaMode rma_mode;
+
+void init_rma_mode();
+const char *rma_mode_name(NsRmaMode mode);
+
+class NsExchange {
+public:
+    NsExchange(const vector<NsLayer *> &layers);
+
+    void addLayerPair(int layer1, int layer2);
+    void exchange();
+    void free();
+
+private:
+    struct Plan {
+        vector<int> sendCounts;
+        vector<MPI_Aint> sendDispls;
+        vector<MPI_Datatype> sendTypes;
+        vector<int> recvCounts;
+        vector<MPI_Aint> recvDispls;
+        vector<MPI_Datatype> recvTypes;
+        NsSyncPlan requests;
+        bool isPlanned;         // requests have been set up
+    };
+
+    void commit();
+    Plan &getPlan();
+    static MPI_Aint address(const uint8_t *p);
+    void commitRma();
+    void exchangeRma(const Plan &plan);
+
+    const vector<NsLayer *> &layers;
+    vector<bool> isAdjacent;    // layers connected to this rank's layer
+    vector<int> neighbors;      // world ranks of the ranks in those layers
+    vector<int> neighborLayers; // the layer of each neighbor
+    MPI_Comm graphComm;
+    bool isCommitted;
+    unordered_map<uint, Plan> plans;  // by mask of frozen layers
+
+    // One-sided exchange
+    //
+    MPI_Win rmaWin;
+    MPI_Group neighborGroup;
+    vector<MPI_Aint> putTargets;  // per neighbor: own slice in its array
+    vector<MPI_Aint> getTargets;  // per neighbor: its slice in its array
+};
+
+#endif
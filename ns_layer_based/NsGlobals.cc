@@ -1,7 +1,9 @@
 #include "NsGlobals.hh"
 #include "NsSystem.hh"
+#include "NsPersistent.hh"
 #include <iostream>
 #include <map>
+#include <algorithm>
 #include <mpi.h>
 
 using std::string;
@@ -18,6 +20,7 @@ uint  timeStep;
  * MPI / parallel stuff
  */
 
+MPI_Comm sim_comm = MPI_COMM_NULL;
 int world_rank;
 int world_size;
 
@@ -33,10 +36,13 @@ int layer_size;     // total number of ranks in layer
 
 int *counts;
 int *displacements;
+
+bool rebalance_enabled = false;
+bool rebalanced = false;
 //uint8_t *global_activations;
 
-std::map <uint, string> gid_id_map;
 std::vector<std::string> layer_names;
+std::vector<uint> layer_first_gids;
 
 
 void init_counts_displacements() {
@@ -59,7 +65,31 @@ void init_counts_displacements() {
 }
 
 
+/**
+ * Layer-based distribution of a layer's units over all world ranks:
+ * the ranks assigned to the layer get contiguous ranges (in rank order),
+ * all other ranks get none.
+ */
+void base_partition(int layerID, std::vector<int> &owner_counts,
+                    std::vector<int> &owner_displacements) {
+    owner_counts.assign(world_size, 0);
+    owner_displacements.assign(world_size, 0);
+    int n_ranks = (world_size - layerID + 3) / 4;
+    int count = total_units_per_layer / n_ranks;
+    int remainder = total_units_per_layer % n_ranks;
+    for (int r = layerID; r < world_size; r += 4) {
+        owner_counts[r] = (r / 4 < remainder) ? count + 1 : count;
+    }
+    for (int r = 1; r < world_size; r++) {
+        owner_displacements[r] = owner_displacements[r - 1] + owner_counts[r - 1];
+    }
+}
+
+
 bool needs_layer_activations(int layerID) {
+    if (rebalance_enabled) {
+        return true;
+    }
     switch (layerID) {
         case 0:
             return true;
@@ -84,10 +114,27 @@ bool needs_layer_activations(int layerID) {
 
 
 void init_mpi_components() {
+    rebalance_enabled = props.getBool("rebalance", false);
     layer_id = world_rank % 4;
-    MPI_Comm_split(MPI_COMM_WORLD, layer_id, world_rank, &layer_comm);
+    MPI_Comm_split(sim_comm, layer_id, world_rank, &layer_comm);
     MPI_Comm_rank(layer_comm, &layer_rank);
     MPI_Comm_size(layer_comm, &layer_size);
     init_counts_displacements();
+    init_sync_mode();
+    init_rma_mode();
     //global_activations = new uint8_t [total_units_per_layer * world_size];
-}
\ No newline at end of file
+}
+
+
+/**
+ * Compute the string id ("<layer>.<index>") of a unit from its gid.
+ * Ids are only needed for traces, so they are not stored per unit
+ * or connection.
+ */
+string unit_id(uint gid)
+{
+    auto it = std::upper_bound(layer_first_gids.begin(),
+                               layer_first_gids.end(), gid);
+    uint l = it - layer_first_gids.begin() - 1;
+    return fmt::format("{}.{:02}", layer_names[l], gid - layer_first_gids[l]);
+}
@@ -5,6 +5,7 @@
 #include <unordered_set>
 #include <map>
 #include <string>
+#include <vector>
 #include <mpi.h>
 
 using std::string;
@@ -29,8 +30,9 @@ extern uint  timeStep; // hours
  * MPI / parallel stuff
  */
 
-extern int world_rank; // MPI rank
-extern int world_size; // MPI comm size
+extern MPI_Comm sim_comm; // ranks of this simulation (see NsEnsemble.hh)
+extern int world_rank; // MPI rank in sim_comm
+extern int world_size; // MPI comm size of sim_comm
 
 extern int layer_id;       // which layer (0 -> 3) this rank belongs to
 extern int layer_rank;     // rank within the layer
@@ -40,8 +42,9 @@ extern int total_units_per_layer;
 
 
 extern uint n_units_global;
-extern std::map <uint, string> gid_id_map;
 extern std::vector<std::string> layer_names;
+extern std::vector<uint> layer_first_gids; // gid of each layer's first unit
+string unit_id(uint gid);
 
 extern int global_layer_count;
 
@@ -50,7 +53,12 @@ extern MPI_Comm layer_comm;
 extern int* counts;
 extern int* displacements;
 
+extern bool rebalance_enabled; // units may move off their layer's ranks
+extern bool rebalanced;        // units are currently not distributed by layer
+
 void init_mpi_components();
 bool needs_layer_activations(int layerID);
+void base_partition(int layerID, std::vector<int> &owner_counts,
+                    std::vector<int> &owner_displacements);
 
 #endif
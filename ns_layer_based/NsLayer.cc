@@ -1,7 +1,10 @@
+#include <string.h>
+
 #include "NsSystem.hh"
 #include "NsLayer.hh"
 #include "MathUtil.hh"
 #include "NsGlobals.hh"
+#include "NsOutput.hh"
 
 /**
  * Implementation of the NsLayer class
@@ -11,42 +14,52 @@ NsLayer::NsLayer(const string &id, const string &type)
     : id(id),
       type(type),
       intID(global_layer_count++),
-      width(props.getUint(id + '.' + "width")),
-      height(props.getUint(id + '.' + "height")),
-      k(props.getDouble(id + '.' + "k")),
-      minInhibition(props.getDouble("minInhibition")),
-      maxInhibition(props.getDouble("maxInhibition")),
-      initInhibition(props.getDouble("initInhibition")),
-      inhibIncr(props.getDouble("inhibIncr")),
-      inhibition(initInhibition),
+      params(params_layer(id)),
+      width(params.width),
+      height(params.height),
+      k(params.k),
+      inhibition(params.initInhibition),
       isClamped(false),
       isFrozen(false),
       isLesioned(false),
-      orthogonalPatterns(props.getBool("orthogonalPatterns")),
       nextPatternUnit(0),
-      printPatterns(props.getBool("printPatterns")),
       activations_on_rank(needs_layer_activations(intID))
 {
     size = width * height;
     if (activations_on_rank) activations = new uint8_t [size];
+    if (activations_on_rank) memset(activations, 0, size);
+    global_displacement = n_units_global;
     layer_names.push_back(id);
-    for (uint i = 0; i < size; i++) {
-        if (activations_on_rank) activations[i] = 0;
-        // assignment of units to ranks based on layer
-        if (layer_id == intID && (i >= (unsigned)displacements[layer_rank] && i < (unsigned)(displacements[layer_rank] + counts[layer_rank]))) {
-            units.push_back(new NsUnit(this, i, n_units_global));
+    layer_first_gids.push_back(global_displacement);
+    n_units_global += size;
+
+    // assignment of units to ranks based on layer: only create the
+    // units this rank owns
+    if (layer_id == intID) {
+        uint first = displacements[layer_rank];
+        uint last = first + counts[layer_rank];
+        unitSlab.reserve(counts[layer_rank]);
+        units.reserve(counts[layer_rank]);
+        for (uint i = first; i < last; i++) {
+            unitSlab.emplace_back(this, i, global_displacement + i);
+            units.push_back(&unitSlab.back());
         }
-        gid_id_map.insert({n_units_global, id + "." + fmt::format("{:02}", i)});
-        layer_gids.push_back(n_units_global);
-        n_units_global++;
     }
+    base_partition(intID, owner_counts, owner_displacements);
 }
 
-void NsLayer::makePattern(const string &patId)
+/**
+ * Make a new pattern: a random set of units or, with orthogonalPatterns,
+ * the next units not used by any pattern yet
+ * @param patId Pattern ID
+ * @return the pattern's handle
+ */
+NsPatternHandle NsLayer::makePattern(const string &patId)
 {
-    ABORT_IF(definedPatterns.count(patId) != 0, "Duplicate pattern ID");
+    NsPatternHandle h = registerPattern(patId);
+    ABORT_IF(hasPattern(h), "Duplicate pattern ID");
     NsPattern p;
-    if (orthogonalPatterns) {
+    if (params.orthogonalPatterns) {
         for (uint i = 0; i < k * size; i++) {
             ABORT_IF(nextPatternUnit >= size, "too many patterns");
             p.push_back(nextPatternUnit++);
@@ -54,13 +67,28 @@ void NsLayer::makePattern(const string &patId)
     } else {
         p = Util::randUniqueUintList(k * size, size);
     }
-    definedPatterns.insert({patId, p});
-    definedPatternIds.push_back(patId);
+    definePattern(h, p);
 
     TRACE_DEBUG("{}.{} {}\n", id, patId, patternToStr(p));
+    return h;
+}
+
+/**
+ * Define a pattern
+ * @param h Pattern handle
+ * @param pattern The pattern's units
+ */
+void NsLayer::definePattern(NsPatternHandle h, const NsPattern &pattern)
+{
+    if (h >= definedPatterns.size()) {
+        definedPatterns.resize(h + 1);
+    }
+    definedPatterns[h] = { patternArena.copy(pattern),
+                           patternToMask(pattern, size, patternArena) };
+    definedPatternHandles.push_back(h);
 }
 
-void NsLayer::setPattern(const NsPattern &pat)
+void NsLayer::setPattern(const ArenaArray<uint> &pat)
 {
     if (!isFrozen && activations_on_rank) {
         clear();
@@ -70,27 +98,39 @@ void NsLayer::setPattern(const NsPattern &pat)
     }
 }
 
+void NsLayer::setPattern(NsPatternHandle h)
+{
+    ABORT_IF(!hasPattern(h), "Layer {} has no pattern {}", id, h);
+    setPattern(definedPatterns[h].units);
+}
+
 void NsLayer::setPattern(const string &patId)
 {
-    setPattern(definedPatterns.at(patId));
+    setPattern(findPattern(patId));
 }
 
+/**
+ * Forget all defined patterns, and release their storage in place
+ */
 void NsLayer::clearPatterns()
 {
-    definedPatternIds.clear();
-    definedPatterns.clear();
+    for (auto h : definedPatternHandles) {
+        definedPatterns[h] = NsLayerPattern();
+    }
+    definedPatternHandles.clear();
+    patternArena.reset();
 }
 
 /**
  * Randomly select one of the trained patterns and activate it
  */
-const string &NsLayer::setRandomPattern()
+NsPatternHandle NsLayer::setRandomPattern()
 {
-    uint i = Util::randInt(0, definedPatternIds.size());
-    const string &pid = definedPatternIds[i];
-    setPattern(pid);
-    TRACE_INFO("Layer {}, pattern {}", id, pid);
-    return pid;
+    uint i = Util::randInt(0, definedPatternHandles.size());
+    NsPatternHandle h = definedPatternHandles[i];
+    setPattern(h);
+    TRACE_INFO("Layer {}, pattern {}", id, patternId(h));
+    return h;
 }
 
 void NsLayer::clear()
@@ -116,9 +156,9 @@ void NsLayer::adjustInhibition()
     // in proportion to the magnitude of the error
 
     inhibition = Util::bracket(
-        inhibition + (double) error / target * inhibIncr,
-        minInhibition,
-        maxInhibition);
+        inhibition + (double) error / target * params.inhibIncr,
+        params.minInhibition,
+        params.maxInhibition);
 
     TTRACE_DEBUG("inhib", "{} active: {}  inhib: {}", id, getNumActive(), inhibition);
 }
@@ -189,6 +229,17 @@ void NsLayer::maintain()
 uint NsLayer::getNumActive() const
 {
     uint numActive = 0;
+    if (rebalanced) {
+        // Every rank has all activations
+        //
+        for (uint i = 0; i < size; i++) {
+            if (activations[i]) {
+                numActive++;
+            }
+        }
+        return numActive;
+    }
+
     if (layer_id == intID) {
         for(int i = displacements[layer_rank]; i < displacements[layer_rank]+counts[layer_rank]; i++) {
             if (activations[i]) {
@@ -196,11 +247,11 @@ uint NsLayer::getNumActive() const
             }
         }
         MPI_Allreduce(MPI_IN_PLACE, &numActive, 1, MPI_UINT32_T, MPI_SUM, layer_comm);
-        if (layer_rank == 0 && intID != 0) MPI_Send(&numActive, 1, MPI_UINT32_T, 0, intID, MPI_COMM_WORLD);
+        if (layer_rank == 0 && intID != 0) MPI_Send(&numActive, 1, MPI_UINT32_T, 0, intID, sim_comm);
     }
 
     if (world_rank == 0 && intID != 0) {
-        MPI_Recv(&numActive, 1, MPI_UINT32_T, intID, intID, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        MPI_Recv(&numActive, 1, MPI_UINT32_T, intID, intID, sim_comm, MPI_STATUS_IGNORE);
     }
 
     return numActive;
@@ -215,31 +266,62 @@ void NsLayer::printState() const
 }
 
 /**
- * Count number of active target units
- * @param targetId ID of target pattern
- * @return Count of targeted active units
+ * Get the set of active units among a range of units
+ * @param begin Index of the first unit of the range
+ * @param end Index past the last unit of the range
+ * @return the active units; valid until the next call
+ */
+const NsUnitMask &NsLayer::getActiveUnits(uint begin, uint end) const
+{
+    activeUnits.assign(unitMaskWords(size), 0);
+    for (uint i = begin; i < end; i++) {
+        activeUnits[i / 64] |= (uint64_t) (activations[i] != 0) << (i % 64);
+    }
+    return activeUnits;
+}
+
+/**
+ * Count number of active units and of active target units. Must be
+ * called by all ranks; the counts are valid on world rank 0.
+ * @param target Target pattern
+ * @param numHits Set to the count of targeted active units
+ * @param numActive Set to the count of active units
  */
-uint NsLayer::getNumHits(const string &targetId) const
+void NsLayer::getNumHits(NsPatternHandle target,
+                         uint &numHits, uint &numActive) const
 {
-    NsPattern target = definedPatterns.at(targetId);
-    uint ret = 0;
+    const NsStoredMask &mask = definedPatterns[target].mask;
+    uint count[2] = { 0, 0 };   // hits, active
+    if (rebalanced) {
+        // Every rank has all activations
+        //
+        const NsUnitMask &active = getActiveUnits(0, size);
+        numHits = countCommonUnits(active, mask);
+        numActive = countUnits(active);
+        return;
+    }
+
     if (layer_id == intID) {
-        for (auto id : target) {
-            if(id >= (unsigned)displacements[layer_rank] &&
-            id < (unsigned)(displacements[layer_rank] + counts[layer_rank]) && activations[id]) ret++;
-        }
-        MPI_Allreduce(MPI_IN_PLACE, &ret, 1, MPI_UINT32_T, MPI_SUM, layer_comm);
-        if (layer_rank == 0 && intID != 0) MPI_Send(&ret, 1, MPI_UINT32_T, 0, intID, MPI_COMM_WORLD);
+        const NsUnitMask &active = getActiveUnits(
+            displacements[layer_rank],
+            displacements[layer_rank] + counts[layer_rank]);
+        count[0] = countCommonUnits(active, mask);
+        count[1] = countUnits(active);
+        MPI_Allreduce(MPI_IN_PLACE, count, 2, MPI_UINT32_T, MPI_SUM, layer_comm);
+        if (layer_rank == 0 && intID != 0) MPI_Send(count, 2, MPI_UINT32_T, 0, intID, sim_comm);
     }
     if (world_rank == 0  && intID != 0) {
-        MPI_Recv(&ret, 1, MPI_UINT32_T, intID, intID, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        MPI_Recv(count, 2, MPI_UINT32_T, intID, intID, sim_comm, MPI_STATUS_IGNORE);
     }
-    return ret;
+    numHits = count[0];
+    numActive = count[1];
 }
 
 void NsLayer::printScoreHdr()
 {
-    fmt::print("time score condition layer target hits extras\n");
+    if (world_rank == 0) {
+        fmt::print("time score condition layer target hits extras\n");
+    }
 }
 
 void NsLayer::printNumActiveHdr()
@@ -252,27 +334,30 @@ void NsLayer::printNumActive() const
       infoTrace("{} layer {} {}\n", simTime, id, getNumActive());
 }
 
-void NsLayer::printGrid(const string &tag, const string &targetId) const
+void NsLayer::printGrid(const string &tag, NsPatternHandle target) const
 {
-    bool targetKnown = (definedPatterns.count(targetId) != 0);
-
-    if (targetKnown) {
-        uint targetSize = definedPatterns.at(targetId).size();
-        uint numHits = getNumHits(targetId);
-        uint numActive = getNumActive();
+    if (hasPattern(target)) {
+        uint targetSize = definedPatterns[target].units.size();
+        uint numHits;
+        uint numActive;
+        getNumHits(target, numHits, numActive);
         uint numExtras = numActive > numHits ?
             numActive - numHits : 0;
-        fmt::print("{} score {} {} {} {} {}\n",
-                   simTime / 24., tag, id, targetSize, numHits, numExtras);
+        if (world_rank == 0) {
+            fmt::print("{} score {} {} {} {} {}\n",
+                       simTime / 24., tag, id, targetSize, numHits, numExtras);
+            output_record(NS_REC_SCORE, output_name(tag), output_name(id), 0,
+                          targetSize, numHits, numExtras);
+        }
     } else {
-        if (printPatterns) {
+        if (params.printPatterns) {
             infoTrace("{} {} {}\n", simTime / 24., tag, id);
         }
     }
 
     if (activations_on_rank) {
-        if (printPatterns) {
-            infoTrace("+{}+\n", string(2 * width -1, '-'));
+        if (params.printPatterns) {
+            infoTrace("+{:-<{}}+\n", "", 2 * width - 1);
             for (uint row = 0; row < height; row++) {
                 infoTrace("|");
                 for (uint col = 0; col < width; col++) {
@@ -282,7 +367,7 @@ void NsLayer::printGrid(const string &tag, const string &targetId) const
                 }
                 infoTrace("|\n");
             }
-            infoTrace("+{}+\n", string(2 * width -1, '-'));
+            infoTrace("+{:-<{}}+\n", "", 2 * width - 1);
         }
     }
 
@@ -16,11 +16,16 @@ using std::string;
 class NsLayer {
 public:
     NsLayer(const string &id, const string &type);
-    void makePattern(const string &patId);
+    NsPatternHandle makePattern(const string &patId);
+    void definePattern(NsPatternHandle h, const NsPattern &pattern);
+    bool hasPattern(NsPatternHandle h) const {
+        return h < definedPatterns.size() && !definedPatterns[h].mask.empty();
+    }
     void setPattern(const string &patId);
-    void setPattern(const NsPattern &pat);
+    void setPattern(NsPatternHandle h);
+    void setPattern(const ArenaArray<uint> &pat);
     void clearPatterns();
-    const string &setRandomPattern();
+    NsPatternHandle setRandomPattern();
     void clear();
     void randomize();
     void computeNewActivations();
@@ -31,41 +36,47 @@ public:
     void maintain();
     uint getNumActive() const;
     static void printScoreHdr();
-    uint getNumHits(const string &targetId) const;
+    const NsUnitMask &getActiveUnits(uint begin, uint end) const;
+    void getNumHits(NsPatternHandle target,
+                    uint &numHits, uint &numActive) const;
     static void printNumActiveHdr();
     void printNumActive() const;
     void printState() const;
-    void printGrid(const string &tag, const string &targetId) const;
+    void printGrid(const string &tag, NsPatternHandle target) const;
 
     void saveInhibition() { savedInhibition = inhibition; }
+    bool isInSlab(const NsUnit *u) const {
+        return !unitSlab.empty() &&
+               u >= &unitSlab.front() && u <= &unitSlab.back();
+    }
     void restoreInhibition() { inhibition = savedInhibition; }
 
     string toStr(uint iLvl = 0, const string &iStr = "   ") const;
     const string id;
     const string type;
     const int intID;
+    const NsLayerParams &params;
     const uint width;
     const uint height;
     const double k;
-    const double minInhibition;
-    const double maxInhibition;
-    const double initInhibition;
-    const double inhibIncr;
     double inhibition;
     double savedInhibition;
     bool isClamped;
     bool isFrozen;
     bool isLesioned;
     vector<NsUnit *> units;
-    vector<uint> layer_gids;
+    vector<NsUnit> unitSlab;         // the units created by the
+                                     // constructor, in one block
+    vector<int> owner_counts;        // units owned by each world rank
+    vector<int> owner_displacements; // index of each world rank's first unit
     uint8_t *activations;
     uint size;
-    uint global_displacement;
-    bool orthogonalPatterns;
+    uint global_displacement; // gid of the first unit
     uint nextPatternUnit;
-    unordered_map<string, NsPattern> definedPatterns;
-    vector<string> definedPatternIds;
-    bool printPatterns;
+    vector<NsLayerPattern> definedPatterns;        // per handle
+    vector<NsPatternHandle> definedPatternHandles; // in order of definition
+    Arena patternArena;     // defined patterns, until clearPatterns()
+    mutable NsUnitMask activeUnits;
     bool activations_on_rank;
 };
 
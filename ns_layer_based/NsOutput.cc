@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <unordered_map>
+#include <mpi.h>
+
+#include "NsOutput.hh"
+#include "NsGlobals.hh"
+#include "NsProfile.hh"
+
+static MPI_File recordFile;
+static MPI_Datatype recordType;
+static MPI_Offset recordFileEnd;
+static std::vector<NsRecord> records;
+static std::unordered_map<string, uint32_t> names;
+
+static FILE *fout;
+static FILE *ferr;
+
+/**
+ * Redirect standard output and error and open the shared record file.
+ * Must be called by all ranks.
+ * @param prefix Output path prefix
+ */
+void output_open(const char *prefix)
+{
+    char fname[1000];
+
+    if (world_rank == 0) {
+        snprintf(fname, sizeof(fname), "%s_%d.raw", prefix, world_rank);
+        fout = freopen(fname, "a", stdout);
+        snprintf(fname, sizeof(fname), "%s_%d.err", prefix, world_rank);
+        ferr = freopen(fname, "a", stderr);
+    } else {
+        fout = freopen("/dev/null", "w", stdout);
+        ferr = NULL;
+    }
+
+    MPI_Type_contiguous(sizeof(NsRecord), MPI_BYTE, &recordType);
+    MPI_Type_commit(&recordType);
+
+    snprintf(fname, sizeof(fname), "%s.rec", prefix);
+    MPI_File_open(sim_comm, fname, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                  MPI_INFO_NULL, &recordFile);
+    MPI_File_set_size(recordFile, 0);
+
+    NsRecordFileHeader hdr;
+    memcpy(hdr.magic, "NSRO", 4);
+    hdr.version = recordFileVersion;
+    hdr.recordSize = sizeof(NsRecord);
+    hdr.replicate = 0;
+    hdr.numRanks = world_size;
+    if (world_rank == 0) {
+        MPI_File_write_at(recordFile, 0, &hdr, sizeof(hdr), MPI_BYTE,
+                          MPI_STATUS_IGNORE);
+    }
+    recordFileEnd = sizeof(hdr);
+}
+
+/**
+ * Get the index of a name. Rank 0 buffers an NS_REC_NAME record for it
+ * if it is new; since rank 0's records are flushed first, the name
+ * precedes any record that refers to it. Names that all ranks use must be
+ * registered by all ranks in the same order, before rank 0 registers
+ * names of its own (score conditions).
+ */
+uint32_t output_name(const string &name)
+{
+    auto it = names.find(name);
+    if (it != names.end()) {
+        return it->second;
+    }
+    uint32_t id = names.size();
+    names.insert({name, id});
+
+    if (world_rank == 0) {
+        NsRecord rec;
+        memset(&rec, 0, sizeof(rec));
+        rec.type = NS_REC_NAME;
+        rec.id = id;
+        rec.id2 = name.size();
+        records.push_back(rec);
+
+        uint numRecs =
+            (name.size() + sizeof(NsRecord) - 1) / sizeof(NsRecord);
+        size_t first = records.size();
+        records.resize(first + numRecs);
+        memset(&records[first], 0, numRecs * sizeof(NsRecord));
+        memcpy(&records[first], name.data(), name.size());
+    }
+
+    return id;
+}
+
+/**
+ * Append a record to this rank's record buffer
+ */
+void output_record(NsRecordType type, uint32_t id, uint32_t id2,
+                   uint32_t id3, double v0, double v1, double v2,
+                   uint16_t flags)
+{
+    NsRecord rec;
+    rec.type = type;
+    rec.flags = flags;
+    rec.id = id;
+    rec.id2 = id2;
+    rec.id3 = id3;
+    rec.time = simTime / 24.;
+    rec.values[0] = v0;
+    rec.values[1] = v1;
+    rec.values[2] = v2;
+    records.push_back(rec);
+}
+
+/**
+ * Write all ranks' buffered records to the record file, in rank order.
+ * Must be called by all ranks.
+ */
+void output_flush()
+{
+    NsProfileRegion region(NS_PHASE_OUTPUT);
+
+    long long count = records.size();
+    long long offset = 0;
+    long long total = 0;
+    MPI_Exscan(&count, &offset, 1, MPI_LONG_LONG, MPI_SUM, sim_comm);
+    MPI_Allreduce(&count, &total, 1, MPI_LONG_LONG, MPI_SUM, sim_comm);
+    if (world_rank == 0) {
+        offset = 0;
+    }
+
+    MPI_File_write_at_all(recordFile,
+                          recordFileEnd + offset * sizeof(NsRecord),
+                          records.data(), count, recordType,
+                          MPI_STATUS_IGNORE);
+    recordFileEnd += total * sizeof(NsRecord);
+    records.clear();
+}
+
+/**
+ * Flush and close everything. Must be called by all ranks.
+ */
+void output_close()
+{
+    NsProfileRegion region(NS_PHASE_OUTPUT);
+
+    output_flush();
+    MPI_File_close(&recordFile);
+    MPI_Type_free(&recordType);
+
+    fclose(fout);
+    if (ferr != NULL) {
+        fclose(ferr);
+    }
+}
@@ -0,0 +1,127 @@
+#include <unordered_map>
+
+#include "NsParams.hh"
+#include "NsGlobals.hh"
+#include "Trace.hh"
+#include "Util.hh"
+
+#define CHECK_RANGE(p, field, min, max) \
+    ABORT_UNLESS(Util::isInRange(p.field, min, max), \
+                 "bad value for '{}': {}", #field, p.field)
+
+static bool initialized = false;
+static NsUnitParams unitParams;
+static NsConnectionParams connectionParams;
+static NsSystemParams systemParams;
+static NsLayerParams layerDefaults;       // the values shared by all layers
+
+static std::unordered_map<string, NsLayerParams> layerParams;   // by ID
+static std::unordered_map<string, NsTractParams> tractParams;   // by type
+
+/**
+ * Resolve the global parameters. Must be called after the props have been
+ * read.
+ */
+void params_init()
+{
+    unitParams.actFuncK     = props.getDouble("actFuncK");
+    unitParams.actThreshold = props.getDouble("actThreshold");
+
+    connectionParams.minPsdSize     = props.getDouble("minPsdSize");
+    connectionParams.maxPsdSize     = props.getDouble("maxPsdSize");
+    connectionParams.minNumCiAmpars = props.getDouble("minNumCiAmpars");
+    connectionParams.minNumCpAmpars = props.getDouble("minNumCpAmpars");
+    connectionParams.potProbK       = props.getDouble("potProbK");
+    connectionParams.potProbHalf    = props.getDouble("potProbHalf");
+
+    systemParams.trainNumStimCycles = props.getUint("trainNumStimCycles");
+    systemParams.consNumStimCycles  = props.getUint("consNumStimCycles");
+    systemParams.reactNumStimCycles = props.getUint("reactNumStimCycles");
+    systemParams.numSettleCycles    = props.getUint("numSettleCycles");
+
+    layerDefaults.minInhibition      = props.getDouble("minInhibition");
+    layerDefaults.maxInhibition      = props.getDouble("maxInhibition");
+    layerDefaults.initInhibition     = props.getDouble("initInhibition");
+    layerDefaults.inhibIncr          = props.getDouble("inhibIncr");
+    layerDefaults.orthogonalPatterns = props.getBool("orthogonalPatterns");
+    layerDefaults.printPatterns      = props.getBool("printPatterns");
+
+    layerParams.clear();
+    tractParams.clear();
+    initialized = true;
+}
+
+const NsUnitParams &params_unit()
+{
+    ABORT_UNLESS(initialized, "params_init() has not been called");
+    return unitParams;
+}
+
+const NsConnectionParams &params_connection()
+{
+    ABORT_UNLESS(initialized, "params_init() has not been called");
+    return connectionParams;
+}
+
+const NsSystemParams &params_system()
+{
+    ABORT_UNLESS(initialized, "params_init() has not been called");
+    return systemParams;
+}
+
+/**
+ * Get the parameters of a layer, resolving them on first use
+ * @param id Layer ID
+ */
+const NsLayerParams &params_layer(const string &id)
+{
+    ABORT_UNLESS(initialized, "params_init() has not been called");
+    auto it = layerParams.find(id);
+    if (it != layerParams.end()) return it->second;
+
+    NsLayerParams p = layerDefaults;
+    p.width  = props.getUint(id + '.' + "width");
+    p.height = props.getUint(id + '.' + "height");
+    p.k      = props.getDouble(id + '.' + "k");
+    return layerParams.insert({ id, p }).first->second;
+}
+
+/**
+ * Get the parameters of a tract type, resolving and checking them on
+ * first use
+ * @param type Tract type
+ */
+const NsTractParams &params_tract(const string &type)
+{
+    ABORT_UNLESS(initialized, "params_init() has not been called");
+    auto it = tractParams.find(type);
+    if (it != tractParams.end()) return it->second;
+
+    NsTractParams p;
+    p.acqLearnRate            = props.getDouble(type + '.' + "acqLearnRate");
+    p.reactE3Level            = props.getDouble(type + '.' + "reactE3Level");
+    p.consLearnRate01h        = props.getDouble(type + '.' + "consLearnRate01h");
+    p.psdDecayRate01h         = props.getDouble(type + '.' + "psdDecayRate01h");
+    p.cpAmparRemovalRate01h   = props.getDouble(type + '.' + "cpAmparRemovalRate01h");
+    p.ciAmparInsertionRate01h = props.getDouble(type + '.' + "ciAmparInsertionRate01h");
+    p.ciAmparRemovalRate01h   = props.getDouble(type + '.' + "ciAmparRemovalRate01h");
+    p.baseDepotProb01h        = props.getDouble(type + '.' + "baseDepotProb01h");
+    p.maxE3DepotProb01h       = props.getDouble(type + '.' + "maxE3DepotProb01h");
+    p.e3DecayRate01h          = props.getDouble(type + '.' + "e3DecayRate01h");
+    p.maxPotProb01h           = props.getDouble(type + '.' + "maxPotProb01h");
+
+    // Sanity check
+    //
+    CHECK_RANGE(p, acqLearnRate,            0.0, 1.0);
+    CHECK_RANGE(p, reactE3Level,            0.0, 1.0);
+    CHECK_RANGE(p, consLearnRate01h,        0.0, 1.0);
+    CHECK_RANGE(p, psdDecayRate01h,         0.0, 1.0);
+    CHECK_RANGE(p, cpAmparRemovalRate01h,   0.0, 1.0);
+    CHECK_RANGE(p, ciAmparRemovalRate01h,   0.0, 1.0);
+    CHECK_RANGE(p, baseDepotProb01h,        0.0, 1.0);
+    CHECK_RANGE(p, e3DecayRate01h,          0.0, 1.0);
+    CHECK_RANGE(p, maxE3DepotProb01h,       0.0, 1.0);
+    CHECK_RANGE(p, maxPotProb01h,           0.0, 1.0);
+
+    return tractParams.insert({ type, p }).first->second;
+}
@@ -0,0 +1,39 @@
+#include <unordered_map>
+
+#include "NsPattern.hh"
+
+static vector<string> patternIds;
+static std::unordered_map<string, NsPatternHandle> patternHandles;
+
+/**
+ * Get the handle of a pattern ID, registering the ID if it is new
+ */
+NsPatternHandle registerPattern(const string &id)
+{
+    auto it = patternHandles.find(id);
+    if (it != patternHandles.end()) {
+        return it->second;
+    }
+    NsPatternHandle h = patternIds.size();
+    patternIds.push_back(id);
+    patternHandles.insert({id, h});
+    return h;
+}
+
+/**
+ * Get the handle of a pattern ID
+ * @return the handle, or noPattern if the ID has not been registered
+ */
+NsPatternHandle findPattern(const string &id)
+{
+    auto it = patternHandles.find(id);
+    return (it == patternHandles.end()) ? noPattern : it->second;
+}
+
+/**
+ * Get the ID of a registered pattern
+ */
+const string &patternId(NsPatternHandle h)
+{
+    return patternIds.at(h);
+}
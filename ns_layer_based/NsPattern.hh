@@ -1,6 +1,15 @@
 #ifndef NS_PATTERN_HH
 #define NS_PATTERN_HH
 
+#include <stdint.h>
+#include <limits.h>
+#include <vector>
+#include <string>
+#include "Arena.hh"
+
+using std::vector;
+using std::string;
+
 /**
  * An activation pattern is a vector of unit indices, identifying
  * the units to activate when presenting a stimulus to a layer.
@@ -24,5 +33,80 @@ inline string patternToStr(NsPattern &p)
     return ret;
 }
 
+/**
+ * Pattern registry
+ *
+ * Pattern IDs such as "CS-US" or "dummy-17" are registered once, when a
+ * pattern is first made, and are then referred to by integer handles.
+ * A handle denotes the same pattern ID in all layers, and indexes the
+ * layers' pattern tables directly, so that no strings are hashed or
+ * compared while the patterns are used.
+ */
+typedef uint NsPatternHandle;
+static const NsPatternHandle noPattern = UINT_MAX;
+
+NsPatternHandle registerPattern(const string &id);
+NsPatternHandle findPattern(const string &id);
+const string &patternId(NsPatternHandle h);
+
+/**
+ * A set of units as a bitmask: unit i is in the set if bit i % 64 of
+ * word i / 64 is set
+ */
+typedef vector<uint64_t> NsUnitMask;
+
+inline uint unitMaskWords(uint numUnits)
+{
+    return (numUnits + 63) / 64;
+}
+
+/**
+ * A set of units as a bitmask in an arena, laid out like NsUnitMask
+ */
+typedef ArenaArray<uint64_t> NsStoredMask;
+
+inline NsStoredMask patternToMask(const NsPattern &p, uint numUnits,
+                                  Arena &arena)
+{
+    NsStoredMask mask = arena.makeArray<uint64_t>(unitMaskWords(numUnits));
+    for (auto u : p) {
+        mask[u / 64] |= (uint64_t) 1 << (u % 64);
+    }
+    return mask;
+}
+
+/**
+ * Count the units that are in both of two sets
+ */
+inline uint countCommonUnits(const NsUnitMask &a, const NsStoredMask &b)
+{
+    uint n = 0;
+    for (uint w = 0; w < a.size(); w++) {
+        n += __builtin_popcountll(a[w] & b[w]);
+    }
+    return n;
+}
+
+/**
+ * Count the units in a set
+ */
+inline uint countUnits(const NsUnitMask &a)
+{
+    uint n = 0;
+    for (auto w : a) {
+        n += __builtin_popcountll(w);
+    }
+    return n;
+}
+
+/**
+ * A pattern as defined in a layer: its units as a list, to activate
+ * them, and as a mask, to score activations against them. Both are
+ * stored in the layer's pattern arena.
+ */
+struct NsLayerPattern {
+    ArenaArray<uint> units;
+    NsStoredMask mask;
+};
 
 #endif
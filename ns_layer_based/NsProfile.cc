@@ -0,0 +1,60 @@
+#ifdef NS_MPIP
+
+#include <string.h>
+#include <mpi.h>
+
+#include "NsProfile.hh"
+#include "NsGlobals.hh"
+#include "Trace.hh"
+
+static const char *phaseNames[NS_NUM_PHASES] = {
+    "construction",
+    "training",
+    "settle",
+    "synchronize",
+    "maintain",
+    "test",
+    "output"
+};
+
+static bool isSelected[NS_NUM_PHASES];
+static uint activeRegions = 0;  // currently entered regions of selected phases
+
+/**
+ * Switch off profiling until the first selected phase is entered.
+ * Call right after MPI_Init.
+ */
+void profile_init()
+{
+    MPI_Pcontrol(0);
+}
+
+/**
+ * Select the phases to profile from the mpipPhases property
+ */
+void profile_select_phases()
+{
+    std::vector<string> all(phaseNames, phaseNames + NS_NUM_PHASES);
+    for (auto &name : props.getStringVector("mpipPhases", all)) {
+        uint p = 0;
+        while (p < NS_NUM_PHASES && name != phaseNames[p]) p++;
+        ABORT_IF(p == NS_NUM_PHASES, "Unknown mpipPhases value: {}", name);
+        isSelected[p] = true;
+    }
+}
+
+void profile_begin(NsPhase phase)
+{
+    if (isSelected[phase] && activeRegions++ == 0) {
+        MPI_Pcontrol(1);
+    }
+}
+
+void profile_end(NsPhase phase)
+{
+    if (isSelected[phase] && --activeRegions == 0) {
+        MPI_Pcontrol(0);
+    }
+}
+
+#endif
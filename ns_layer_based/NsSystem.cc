@@ -1,18 +1,20 @@
 #include "NsSystem.hh"
 #include "NsGlobals.hh"
+#include "NsOutput.hh"
+#include "NsProfile.hh"
 #include <mpi.h>
 
-MPI_Request reqs[3];
-
 /**
  * Constructor
- * @param props Properties
+ * @param params Parameters
  */
-NsSystem::NsSystem(Props &props)
-    : trainNumStimCycles(props.getUint("trainNumStimCycles")),
-      consNumStimCycles(props.getUint("consNumStimCycles")),
-      reactNumStimCycles(props.getUint("reactNumStimCycles")),
-      numSettleCycles(props.getUint("numSettleCycles"))
+NsSystem::NsSystem(const NsSystemParams &params)
+    : trainNumStimCycles(params.trainNumStimCycles),
+      consNumStimCycles(params.consNumStimCycles),
+      reactNumStimCycles(params.reactNumStimCycles),
+      numSettleCycles(params.numSettleCycles),
+      exchange(layers_vec),
+      balancer(NULL)
 {
 }
 
@@ -22,10 +24,16 @@ NsSystem::NsSystem(Props &props)
  */
 void NsSystem::addLayer(const string &id, const string &type)
 {
+    // All ranks add the same layers and tracts in the same order, so
+    // their record name indices agree
+    output_name(id);
+
     NsLayer *layer = new NsLayer(id, type);
     std::pair<string, NsLayer *> pair(id, layer);
     layers.insert(pair);
     layers_vec.push_back(layer);
+    inTracts.push_back(vector<NsTract *>());
+    outTracts.push_back(vector<NsTract *>());
 }
 
 /**
@@ -43,10 +51,15 @@ void NsSystem::addTract(const string &fromLayerId,
     NsLayer *fromLayer = layers.at(fromLayerId);
     NsLayer *toLayer = layers.at(toLayerId);
 
+    output_name(id);
     NsTract *tract =
         new NsTract(id, fromLayer, toLayer, type);
     std::pair<string, NsTract *> pair(id, tract);
     tracts.insert(pair);
+    tract->intID = tracts_vec.size();
+    tracts_vec.push_back(tract);
+    inTracts[toLayer->intID].push_back(tract);
+    outTracts[fromLayer->intID].push_back(tract);
 }
 
 /**
@@ -59,40 +72,52 @@ void NsSystem::addTract(const string &fromLayerId,
 void NsSystem::addBiTract(const string &layer1Id, const string &layer2Id,
                           const string &type)
 {
-    int layer1_id = layers.at(layer1Id)->intID;
-    int layer2_id = layers.at(layer2Id)->intID;
-    MPI_Comm inter_comm;
-    if (layer_id == layer1_id) {
-        MPI_Intercomm_create(layer_comm, 0, MPI_COMM_WORLD, layer2_id, 99+(layer1_id + 1)*layer2_id, &inter_comm);
-        synchronization_components.push_back(std::make_tuple(layer1_id, layer2_id, inter_comm));
-    } else if (layer_id == layer2_id) {
-        MPI_Intercomm_create(layer_comm, 0, MPI_COMM_WORLD, layer1_id, 99+(layer1_id + 1)*layer2_id, &inter_comm);
-        synchronization_components.push_back(std::make_tuple(layer1_id, layer2_id, inter_comm));
-    }
+    exchange.addLayerPair(getLayer(layer1Id)->intID,
+                          getLayer(layer2Id)->intID);
     addTract(layer1Id, layer2Id, type);
     addTract(layer2Id, layer1Id, type);
 }
 
 void NsSystem::synchronize()
 {
-    int i = 0;
-    for (auto const& tup : synchronization_components) {
-        int l1, l2;
-        MPI_Comm comm;
-        std::tie(l1, l2, comm) = tup;
-        if (!(layers_vec[l1]->isFrozen || layers_vec[l2]->isFrozen)) {
-            if (layer_id == l1) {
-                MPI_Iallgatherv(&(layers_vec[l1]->activations[displacements[layer_rank]]),
-                                counts[layer_rank], MPI_UINT8_T, &(layers_vec[l2]->activations[0]),
-                                counts, displacements, MPI_UINT8_T, comm, &reqs[i++]);
-            } else if (layer_id == l2) {
-                MPI_Iallgatherv(&(layers_vec[l2]->activations[displacements[layer_rank]]),
-                                counts[layer_rank], MPI_UINT8_T, &(layers_vec[l1]->activations[0]),
-                                counts, displacements, MPI_UINT8_T, comm, &reqs[i++]);
-            }
-        }
+    NsProfileRegion region(NS_PHASE_SYNCHRONIZE);
+
+    if (rebalanced) {
+        balancer->synchronize();
+        return;
+    }
+
+    exchange.exchange();
+}
+
+/**
+ * Release the resources of the activation exchange
+ */
+void NsSystem::freeSynchronization()
+{
+    exchange.free();
+}
+
+/**
+ * Start measuring costs, so that units can be redistributed among
+ * ranks by rebalance() when layers are frozen or lesioned.
+ * @param minGain Minimum predicted relative reduction in the cost of the
+ *        busiest rank that justifies moving units.
+ */
+void NsSystem::enableRebalancing(double minGain)
+{
+    balancer = new NsBalancer(this, minGain);
+}
+
+/**
+ * Redistribute units according to which layers are currently frozen.
+ * Must be called by all ranks, at event boundaries.
+ */
+void NsSystem::rebalance()
+{
+    if (balancer != NULL) {
+        balancer->rebalance();
     }
-    MPI_Waitall(i, reqs, MPI_STATUSES_IGNORE);
 }
 
 /**
@@ -100,8 +125,8 @@ void NsSystem::synchronize()
  */
 void NsSystem::calcRates()
 {
-    for (auto &t : tracts) {
-        t.second->calcRates();
+    for (auto t : tracts_vec) {
+        t->calcRates();
     }
 }
 
@@ -110,8 +135,8 @@ void NsSystem::calcRates()
  */
 void NsSystem::acquire(uint numStimCycles, const char *tag)
 {
-    for (auto &t : tracts) {
-        t.second->acquire(numStimCycles, tag);
+    for (auto t : tracts_vec) {
+        t->acquire(numStimCycles, tag);
     }
 }
 
@@ -122,23 +147,29 @@ void NsSystem::acquire(uint numStimCycles, const char *tag)
  */
 void NsSystem::settle()
 {
+    NsProfileRegion region(NS_PHASE_SETTLE);
+
     for (uint c = 0; c < numSettleCycles; c++) {
-        for (auto &l : layers) {
-            if (!l.second->isFrozen) {
-                l.second->computeNewActivations();
+        for (auto l : layers_vec) {
+            if (!l->isFrozen) {
+                double startTime = MPI_Wtime();
+                l->computeNewActivations();
+                if (balancer != NULL && !l->isClamped) {
+                    balancer->addSettleCost(l, MPI_Wtime() - startTime);
+                }
             }
         }
-        for (auto &l : layers) {
-            if (!l.second->isFrozen) {
-                l.second->applyNewActivations();
+        for (auto l : layers_vec) {
+            if (!l->isFrozen) {
+                l->applyNewActivations();
             }
         }
 
         synchronize();
 
-        for (auto &l : layers) {
-            if (!l.second->isFrozen) {
-                l.second->adjustInhibition();
+        for (auto l : layers_vec) {
+            if (!l->isFrozen) {
+                l->adjustInhibition();
             }
         }
     }
@@ -171,12 +202,12 @@ void NsSystem::consolidate()
     // Activate and clamp a randomly chosen defined pattern in
     // the HPC layer
     //
-    const string &hpcPid = hpcLayer->setRandomPattern();
+    NsPatternHandle hpcPid = hpcLayer->setRandomPattern();
     hpcLayer->isClamped = true;
 
 #else
     // Randomize the HPC layer
-    const string &hpcPid = "";
+    NsPatternHandle hpcPid = noPattern;
     hpcLayer->randomize();
 #endif
 
@@ -188,8 +219,8 @@ void NsSystem::consolidate()
     
     // Learn the pattern settled into: PSD growth
     //
-    for (auto &t : tracts) {
-        t.second->consolidate(consNumStimCycles);
+    for (auto t : tracts_vec) {
+        t->consolidate(consNumStimCycles);
     }
 }
 
@@ -198,11 +229,17 @@ void NsSystem::consolidate()
  */
 void NsSystem::maintain()
 {
-    for (auto &t : tracts) {
-        t.second->maintain();
+    NsProfileRegion region(NS_PHASE_MAINTAIN);
+
+    for (auto t : tracts_vec) {
+        double startTime = MPI_Wtime();
+        t->maintain();
+        if (balancer != NULL) {
+            balancer->addMaintainCost(t, MPI_Wtime() - startTime);
+        }
     }
-    for (auto &l : layers) {
-        l.second->maintain();
+    for (auto l : layers_vec) {
+        l->maintain();
     }
 }
 
@@ -211,9 +248,9 @@ void NsSystem::maintain()
  */
 void NsSystem::clear()
 {
-    for (auto &l : layers) {
-        l.second->clear();
-        l.second->isClamped = false;
+    for (auto l : layers_vec) {
+        l->clear();
+        l->isClamped = false;
     }
 }
 
@@ -257,7 +294,8 @@ void NsSystem::retrieve(const string &cueLayerId,
     // Set and clamp the specified pattern in the cue layer
     //
     NsLayer *cueLayer = layers.at(cueLayerId);
-    cueLayer->setPattern(patternId);
+    NsPatternHandle target = findPattern(patternId);
+    cueLayer->setPattern(target);
     cueLayer->isClamped = true;
 
     printGrids(fmt::format("{}-present", condition));
@@ -265,7 +303,7 @@ void NsSystem::retrieve(const string &cueLayerId,
     // Cycle until settled
     //
     settle();
-    printGrids(fmt::format("{}-settled", condition), patternId);
+    printGrids(fmt::format("{}-settled", condition), target);
 }
 
 /**
@@ -280,8 +318,8 @@ void NsSystem::test(const string &cueLayerId, const string &patternId,
 {
     // Record inhibition levels before the test
     //
-    for (auto l : layers) {
-        l.second->saveInhibition();
+    for (auto l : layers_vec) {
+        l->saveInhibition();
     }
 
     // Do the test
@@ -291,8 +329,8 @@ void NsSystem::test(const string &cueLayerId, const string &patternId,
     // Restore inhibition levels, in order to leave the system unaffected by
     // the test.
     //
-    for (auto l : layers) {
-        l.second->restoreInhibition();
+    for (auto l : layers_vec) {
+        l->restoreInhibition();
     }
 }
 
@@ -316,8 +354,8 @@ void NsSystem::reactivate()
 
     // Execute reactivation logic in all tracts
     //
-    for (auto &t : tracts) {
-        t.second->reactivate();
+    for (auto t : tracts_vec) {
+        t->reactivate();
     }
 
     // Patterns should disappear from HPC layer's (really, any layer's)
@@ -339,60 +377,65 @@ void NsSystem::reactivate()
 }
 
 /**
- * Toggle PSI on or off in all tracts that terminate on the
+ * Toggle PSI on or off in all tracts that start or terminate on the
  * specified layer.
  */
 void NsSystem::togglePsi(string layerId, bool state)
 {
     NsLayer *layer = getLayer(layerId);
-    for (auto &t : tracts) {
-        if (t.second->fromLayer == layer || t.second->toLayer == layer) {
-            t.second->togglePsi(state);
-        }
+    for (auto t : inTracts[layer->intID]) {
+        t->togglePsi(state);
+    }
+    for (auto t : outTracts[layer->intID]) {
+        t->togglePsi(state);
     }
 }
 
 void NsSystem::printStateHdrs()
 {
-    NsConnection::printStateHdr();
-    NsUnit::printStateHdr();
     NsLayer::printScoreHdr();
     NsLayer::printNumActiveHdr();
     NsTract::printNumPotentiatedHdr();
 }
 
+/**
+ * Print layer and tract summaries, and write unit and connection state to
+ * the record file. Must be called by all ranks.
+ */
 void NsSystem::printState() const
 {
-    for (auto &l : layers) {
-        l.second->printState();
+    NsProfileRegion region(NS_PHASE_OUTPUT);
+
+    for (auto l : layers_vec) {
+        l->printState();
     }
-    for (auto &t : tracts) {
-        t.second->printState();
+    for (auto t : tracts_vec) {
+        t->printState();
     }
+    output_flush();
 }
 
-void NsSystem::printGrids(const string &tag,
-                          const string &targetId) const
+void NsSystem::printGrids(const string &tag, NsPatternHandle target) const
 {
-    for (auto &l : layers) {
-        l.second->printGrid(tag, targetId);
+    for (auto l : layers_vec) {
+        l->printGrid(tag, target);
     }
 }
 
 void NsSystem::printSize()
 {
     uint tot = 0;
-    for (auto &l : layers) {
-        uint n = l.second->units.size();
-        infoTrace("Layer {}: {} units\n", l.second->id, n);
+    for (auto l : layers_vec) {
+        uint n = l->units.size();
+        infoTrace("Layer {}: {} units\n", l->id, n);
         tot += n;
     }
     infoTrace("Total: {} units\n", tot);
 
     tot = 0;
-    for (auto &t : tracts) {
-        uint n = t.second->connections.size();
-        infoTrace("Tract {}: {} connections\n", t.second->id, n);
+    for (auto t : tracts_vec) {
+        uint n = t->connections.size();
+        infoTrace("Tract {}: {} connections\n", t->id, n);
         tot += n;
     }
     infoTrace("Total: {} connections\n", tot);
@@ -402,11 +445,11 @@ void NsSystem::printSize()
 string NsSystem::toStr(uint iLvl, const string &iStr) const
 {
     string ret = Util::repeatStr(iStr, iLvl) + "NsSystem:";
-    for (auto &l : layers) {
-        ret += "\n" + l.second->toStr(iLvl + 1, iStr);
+    for (auto l : layers_vec) {
+        ret += "\n" + l->toStr(iLvl + 1, iStr);
     }
-    for (auto &t : tracts) {
-        ret += "\n" + t.second->toStr(iLvl + 1, iStr);
+    for (auto t : tracts_vec) {
+        ret += "\n" + t->toStr(iLvl + 1, iStr);
     }
 
     return ret;
@@ -2,13 +2,14 @@
 #include "NsUnit.hh"
 #include "MathUtil.hh"
 #include "NsGlobals.hh"
+#include "NsOutput.hh"
 
 NsUnit::NsUnit(const NsLayer *layer, uint index, uint gid)
     : layer(layer), 
       id(layer->id + "." + fmt::format("{:02}", index)),
       gid(gid),
-      actFuncK(props.getDouble("actFuncK")),
-      actThreshold(props.getDouble("actThreshold")),
+      index(index),
+      params(params_unit()),
       isFrozen(false),
       isActive(&(layer->activations[index])),
       newIsActive(0),
@@ -23,10 +24,10 @@ NsUnit::NsUnit(const NsLayer *layer, uint index, uint gid)
  */
 uint8_t NsUnit::activationFunction(double netInput)
 {
-    if (netInput <= actThreshold) return 0;
+    if (netInput <= params.actThreshold) return 0;
 
     double probOfActivation =
-        MathUtil::asigmoid(netInput, actFuncK, layer->inhibition);
+        MathUtil::asigmoid(netInput, params.actFuncK, layer->inhibition);
     //infoTrace("XXX {}\n", netInput);
 
     uint8_t ret = Util::randDouble(0.0, 1.0) < probOfActivation;
@@ -93,14 +94,38 @@ void NsUnit::maintain()
 {
 }
 
-void NsUnit::printStateHdr()
+/**
+ * Snapshot of the unit's mutable state
+ */
+NsUnitState NsUnit::getState() const
 {
-    infoTrace("time unit ID ACTIVE\n");
+    NsUnitState state;
+    state.index = index;
+    state.isActive = *isActive;
+    state.newIsActive = newIsActive;
+    state.isFrozen = isFrozen;
+    state.lastNetInput = lastNetInput;
+    return state;
 }
 
+/**
+ * Restore the unit's mutable state from a snapshot
+ */
+void NsUnit::setState(const NsUnitState &state)
+{
+    *isActive = state.isActive;
+    newIsActive = state.newIsActive;
+    isFrozen = state.isFrozen;
+    lastNetInput = state.lastNetInput;
+}
+
+/**
+ * Write the unit's state to the record file
+ */
 void NsUnit::printState() const
 {
-    infoTrace("{} unit {} {}\n", simTime / 24., id, *isActive ? 'a' : 'i');
+    output_record(NS_REC_UNIT, output_name(layer->id), index, 0,
+                  *isActive);
 }
 
 string NsUnit::toStr(uint iLvl, const string &iStr) const
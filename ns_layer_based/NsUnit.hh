@@ -4,11 +4,25 @@
 #include <stdlib.h>
 #include <string>
 
+#include "NsParams.hh"
+
 using std::string;
 
 class NsLayer;
 class NsConnection;
 
+/**
+ * Mutable per-unit state, in a form that can be copied between ranks
+ * when units are redistributed.
+ */
+struct NsUnitState {
+    uint    index;
+    uint8_t isActive;
+    uint8_t newIsActive;
+    uint8_t isFrozen;
+    double  lastNetInput;
+};
+
 class NsUnit {
 public:
     NsUnit(const NsLayer *layer, uint index, uint gid);
@@ -17,15 +31,16 @@ public:
     void applyNewActivation();
     void setFrozen(bool state);
     void maintain();
-    static void printStateHdr();
     void printState() const;
     string toStr(uint iLvl = 0, const string &iStr = "   ") const;
+    NsUnitState getState() const;
+    void setState(const NsUnitState &state);
 
     const NsLayer *layer;
     const string id;
     const uint gid;
-    double actFuncK;
-    double actThreshold;
+    const uint index;
+    const NsUnitParams &params;
     bool isFrozen;
     uint8_t *isActive;
     uint8_t newIsActive;
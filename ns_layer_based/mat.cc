@@ -4,11 +4,30 @@
  *       number of rows and cols of float or int numbers, optionally with a
  *       first header row and/or first index column. Headers and indices, if
  *       present, are copied to the output without applying any operations.
+ *       The stats operation computes average, sample standard deviation
+ *       and standard error in one pass, and outputs them side by side, the
+ *       latter two with headers prefixed by S_ and E_ (and without the
+ *       index column), as tab-separated columns like those that
+ *       multi_ns used to assemble with paste and columns.
+ *
+ *       The files are memory-mapped and processed in blocks of rows: a
+ *       pool of threads parses the next block of every file, then the
+ *       block is combined across the files (in file order, so that the
+ *       results do not depend on the number of threads) and written out.
+ *       Memory use is thus bounded by one block of rows per file.
  */
 
 #include <stdlib.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <set>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 #include <fmt/format.h>
 #include "Util.hh"
@@ -34,11 +53,14 @@ void fail(string file, uint line, const char *format, const T & ... args)
 static const char *sepChars = " \t";
 static const char *prefix = "";
 static const char *suffix = "";
+static bool isSep[256];
 
 /**
  * Adorn each token in line with prefix and suffix
+ * @param skipFirst Whether to omit the first token
  */
-string adorn(string line)
+string adorn(string line, const char *prefix = ::prefix, bool skipFirst = false,
+             char sep = sepChars[0])
 {
     string errMsg;
     std::vector<string> tokens =
@@ -48,10 +70,14 @@ string adorn(string line)
     string r;
     bool first = true;
     for (auto tok : tokens) {
+        if (skipFirst) {
+            skipFirst = false;
+            continue;
+        }
         if (first) {
             first = false;
         } else {
-            r += sepChars[0];
+            r += sep;
         }
         r += prefix;
         r += tok;
@@ -61,6 +87,312 @@ string adorn(string line)
     return r;
 }
 
+static const double powersOf10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/**
+ * Convert a token to double, as std::stod does, without allocating.
+ * Plain decimal numbers with at most 19 significant digits whose value
+ * can be computed exactly (mantissa < 2^53, exponent within +-22) are
+ * converted directly; everything else is left to strtod.
+ * @param begin Start of the token
+ * @param end End of the token
+ * @param val Set to the value
+ * @return false if the token does not start with a number
+ */
+static bool parseDouble(const char *begin, const char *end, double &val)
+{
+    const char *p = begin;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p++ == '-');
+    }
+
+    uint64_t mantissa = 0;
+    uint numDigits = 0;
+    int exponent = 0;
+    bool anyDigits = false;
+    bool fast = true;
+    for (bool fraction = false; p < end; p++) {
+        if (*p == '.' && !fraction) {
+            fraction = true;
+            continue;
+        }
+        if (*p < '0' || *p > '9') break;
+        anyDigits = true;
+        if (mantissa != 0 || *p != '0') {
+            if (++numDigits > 19) {
+                fast = false;
+                break;
+            }
+            mantissa = mantissa * 10 + (*p - '0');
+        }
+        if (fraction) {
+            exponent--;
+        }
+    }
+    if (fast && anyDigits && p < end && (*p == 'e' || *p == 'E')) {
+        const char *q = p + 1;
+        bool negativeExp = false;
+        if (q < end && (*q == '-' || *q == '+')) {
+            negativeExp = (*q++ == '-');
+        }
+        int exp = 0;
+        const char *digits = q;
+        for (; q < end && *q >= '0' && *q <= '9' && exp < 10000; q++) {
+            exp = exp * 10 + (*q - '0');
+        }
+        if (q > digits) {
+            exponent += negativeExp ? -exp : exp;
+            p = q;
+        }
+    }
+
+    if (fast && anyDigits && p == end && mantissa < (1ULL << 53)) {
+        if (mantissa == 0) {
+            val = negative ? -0.0 : 0.0;
+            return true;
+        }
+        if (exponent >= -22 && exponent <= 22) {
+            val = (exponent < 0) ? mantissa / powersOf10[-exponent]
+                                 : mantissa * powersOf10[exponent];
+            if (negative) val = -val;
+            return true;
+        }
+    }
+
+    // Let strtod handle it (and the partial conversions std::stod accepts)
+    //
+    char buf[64];
+    string longToken;
+    size_t len = end - begin;
+    const char *str = buf;
+    if (len < sizeof(buf)) {
+        memcpy(buf, begin, len);
+        buf[len] = '\0';
+    } else {
+        longToken.assign(begin, len);
+        str = longToken.c_str();
+    }
+    char *endPtr;
+    errno = 0;
+    val = strtod(str, &endPtr);
+    return endPtr != str && errno != ERANGE;
+}
+
+/**
+ * An input file, memory-mapped, and the rows of it that have been parsed
+ * for the current block
+ */
+struct MatInput {
+    MatInput(const char *fname)
+        : fname(fname)
+    {
+        int fd = open(fname, O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            perror(fname);
+            exit(1);
+        }
+        size = st.st_size;
+        data = NULL;
+        if (size > 0) {
+            data = (const char *) mmap(NULL, size, PROT_READ, MAP_PRIVATE,
+                                       fd, 0);
+            if (data == MAP_FAILED) {
+                perror(fname);
+                exit(1);
+            }
+            madvise((void *) data, size, MADV_SEQUENTIAL);
+        }
+        close(fd);
+        pos = data;
+        end = data + size;
+    }
+
+    ~MatInput()
+    {
+        if (size > 0) {
+            munmap((void *) data, size);
+        }
+    }
+
+    /**
+     * Get the next line, without its newline
+     * @return false at the end of the file
+     */
+    bool nextLine(const char *&lineBegin, const char *&lineEnd)
+    {
+        if (pos >= end) return false;
+        lineBegin = pos;
+        lineEnd = (const char *) memchr(pos, '\n', end - pos);
+        if (lineEnd == NULL) {
+            lineEnd = end;
+        }
+        pos = lineEnd + 1;
+        lineNum++;
+        return true;
+    }
+
+    /**
+     * Count the remaining lines
+     */
+    uint countLines()
+    {
+        const char *b, *e;
+        uint n = 0;
+        while (nextLine(b, e)) {
+            n++;
+        }
+        return n;
+    }
+
+    string fname;
+    const char *data;
+    const char *pos;
+    const char *end;
+    size_t size;
+    uint lineNum = 0;
+
+    vector<double> rows;    // numRows * nCols values of the current block
+    uint numRows = 0;       // in the current block
+    uint totalRows = 0;     // including the current block
+    bool atEnd = false;
+    string error;           // set if parsing failed
+};
+
+static uint nCols = 0;
+static uint blockRows = 256;
+
+/**
+ * Parse the next block of rows of an input. Errors are recorded in the
+ * input rather than reported, so that they can be reported in file order.
+ */
+static void parseBlock(MatInput &in)
+{
+    in.numRows = 0;
+    if (!in.error.empty()) return;
+    in.rows.resize((size_t) blockRows * nCols);
+
+    const char *lineBegin, *lineEnd;
+    while (in.numRows < blockRows) {
+        if (!in.nextLine(lineBegin, lineEnd)) {
+            in.atEnd = true;
+            return;
+        }
+        double *row = in.rows.data() + (size_t) in.numRows * nCols;
+        uint numTokens = 0;
+        const char *p = lineBegin;
+        for (;;) {
+            while (p < lineEnd && isSep[(uint8_t) *p]) p++;
+            if (p == lineEnd) break;
+            const char *tok = p;
+            while (p < lineEnd && !isSep[(uint8_t) *p]) p++;
+            if (numTokens < nCols && !parseDouble(tok, p, row[numTokens])) {
+                in.error = fmt::format("File {}, line {}: Bad double [{}]",
+                                       in.fname, in.lineNum,
+                                       string(tok, p - tok));
+                return;
+            }
+            numTokens++;
+        }
+        if (numTokens == 0) {
+            in.error = fmt::format("File {}, line {}: empty line",
+                                   in.fname, in.lineNum);
+            return;
+        }
+        if (numTokens != nCols) {
+            in.error = fmt::format(
+                "File {}, line {}: Expected {} tokens, found {}",
+                in.fname, in.lineNum, nCols, numTokens);
+            return;
+        }
+        in.numRows++;
+        in.totalRows++;
+    }
+}
+
+/**
+ * Threads that parse the blocks of a share of the inputs: thread t
+ * parses inputs t, t + numThreads, ...
+ */
+class ParserPool {
+public:
+    ParserPool(vector<MatInput *> &inputs, uint numThreads)
+        : inputs(inputs), numThreads(numThreads)
+    {
+        for (uint t = 1; t < numThreads; t++) {
+            threads.push_back(std::thread(&ParserPool::work, this, t));
+        }
+    }
+
+    ~ParserPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        start.notify_all();
+        for (auto &t : threads) {
+            t.join();
+        }
+    }
+
+    /**
+     * Parse the next block of all inputs
+     */
+    void parseBlocks()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            generation++;
+            numBusy = numThreads - 1;
+        }
+        start.notify_all();
+        parseShare(0);
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return numBusy == 0; });
+    }
+
+private:
+    void parseShare(uint t)
+    {
+        for (uint i = t; i < inputs.size(); i += numThreads) {
+            parseBlock(*inputs[i]);
+        }
+    }
+
+    void work(uint t)
+    {
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                start.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            parseShare(t);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                numBusy--;
+            }
+            done.notify_one();
+        }
+    }
+
+    vector<MatInput *> &inputs;
+    uint numThreads;
+    vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable start;
+    std::condition_variable done;
+    uint64_t generation = 0;
+    uint numBusy = 0;
+    bool stopping = false;
+};
 
 int main(int argc, char *argv[])
 {
@@ -69,6 +401,7 @@ int main(int argc, char *argv[])
     bool hasHdr = false;
     bool chkHdr = false;
     bool hasIndex = false;
+    uint numThreads = std::max(std::thread::hardware_concurrency(), 1u);
 
     // Process command line args
     //
@@ -79,24 +412,26 @@ int main(int argc, char *argv[])
         {"sep",     Util::OPTARG_STR,  &sepChars, "separator_chars", ""},
         {"prefix",  Util::OPTARG_STR,  &prefix,   "output_header_prefix", ""},
         {"suffix",  Util::OPTARG_STR,  &suffix,   "output_header_suffix", ""},
+        {"threads", Util::OPTARG_UINT, &numThreads, "num_threads",
+         "default: number of cores"},
+        {"block",   Util::OPTARG_UINT, &blockRows, "rows",
+         "rows per file processed at a time; default: 256"},
         {"help",    Util::OPTARG_NONE, &help,     "", ""     }};
 
     std::vector<string> nonFlags =
-        { "{add|sub|mul|div|min|max|avg|stdevp|stdevs|sterr} <file> ..." };
+        { "{add|sub|mul|div|min|max|avg|stdevp|stdevs|sterr|stats} <file> ..." };
     if (Util::parseOpts(argc, argv, optSpecs) != 0 ||
-        optind > argc - 2 || help)
+        optind > argc - 2 || help || numThreads == 0 || blockRows == 0)
     {
         Util::usage(
             parseOptsUsage(pname, optSpecs, true, nonFlags).c_str(), NULL);
         exit(EXIT_FAILURE);
     }
 
-    uint nCols = 0;
-    uint nRows = 0;
-
     // The first non-flag arg is the operation
     string opStr = argv[optind++];
     Util::Operation op;
+    bool stats = false;
     if      (Util::strCiEq(opStr, "ADD"))    { op = Util::ADD; }
     else if (Util::strCiEq(opStr, "SUB"))    { op = Util::SUB; }
     else if (Util::strCiEq(opStr, "MUL"))    { op = Util::MUL; }
@@ -107,182 +442,216 @@ int main(int argc, char *argv[])
     else if (Util::strCiEq(opStr, "STDEVP")) { op = Util::STDEVP; }
     else if (Util::strCiEq(opStr, "STDEVS")) { op = Util::STDEVS; }
     else if (Util::strCiEq(opStr, "STERR"))  { op = Util::STERR; }
+    else if (Util::strCiEq(opStr, "STATS"))  { op = Util::STDEVS; stats = true; }
     else {
         Util::usage(
             parseOptsUsage(pname, optSpecs, false, nonFlags).c_str(), NULL);
         exit(EXIT_FAILURE);
     }
+    bool squares = (op == Util::STDEVP || op == Util::STDEVS ||
+                    op == Util::STERR);
 
-    // The remaining args are file names. Process them one by one
-    // and build the result matrix as we go. For STDEV and STDERR,
-    // also build sqsum on the fly.
-
-    uint numFiles = argc - optind;
-    string firstFile;
-    string hdr;
+    for (const char *p = sepChars; *p != '\0'; p++) {
+        isSep[(uint8_t) *p] = true;
+    }
 
-    vector<vector<double>> firstMat;
-    vector<vector<double>> result;
-    vector<vector<double>> sqsum;
+    // The remaining args are file names. Map them, and read their
+    // headers.
 
+    vector<MatInput *> inputs;
     while (optind < argc) {
-        const char *fname = argv[optind++];
-        if (firstFile.empty()) {
-            firstFile = fname;
-        }
-        FILE *fp = fopen(fname, "r");
-        if (fp == NULL) {
-            perror(fname);
-            return 1;
-        }
+        inputs.push_back(new MatInput(argv[optind++]));
+    }
+    uint numFiles = inputs.size();
+    MatInput &first = *inputs[0];
 
-        vector<vector<double>> mat;
-
-        uint lineNum = 0;
-        char line[1024];
-
-        // Read a matrix of doubles from the file
-
-        while ((fgets(line, sizeof(line), fp) != NULL)) {
-            Util::chop(line);
-            if (++lineNum == 1) {
-                if (hasHdr) {
-                    // This is a header line
-                    if (hdr.empty()) {
-                        hdr = line;
-                        fmt::print("{}\n", adorn(hdr));
-                    } else {
-                        ABORT_IF(chkHdr && (hdr != line),
-                                 "%s and %s have different headers",
-                                 firstFile.c_str(), fname);
-                    }
-                    continue;
+    const char *lineBegin, *lineEnd;
+    if (hasHdr) {
+        string hdr;
+        for (auto in : inputs) {
+            if (!in->nextLine(lineBegin, lineEnd)) continue;
+            string line(lineBegin, lineEnd);
+            if (in == &first) {
+                hdr = line;
+                if (stats) {
+                    fmt::print("{}\t{}\t{}\n", adorn(hdr, "", false, '\t'),
+                               adorn(hdr, "S_", hasIndex, '\t'),
+                               adorn(hdr, "E_", hasIndex, '\t'));
+                } else {
+                    fmt::print("{}\n", adorn(hdr));
                 }
+            } else {
+                ABORT_IF(chkHdr && (hdr != line),
+                         "%s and %s have different headers",
+                         first.fname.c_str(), in->fname.c_str());
             }
-            string errMsg;
-            std::vector<string> tokens =
-                Util::tokenize(line, sepChars, errMsg);
-            if (!errMsg.empty()) {
-                fail(fname, lineNum, "{}", errMsg);
-            }
+        }
+    }
+
+    // The number of columns is that of the first row of the first file
+    //
+    const char *firstPos = first.pos;
+    uint firstLineNum = first.lineNum;
+    if (first.nextLine(lineBegin, lineEnd)) {
+        for (const char *p = lineBegin; p < lineEnd; ) {
+            while (p < lineEnd && isSep[(uint8_t) *p]) p++;
+            if (p == lineEnd) break;
+            while (p < lineEnd && !isSep[(uint8_t) *p]) p++;
+            nCols++;
+        }
+    }
+    first.pos = firstPos;
+    first.lineNum = firstLineNum;
+
+    // Process the files a block of rows at a time, combining each
+    // block's rows across the files in file order. For STDEV and
+    // STDERR, also build sqsum on the fly.
+
+    ParserPool pool(inputs, std::min(numThreads, numFiles));
+    double bessel = (numFiles > 1) ? 1. * numFiles / (numFiles - 1) : 1.;
+    uint firstCol = hasIndex ? 1 : 0;
+
+    vector<double> result(nCols);
+    vector<double> sqsum(nCols);
+    vector<double> stdev(nCols);
+    fmt::memory_buffer out;
 
-            if (tokens.size() == 0) {
-                fail(fname, lineNum, "empty line", errMsg);
+    for (;;) {
+        pool.parseBlocks();
+
+        // Report errors and row count mismatches in file order
+        //
+        for (auto in : inputs) {
+            if (!in->error.empty()) {
+                fmt::print(stderr, "{}\n", in->error);
+                exit(1);
+            }
+        }
+        for (auto in : inputs) {
+            if (in->numRows != first.numRows) {
+                uint nRows = first.totalRows + first.countLines();
+                uint found = in->totalRows + in->countLines();
+                fail(in->fname, in->lineNum, "Expected {} rows, found {}",
+                     nRows, found);
             }
+        }
+        if (first.numRows == 0) break;
 
-            if (nCols == 0) {
-                nCols = tokens.size();
-            } else if (tokens.size() != nCols) {
-                fail(fname, lineNum, "Expected {} tokens, found {}",
-                     nCols, tokens.size());
+        for (uint r = 0; r < first.numRows; r++) {
+            const double *firstRow = first.rows.data() + (size_t) r * nCols;
+            std::copy(firstRow, firstRow + nCols, result.begin());
+            for (uint c = 0; c < nCols; c++) {
+                sqsum[c] = firstRow[c] * firstRow[c];
             }
 
-            vector<double> row;
-            for (auto tok : tokens) {
-            
-                size_t sz;
-                try {
-                    row.push_back(std::stod(tok, &sz));
-                } catch (std::invalid_argument &) {
-                    fail(fname, lineNum, "Bad double [{}]", tok);
+            for (uint i = 1; i < numFiles; i++) {
+                const MatInput &in = *inputs[i];
+                const double *row = in.rows.data() + (size_t) r * nCols;
+                if (hasIndex && row[0] != firstRow[0]) {
+                    uint rowNum = in.totalRows - in.numRows + r;
+                    fail(in.fname, hasHdr ? rowNum + 2 : rowNum + 1,
+                         "Index differs from file {}", first.fname);
+                }
+                if (squares) {
+                    for (uint c = 0; c < nCols; c++) {
+                        sqsum[c] = sqsum[c] + row[c] * row[c];
+                    }
+                }
+                for (uint c = 0; c < nCols; c++) {
+                    double &res = result[c];
+                    switch (op) {
+                    case Util::STDEVP:
+                    case Util::STDEVS:
+                    case Util::STERR:
+                    case Util::ADD:
+                    case Util::AVG: res = res + row[c]; break;
+                    case Util::SUB: res = res - row[c]; break;
+                    case Util::MUL: res = res * row[c]; break;
+                    case Util::DIV: res = res / row[c]; break;
+                    case Util::MIN: res = Util::min(res, row[c]); break;
+                    case Util::MAX: res = Util::max(res, row[c]); break;
+                    default:
+                        TRACE_FATAL("Bad operation");
+                    }
                 }
-            }
-            mat.push_back(row);
-        }
-    
-        fclose(fp);
-
-        if (nRows == 0) {
-            // First file read
-            nRows = mat.size();
-            result = mat;
-            firstMat = mat;
-            sqsum = Util::matrixSquare(mat);
-        } else {
-            if (mat.size() != nRows) {
-                fail(fname, lineNum, "Expected {} rows, found {}",
-                     nRows, mat.size());
             }
 
-            if (hasIndex) {
-                for (uint r = 0; r < nRows; r++) {
-                    if (mat[r][0] != firstMat[r][0]) {
-                        fail(fname, hasHdr ? r+2 : r+1, "Index differs from file {}", firstFile);
+            if (stats) {
+                // Average, sample standard deviation and standard error,
+                // side by side, the latter two without the index column
+                //
+                uint numStdev = 0;
+                for (uint c = 0; c < nCols; c++) {
+                    double avg = result[c] / numFiles;
+                    double var = std::max(sqsum[c] / numFiles - avg * avg, 0.);
+                    result[c] = avg;
+                    if (c >= firstCol) {
+                        stdev[numStdev++] = sqrt(var * bessel);
                     }
                 }
+                if (hasIndex) {
+                    result[0] = firstRow[0];
+                }
+                for (uint c = 0; c < nCols; c++) {
+                    fmt::format_to(out, "{}{:.2f}", c == 0 ? "" : "\t",
+                                   result[c]);
+                }
+                for (uint c = 0; c < numStdev; c++) {
+                    fmt::format_to(out, "\t{:.2f}", stdev[c]);
+                }
+                for (uint c = 0; c < numStdev; c++) {
+                    fmt::format_to(out, "\t{:.2f}", stdev[c] / sqrt(numFiles));
+                }
+                fmt::format_to(out, "\n");
+                continue;
             }
-            
+
             switch (op) {
-                case Util::STDEVP:
-                case Util::STDEVS:
-                case Util::STERR:
-                    sqsum = Util::matrixAdd(sqsum, Util::matrixSquare(mat));
-                    // fall thru
-                case Util::ADD:
-                case Util::AVG:
-                    result = Util::matrixAdd(result, mat);
-                    break;
-                case Util::SUB:
-                    result = Util::matrixSub(result, mat);
-                    break;
-                case Util::MUL:
-                    result = Util::matrixMul(result, mat);
-                    break;
-                case Util::DIV:
-                    result = Util::matrixDiv(result, mat);
-                    break;
-                case Util::MIN:
-                    result = Util::matrixMin(result, mat);
-                    break;
-                case Util::MAX:
-                    result = Util::matrixMax(result, mat);
-                    break;
-                default:
-                    TRACE_FATAL("Bad operation");
-            }
-        }
-    }
-    switch (op) {
-        case Util::AVG:
-            for (auto &row : result) {
-                for (auto &elem : row) {
+            case Util::AVG:
+                for (auto &elem : result) {
                     elem /= numFiles;
                 }
-            }
-            break;
-        case Util::STDEVP:
-        case Util::STDEVS:
-        case Util::STERR:
-            // For standard deviation or error, calculate the standard
-            // deviation of the sample
-            for (uint r = 0; r < nRows; r++) {
+                break;
+            case Util::STDEVP:
+            case Util::STDEVS:
+            case Util::STERR:
+                // For standard deviation or error, calculate the standard
+                // deviation of the sample
                 for (uint c = 0; c < nCols; c++) {
                     // stdev = sqrt(sum-of-squares/n - (square-of-sum/n)^2)
-                    result[r][c] = sqrt(sqsum[r][c] / numFiles -
-                                        pow((result[r][c] / numFiles), 2.0));
+                    result[c] = sqrt(sqsum[c] / numFiles -
+                                     pow((result[c] / numFiles), 2.0));
+                    // For sample statistics, apply Bessel's correction
+                    if ((numFiles > 1) &&
+                        (op == Util::STDEVS || op == Util::STERR))
+                    {
+                        result[c] = result[c] * sqrt(1. * numFiles/(numFiles - 1));
+                    }
+                    // For standard error, divide by sqrt of sample size
+                    if (op == Util::STERR) {
+                        result[c] = result[c] / sqrt(numFiles);
+                    }
                 }
+                break;
+            default:
+                // no special processing
+                ;
             }
-            // For sample statistics, apply Bessel's correction
-            if ((numFiles > 1) && (op == Util::STDEVS || op == Util::STERR)) {
-                result = Util::matrixMul(
-                    result, sqrt(1. * numFiles/(numFiles - 1)));
+
+            if (hasIndex) {
+                result[0] = firstRow[0];
             }
-            // For standard error, divide by sqrt of sample size
-            if (op == Util::STERR) {
-                result = Util::matrixDiv(result, sqrt(numFiles));
+            for (uint c = 0; c < nCols; c++) {
+                fmt::format_to(out, "{:8.2f}", result[c]);
             }
-            break;
-        default:
-            // no special processing
-            ;
-    }
-
-    if (hasIndex) {
-        for (uint r = 0; r < nRows; r++) {
-            result[r][0] = firstMat[r][0];
+            fmt::format_to(out, "\n");
         }
-    }        
 
-    fmt::print(Util::matrixToStr(result));
-}
+        fwrite(out.data(), 1, out.size(), stdout);
+        out.clear();
+    }
 
+    for (auto in : inputs) {
+        delete in;
+    }
+}
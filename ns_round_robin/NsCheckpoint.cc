@@ -0,0 +1,471 @@
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <map>
+#include <mpi.h>
+
+#include "Sched.hh"
+
+#include "NsCheckpoint.hh"
+#include "NsSystem.hh"
+#include "NsGlobals.hh"
+
+/**
+ * Serializes the checkpoint metadata
+ */
+class MetaWriter {
+public:
+    template<class T> void put(const T &val)
+    {
+        const char *p = (const char *) &val;
+        buf.insert(buf.end(), p, p + sizeof(T));
+    }
+
+    void putString(const string &s)
+    {
+        put<uint32_t>(s.size());
+        buf.insert(buf.end(), s.begin(), s.end());
+    }
+
+    vector<char> buf;
+};
+
+/**
+ * Deserializes the checkpoint metadata
+ */
+class MetaReader {
+public:
+    MetaReader(const char *begin, const char *end) : p(begin), end(end) {}
+
+    template<class T> T get()
+    {
+        T val;
+        ABORT_IF(p + sizeof(T) > end, "Truncated checkpoint metadata");
+        memcpy(&val, p, sizeof(T));
+        p += sizeof(T);
+        return val;
+    }
+
+    string getString()
+    {
+        uint32_t n = get<uint32_t>();
+        ABORT_IF(p + n > end, "Truncated checkpoint metadata");
+        string s(p, n);
+        p += n;
+        return s;
+    }
+
+private:
+    const char *p;
+    const char *end;
+};
+
+/**
+ * Layers and tracts in checkpoint order, i.e. ordered by ID
+ */
+static std::map<string, NsLayer *> sortedLayers(NsSystem *system)
+{
+    return std::map<string, NsLayer *>(system->layers.begin(),
+                                       system->layers.end());
+}
+
+static std::map<string, NsTract *> sortedTracts(NsSystem *system)
+{
+    return std::map<string, NsTract *>(system->tracts.begin(),
+                                       system->tracts.end());
+}
+
+/**
+ * Index of each layer's first unit, and of each tract's first connection,
+ * in the checkpoint
+ */
+static std::map<string, uint64_t> unitOffsets(NsSystem *system,
+                                              uint64_t &numUnits)
+{
+    std::map<string, uint64_t> offsets;
+    numUnits = 0;
+    for (auto &le : sortedLayers(system)) {
+        offsets[le.first] = numUnits;
+        numUnits += le.second->num_units;
+    }
+    return offsets;
+}
+
+static std::map<string, uint64_t> connectionOffsets(NsSystem *system,
+                                                    uint64_t &numConnections)
+{
+    std::map<string, uint64_t> offsets;
+    numConnections = 0;
+    for (auto &te : sortedTracts(system)) {
+        offsets[te.first] = numConnections;
+        numConnections += (uint64_t) te.second->fromLayer->num_units *
+            te.second->toLayer->num_units;
+    }
+    return offsets;
+}
+
+/**
+ * A unit or connection record of this rank, and where it goes in the file
+ */
+struct Block {
+    MPI_Aint offset;
+    const void *data;
+    int size;
+};
+
+/**
+ * Write a checkpoint of the system to a file. Must be called by all
+ * ranks. Rank 0 writes the header and the metadata, every rank writes the
+ * state of the units it owns and of their inbound connections, all
+ * through MPI-IO. The checkpoint is written to a temporary file first,
+ * which replaces the file at path only when complete, so that an
+ * interrupted write leaves the previous checkpoint intact.
+ * @param system The system
+ * @param path Checkpoint file path
+ * @param lastEventTime Time of the last event processing
+ */
+void checkpoint_write(NsSystem *system, const string &path,
+                      double lastEventTime)
+{
+    NsCheckpointHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, "NSCP", 4);
+    hdr.version = checkpointVersion;
+    hdr.numReplicates = 1;
+    hdr.numRanks = size;
+    hdr.simTime = simTime;
+    hdr.timeStep = timeStep;
+    auto unitOffset = unitOffsets(system, hdr.numUnits);
+    auto connOffset = connectionOffsets(system, hdr.numConnections);
+    MPI_Aint unitsBase = sizeof(hdr);
+    MPI_Aint connsBase = unitsBase + hdr.numUnits * sizeof(NsCheckpointUnit);
+    hdr.metaOffset = connsBase +
+        hdr.numConnections * sizeof(NsCheckpointConnection);
+
+    // This rank's unit and connection records
+    //
+    vector<NsCheckpointUnit> units;
+    vector<NsCheckpointConnection> conns;
+    for (auto &le : sortedLayers(system)) {
+        for (auto u : le.second->units) {
+            NsCheckpointUnit cu;
+            memset(&cu, 0, sizeof(cu));
+            cu.lastNetInput = u->lastNetInput;
+            cu.isActive = *u->isActive;
+            cu.newIsActive = u->newIsActive;
+            units.push_back(cu);
+        }
+    }
+    for (auto &te : sortedTracts(system)) {
+        for (auto c : te.second->connections) {
+            NsConnectionState state = c->getState();
+            NsCheckpointConnection cc;
+            memset(&cc, 0, sizeof(cc));
+            cc.psdSize = state.psdSize;
+            cc.numCiAmpars = state.numCiAmpars;
+            cc.numCpAmpars = state.numCpAmpars;
+            cc.isPotentiated = state.isPotentiated;
+            cc.psiIsOn = state.psiIsOn;
+            conns.push_back(cc);
+        }
+    }
+
+    vector<Block> blocks;
+    uint ui = 0;
+    for (auto &le : sortedLayers(system)) {
+        for (auto u : le.second->units) {
+            uint64_t index = unitOffset[le.first] +
+                (u->gid - le.second->global_displacement);
+            blocks.push_back({
+                (MPI_Aint) (unitsBase + index * sizeof(NsCheckpointUnit)),
+                &units[ui++], sizeof(NsCheckpointUnit)});
+        }
+    }
+    uint ci = 0;
+    for (auto &te : sortedTracts(system)) {
+        NsTract *t = te.second;
+        for (auto c : t->connections) {
+            uint64_t index = connOffset[te.first] +
+                (uint64_t) (c->fromUnit - t->fromLayer->global_displacement) *
+                t->toLayer->num_units +
+                (c->toUnit->gid - t->toLayer->global_displacement);
+            blocks.push_back({
+                (MPI_Aint) (connsBase +
+                            index * sizeof(NsCheckpointConnection)),
+                &conns[ci++], sizeof(NsCheckpointConnection)});
+        }
+    }
+    std::sort(blocks.begin(), blocks.end(),
+              [](const Block &a, const Block &b) {
+                  return a.offset < b.offset;
+              });
+
+    // Pack the records in file order, and describe their places in the
+    // file as an indexed type, in chunks of the size of a unit record
+    // (the connection record is twice as large)
+    //
+    const int chunk = sizeof(NsCheckpointUnit);
+    vector<char> buf;
+    buf.reserve(units.size() * sizeof(NsCheckpointUnit) +
+                conns.size() * sizeof(NsCheckpointConnection));
+    vector<int> lengths;
+    vector<MPI_Aint> displs;
+    for (auto &b : blocks) {
+        const char *p = (const char *) b.data;
+        buf.insert(buf.end(), p, p + b.size);
+        lengths.push_back(b.size / chunk);
+        displs.push_back(b.offset);
+    }
+    MPI_Datatype chunkType, fileType;
+    MPI_Type_contiguous(chunk, MPI_BYTE, &chunkType);
+    MPI_Type_commit(&chunkType);
+    MPI_Type_create_hindexed(blocks.size(), lengths.data(), displs.data(),
+                             chunkType, &fileType);
+    MPI_Type_commit(&fileType);
+
+    // Rank 0 gathers the metadata; the random states of all ranks
+    // are included
+    //
+    string randState = Util::getRandState();
+    vector<char> allRandStates(rank == 0 ? randState.size() * size : 0);
+    MPI_Gather(randState.data(), randState.size(), MPI_BYTE,
+               allRandStates.data(), randState.size(), MPI_BYTE, 0,
+               sim_comm);
+
+    MetaWriter meta;
+    if (rank == 0) {
+        auto layers = sortedLayers(system);
+        meta.put<uint32_t>(layers.size());
+        for (auto &le : layers) {
+            NsLayer *l = le.second;
+            meta.putString(l->id);
+            meta.put<uint32_t>(l->num_units);
+            meta.put<uint64_t>(unitOffset[l->id]);
+            meta.put<uint8_t>(l->isFrozen);
+            meta.put<uint8_t>(l->isLesioned);
+            meta.put<uint32_t>(l->nextPatternUnit);
+            meta.put<double>(l->inhibition);
+            meta.put<uint32_t>(l->definedPatternHandles.size());
+            for (auto h : l->definedPatternHandles) {
+                const ArenaArray<uint> &pat = l->definedPatterns[h].units;
+                meta.putString(patternId(h));
+                meta.put<uint32_t>(pat.size());
+                for (auto i : pat) {
+                    meta.put<uint32_t>(i);
+                }
+            }
+        }
+
+        auto tracts = sortedTracts(system);
+        meta.put<uint32_t>(tracts.size());
+        for (auto &te : tracts) {
+            meta.putString(te.first);
+            meta.put<uint64_t>(connOffset[te.first]);
+            meta.put<double>(te.second->e3Level);
+        }
+
+        meta.put<double>(lastEventTime);
+        vector<double> eventTimes = Sched::getEventTimes();
+        meta.put<uint32_t>(eventTimes.size());
+        for (auto t : eventTimes) {
+            meta.put<double>(t);
+        }
+        meta.put<uint32_t>(size);
+        for (int r = 0; r < size; r++) {
+            meta.putString(string(&allRandStates[r * randState.size()],
+                                  randState.size()));
+        }
+        hdr.metaSize = meta.buf.size();
+    }
+
+    string tmpPath = path + ".tmp";
+    MPI_File fh;
+    int err = MPI_File_open(sim_comm, tmpPath.c_str(),
+                            MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                            MPI_INFO_NULL, &fh);
+    ABORT_IF(err != MPI_SUCCESS, "Cannot create {}", tmpPath);
+    MPI_File_set_size(fh, 0);
+    if (rank == 0) {
+        MPI_File_write_at(fh, 0, &hdr, sizeof(hdr), MPI_BYTE,
+                          MPI_STATUS_IGNORE);
+        MPI_File_write_at(fh, hdr.metaOffset, meta.buf.data(),
+                          meta.buf.size(), MPI_BYTE, MPI_STATUS_IGNORE);
+    }
+    MPI_File_set_view(fh, 0, chunkType, fileType, "native", MPI_INFO_NULL);
+    MPI_File_write_all(fh, buf.data(), buf.size() / chunk, chunkType,
+                       MPI_STATUS_IGNORE);
+    MPI_File_sync(fh);
+    MPI_File_close(&fh);
+    MPI_Type_free(&fileType);
+    MPI_Type_free(&chunkType);
+
+    if (rank == 0) {
+        ABORT_IF(rename(tmpPath.c_str(), path.c_str()) != 0,
+                 "Cannot rename {} to {}", tmpPath, path);
+    }
+    MPI_Barrier(sim_comm);
+
+    TRACE_INFO("Checkpoint at simTime {} written to {}", simTime, path);
+}
+
+/**
+ * Restore the system from a checkpoint. Must be called by all ranks. The
+ * system must have been built from the same props, and its events
+ * scheduled, but not yet run. Every rank maps the file and picks the
+ * state of the units it owns and of their inbound connections, so the
+ * checkpoint may have been written by a different number of ranks.
+ * @param system The system
+ * @param path Checkpoint file path
+ */
+void checkpoint_read(NsSystem *system, const string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    ABORT_IF(fd < 0, "Cannot open {}", path);
+    struct stat st;
+    ABORT_IF(fstat(fd, &st) != 0, "Cannot stat {}", path);
+    size_t fileSize = st.st_size;
+    ABORT_IF(fileSize < sizeof(NsCheckpointHeader),
+             "{} is not a checkpoint", path);
+    const char *base = (const char *) mmap(NULL, fileSize, PROT_READ,
+                                           MAP_PRIVATE, fd, 0);
+    ABORT_IF(base == MAP_FAILED, "Cannot map {}", path);
+    close(fd);
+
+    const NsCheckpointHeader *hdr = (const NsCheckpointHeader *) base;
+    ABORT_IF(memcmp(hdr->magic, "NSCP", 4) != 0,
+             "{} is not a checkpoint", path);
+    ABORT_IF(hdr->version != checkpointVersion,
+             "{}: unsupported checkpoint version {}", path, hdr->version);
+    ABORT_IF(hdr->numReplicates != 1,
+             "{} has {} replicates, expected 1", path, hdr->numReplicates);
+    ABORT_IF(hdr->metaOffset + hdr->metaSize > fileSize,
+             "{} is truncated", path);
+
+    const NsCheckpointUnit *units = (const NsCheckpointUnit *)
+        (base + sizeof(NsCheckpointHeader));
+    const NsCheckpointConnection *conns = (const NsCheckpointConnection *)
+        (units + hdr->numUnits);
+    MetaReader meta(base + hdr->metaOffset,
+                    base + hdr->metaOffset + hdr->metaSize);
+
+    simTime = hdr->simTime;
+    timeStep = hdr->timeStep;
+
+    // Layers and units. Every rank holds all activations; with shared
+    // activations, one rank per node writes them.
+    //
+    uint32_t numLayers = meta.get<uint32_t>();
+    ABORT_IF(numLayers != system->layers.size(),
+             "{} has {} layers, expected {}",
+             path, numLayers, system->layers.size());
+    for (uint32_t li = 0; li < numLayers; li++) {
+        string id = meta.getString();
+        ABORT_IF(system->layers.count(id) == 0, "{}: unknown layer {}",
+                 path, id);
+        NsLayer *l = system->getLayer(id);
+        uint32_t numUnits = meta.get<uint32_t>();
+        uint64_t firstUnit = meta.get<uint64_t>();
+        ABORT_IF(numUnits != l->num_units,
+                 "{}: layer {} has {} units, expected {}",
+                 path, id, numUnits, l->num_units);
+
+        l->isFrozen = meta.get<uint8_t>();
+        l->isLesioned = meta.get<uint8_t>();
+        l->nextPatternUnit = meta.get<uint32_t>();
+        l->inhibition = meta.get<double>();
+        l->clearPatterns();
+        uint32_t numPatterns = meta.get<uint32_t>();
+        for (uint32_t pi = 0; pi < numPatterns; pi++) {
+            string pid = meta.getString();
+            NsPattern pat(meta.get<uint32_t>());
+            for (auto &i : pat) {
+                i = meta.get<uint32_t>();
+            }
+            l->definePattern(registerPattern(pid), pat);
+        }
+
+        const NsCheckpointUnit *cu = units + firstUnit;
+        if (writes_global_activations()) {
+            for (uint i = 0; i < l->num_units; i++) {
+                global_activations[l->global_displacement + i] =
+                    cu[i].isActive;
+            }
+        }
+        for (auto u : l->units) {
+            const NsCheckpointUnit &s =
+                cu[u->gid - l->global_displacement];
+            u->isFrozen = l->isFrozen;
+            u->newIsActive = s.newIsActive;
+            u->lastNetInput = s.lastNetInput;
+        }
+    }
+    fence_global_activations();
+
+    // Tracts and connections
+    //
+    uint32_t numTracts = meta.get<uint32_t>();
+    ABORT_IF(numTracts != system->tracts.size(),
+             "{} has {} tracts, expected {}",
+             path, numTracts, system->tracts.size());
+    for (uint32_t ti = 0; ti < numTracts; ti++) {
+        string id = meta.getString();
+        ABORT_IF(system->tracts.count(id) == 0, "{}: unknown tract {}",
+                 path, id);
+        NsTract *t = system->getTract(id);
+        uint64_t firstConnection = meta.get<uint64_t>();
+        t->e3Level = meta.get<double>();
+        t->lastE3Level = DBL_MAX;
+
+        for (auto c : t->connections) {
+            const NsCheckpointConnection &cc = conns[firstConnection +
+                (uint64_t) (c->fromUnit - t->fromLayer->global_displacement) *
+                t->toLayer->num_units +
+                (c->toUnit->gid - t->toLayer->global_displacement)];
+            NsConnectionState state;
+            state.psdSize = cc.psdSize;
+            state.numCiAmpars = cc.numCiAmpars;
+            state.numCpAmpars = cc.numCpAmpars;
+            state.isPotentiated = cc.isPotentiated;
+            state.psiIsOn = cc.psiIsOn;
+            c->setState(state);
+        }
+    }
+    system->calcRates();
+
+    // Drop the events that were processed before the checkpoint was
+    // taken; what remains should be what was pending then.
+    //
+    double lastEventTime = meta.get<double>();
+    Sched::discardEvents(lastEventTime);
+    vector<double> eventTimes(meta.get<uint32_t>());
+    for (auto &t : eventTimes) {
+        t = meta.get<double>();
+    }
+    if (rank == 0 && eventTimes != Sched::getEventTimes()) {
+        TRACE_WARN("{}: scheduled events differ from those pending "
+                   "at the checkpoint", path);
+    }
+
+    // The ranks' random states can only be restored if the number of
+    // ranks is unchanged
+    //
+    vector<string> randStates(meta.get<uint32_t>());
+    for (auto &s : randStates) {
+        s = meta.getString();
+    }
+    if (hdr->numRanks == (uint) size) {
+        Util::setRandState(randStates[rank]);
+    } else if (rank == 0) {
+        TRACE_WARN("{}: written by {} ranks, random state not restored",
+                   path, hdr->numRanks);
+    }
+
+    munmap((void *) base, fileSize);
+
+    TRACE_INFO("Restarting at simTime {} from {}", simTime, path);
+}
@@ -0,0 +1,75 @@
+#ifndef NS_CHECKPOINT_HH
+#define NS_CHECKPOINT_HH
+
+#include <stdint.h>
+#include <string>
+using std::string;
+
+class NsSystem;
+
+/**
+ * Checkpoint and restart
+ *
+ * A checkpoint holds the complete simulation state: simTime and timeStep,
+ * the state of every unit and connection, layer inhibition, frozen and
+ * lesioned flags and patterns, tract E3 levels, the times of the pending
+ * scheduled events and the random number generator state.
+ *
+ * The file layout does not depend on how the state was distributed when
+ * it was written, so that the parallel engines can restart a checkpoint
+ * with a different number of ranks, and all three engines can read each
+ * other's checkpoints (the serial engine only with the same number of
+ * replicates). It consists of
+ *
+ *   NsCheckpointHeader
+ *   NsCheckpointUnit       units[numUnits * numReplicates]
+ *   NsCheckpointConnection connections[numConnections * numReplicates]
+ *   metadata (layers, tracts, events, random state) at metaOffset
+ *
+ * Layers and tracts are stored in order of their IDs. Units are numbered
+ * consecutively in that layer order; the connections of a tract are
+ * numbered fromIndex * toLayerSize + toIndex, consecutively in that tract
+ * order. The values of the replicates of a unit or connection are stored
+ * consecutively.
+ *
+ * Scheduled events are not stored as such: on restart they are rebuilt
+ * from the props, and those that had been processed before the
+ * checkpoint was taken are discarded.
+ */
+
+static const uint32_t checkpointVersion = 1;
+
+struct NsCheckpointHeader {
+    char     magic[4];        // "NSCP"
+    uint32_t version;
+    uint32_t numReplicates;
+    uint32_t simTime;
+    uint32_t timeStep;
+    uint32_t numRanks;        // ranks that wrote it, 0 for the serial engine
+    uint64_t numUnits;
+    uint64_t numConnections;
+    uint64_t metaOffset;
+    uint64_t metaSize;
+};
+
+struct NsCheckpointUnit {
+    double  lastNetInput;
+    uint8_t isActive;
+    uint8_t newIsActive;
+    uint8_t pad[6];
+};
+
+struct NsCheckpointConnection {
+    double  psdSize;
+    double  numCiAmpars;
+    double  numCpAmpars;
+    uint8_t isPotentiated;
+    uint8_t psiIsOn;
+    uint8_t pad[6];
+};
+
+void checkpoint_write(NsSystem *system, const string &path,
+                      double lastEventTime);
+void checkpoint_read(NsSystem *system, const string &path);
+
+#endif
@@ -7,6 +7,18 @@
 
 class NsTract;
 
+/**
+ * Mutable per-connection state, in a form that can be saved in and
+ * restored from a checkpoint.
+ */
+struct NsConnectionState {
+    double  psdSize;
+    double  numCiAmpars;
+    double  numCpAmpars;
+    uint8_t isPotentiated;
+    uint8_t psiIsOn;
+};
+
 class NsConnection {
 private:
     bool forceStaticInit;
@@ -17,14 +29,16 @@ public:
                           double ciAmparInsertionRate,
                           double ciAmparRemovalRate);
 
-    static void printStateHdr();
     void depotentiate(const char *tag);
     void togglePsi(bool state) { psiIsOn = state; }
     void reactivate();
     double getStrength() const;
     void printState() const;
     string toStr(uint iLvl = 0, const string &iStr = "   ") const;
+    string getId() const { return unit_id(fromUnit) + "->" + toUnit->id; }
     bool isHebbian() const { return global_activations[fromUnit] && *(toUnit->isActive); }
+    NsConnectionState getState() const;
+    void setState(const NsConnectionState &state);
 
     bool isPotentiated;
     const uint fromUnit;
@@ -37,7 +51,7 @@ private:
     void setNumCiAmpars(double n)
     {
         TRACE_DEBUG("simTime: {} {}.numCiAmpars {:5.2f} --> {:5.2f}\n",
-                    simTime, id, numCiAmpars, n);
+                    simTime, getId(), numCiAmpars, n);
         ABORT_IF(n < minNumCiAmpars || isnan(n), "Oops");
         numCiAmpars = n;
     }
@@ -45,7 +59,7 @@ private:
     void setNumCpAmpars(double n)
     {
         TRACE_DEBUG("simTime: {} {}.numCpAmpars {:5.2f} --> {:5.2f}\n",
-                    simTime, id, numCpAmpars, n);
+                    simTime, getId(), numCpAmpars, n);
         ABORT_IF(n < minNumCpAmpars || isnan(n), "Oops");
         numCpAmpars = n;
     }
@@ -53,7 +67,6 @@ private:
     void learn(double learnRate, uint numStimCycles, const char *tag);
 
     const  NsTract *tract;
-    string  id;
     double         psdSize;
     double         numCiAmpars;
     double         numCpAmpars;
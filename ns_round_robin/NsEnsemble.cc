@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <mpi.h>
+
+#include "NsEnsemble.hh"
+#include "NsGlobals.hh"
+#include "Trace.hh"
+
+using std::vector;
+
+/**
+ * Read an ensemble file
+ * @return one entry per run, in file order
+ */
+vector<NsEnsembleRun> ensemble_read(const char *path)
+{
+    std::ifstream in(path);
+    ABORT_IF(!in, "Cannot open ensemble file {}", path);
+
+    vector<NsEnsembleRun> runs;
+    std::map<string, uint> numRuns;  // per name, so that replicates of
+                                     // repeated lines get distinct outputs
+    string line;
+    uint lineNum = 0;
+    while (std::getline(in, line)) {
+        lineNum++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        string propsPath;
+        if (!(fields >> propsPath)) {
+            continue;
+        }
+        uint numReplicates = 1;
+        string extra;
+        if ((fields >> std::ws).good() && !(fields >> numReplicates)) {
+            TRACE_FATAL("{}:{}: bad number of replicates", path, lineNum);
+        }
+        ABORT_IF(fields >> extra, "{}:{}: extra field '{}'",
+                 path, lineNum, extra);
+
+        NsEnsembleRun run;
+        run.propsPath = propsPath;
+        size_t start = propsPath.rfind('/');
+        start = (start == string::npos) ? 0 : start + 1;
+        size_t end = propsPath.rfind(".props");
+        if (end == string::npos || end < start) {
+            end = propsPath.size();
+        }
+        run.name = propsPath.substr(start, end - start);
+        for (uint i = 0; i < numReplicates; i++) {
+            run.replicate = numRuns[run.name]++;
+            runs.push_back(run);
+        }
+    }
+    ABORT_IF(runs.empty(), "No runs in ensemble file {}", path);
+    return runs;
+}
+
+/**
+ * Split MPI_COMM_WORLD into equal blocks of consecutive ranks, one per
+ * run, and make this rank's block the sim_comm. Must be called by all
+ * ranks.
+ * @return the index of the run of this rank
+ */
+int ensemble_split(const vector<NsEnsembleRun> &runs)
+{
+    int worldRank;
+    int worldSize;
+    MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+    MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+
+    int numRuns = runs.size();
+    ABORT_IF(worldSize % numRuns != 0,
+             "{} ranks cannot be split evenly between {} runs",
+             worldSize, numRuns);
+    int runIndex = worldRank / (worldSize / numRuns);
+    MPI_Comm_split(MPI_COMM_WORLD, runIndex, worldRank, &sim_comm);
+    return runIndex;
+}
+
+/**
+ * Create <outDir>/<name> (and outDir) if needed
+ */
+static void makeOutputDir(const string &outDir, const NsEnsembleRun &run)
+{
+    for (const string &dir : { outDir, outDir + "/" + run.name }) {
+        ABORT_IF(mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST,
+                 "Cannot create directory {}", dir);
+    }
+}
+
+/**
+ * Get the output path prefix of a run, creating its directory. Must be
+ * called by all ranks of sim_comm.
+ */
+string ensemble_output_prefix(const string &outDir, const NsEnsembleRun &run)
+{
+    int simRank;
+    MPI_Comm_rank(sim_comm, &simRank);
+    if (simRank == 0) {
+        makeOutputDir(outDir, run);
+    }
+    MPI_Barrier(sim_comm);
+    return outDir + "/" + run.name + "/" + std::to_string(run.replicate);
+}
+
+/**
+ * Gather the timings of all runs on world rank 0 and write them to
+ * <outDir>/ensemble.out, one line per run: run index, props file,
+ * replicate, number of ranks, setup and run time of the slowest rank.
+ * Must be called by all ranks.
+ */
+void ensemble_report(const string &outDir, const vector<NsEnsembleRun> &runs,
+                     double setupTime, double runTime)
+{
+    double times[2] = { setupTime, runTime };
+    double maxTimes[2];
+    MPI_Reduce(times, maxTimes, 2, MPI_DOUBLE, MPI_MAX, 0, sim_comm);
+
+    int worldRank;
+    int simRank;
+    int simSize;
+    MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+    MPI_Comm_rank(sim_comm, &simRank);
+    MPI_Comm_size(sim_comm, &simSize);
+
+    // The rank 0 of each run contributes its run's times
+    //
+    MPI_Comm leaders;
+    MPI_Comm_split(MPI_COMM_WORLD, simRank == 0 ? 0 : MPI_UNDEFINED,
+                   worldRank, &leaders);
+    if (simRank != 0) {
+        return;
+    }
+    vector<double> allTimes(2 * runs.size());
+    MPI_Gather(maxTimes, 2, MPI_DOUBLE, allTimes.data(), 2, MPI_DOUBLE, 0,
+               leaders);
+    MPI_Comm_free(&leaders);
+
+    if (worldRank == 0) {
+        string path = outDir + "/ensemble.out";
+        FILE *f = fopen(path.c_str(), "w");
+        ABORT_IF(f == NULL, "Cannot create {}", path);
+        fprintf(f, "run props replicate ranks setup_time run_time\n");
+        for (uint i = 0; i < runs.size(); i++) {
+            fprintf(f, "%u %s %u %d %g %g\n", i, runs[i].propsPath.c_str(),
+                    runs[i].replicate, simSize,
+                    allTimes[2 * i], allTimes[2 * i + 1]);
+        }
+        fclose(f);
+    }
+}
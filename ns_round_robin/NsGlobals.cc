@@ -1,7 +1,10 @@
 #include "NsGlobals.hh"
 #include <iostream>
-#include <unordered_set>
+#include <algorithm>
 #include <mpi.h>
+#include "Trace.hh"
+#include "NsProfile.hh"
+#include "NsPersistent.hh"
 
 using std::string;
 
@@ -17,12 +20,13 @@ uint  timeStep;
  * MPI / parallel stuff
  */
 
+MPI_Comm sim_comm = MPI_COMM_NULL;
 int rank;
 int size;
 uint n_units_global = 0;
 
-std::unordered_set <uint> local_gids;
-std::map <uint, string> gid_id_map;
+std::vector<std::string> layer_names;
+std::vector<uint> layer_first_gids;
 
 uint8_t *global_activations;
 int *counts;
@@ -31,6 +35,35 @@ int *recvcounts;
 int max_count;
 
 MPI_Datatype strided, resizestrided;
+NsSyncPlan sync_plan;   // persistent exchange of global_activations
+
+/**
+ * Node-shared activations: the ranks of a node (or of a group of
+ * sharedActivationsGroupSize ranks within a node) map a single copy of
+ * global_activations, and only the group leaders exchange activations.
+ */
+bool shared_activations = false;
+MPI_Win activations_win;
+
+/**
+ * Hierarchical exchange (hierarchicalSync): ranks keep private copies,
+ * but gather them on the node leader, leaders exchange node-aggregated
+ * activations, and broadcast the result within the node.
+ */
+bool hierarchical_sync = false;
+int *node_gather_counts;
+int *node_gather_displacements;
+
+// Nodes and node leaders, for both of the above
+//
+bool has_node_comms = false;
+MPI_Comm node_comm;
+MPI_Comm leader_comm;
+int node_rank;
+int node_size;
+int node_first_rank;
+int *leader_recvcounts;
+int *leader_displacements;
 
 
 void init_global_counts_displacements() {
@@ -65,15 +98,238 @@ void build_mpi_components() {
 }
 
 
+/**
+ * Split the ranks into nodes (or groups of group_size ranks within a
+ * node) and create the communicator of node leaders. Requires each node
+ * to consist of consecutive ranks, so that a node's units form node_size
+ * blocks of resizestrided starting at the leader's rank.
+ * @return false (and no communicators) if that is not the case
+ */
+static bool init_node_comms(int group_size) {
+    MPI_Comm_split_type(sim_comm, MPI_COMM_TYPE_SHARED, rank,
+                        MPI_INFO_NULL, &node_comm);
+    if (group_size > 0) {
+        int rank_on_node;
+        MPI_Comm node;
+        MPI_Comm_rank(node_comm, &rank_on_node);
+        node = node_comm;
+        MPI_Comm_split(node, rank_on_node / group_size, rank, &node_comm);
+        MPI_Comm_free(&node);
+    }
+    MPI_Comm_rank(node_comm, &node_rank);
+    MPI_Comm_size(node_comm, &node_size);
+
+    int max_rank;
+    MPI_Allreduce(&rank, &node_first_rank, 1, MPI_INT, MPI_MIN, node_comm);
+    MPI_Allreduce(&rank, &max_rank, 1, MPI_INT, MPI_MAX, node_comm);
+    int blocked = (max_rank - node_first_rank + 1 == node_size);
+    MPI_Allreduce(MPI_IN_PLACE, &blocked, 1, MPI_INT, MPI_LAND, sim_comm);
+    if (!blocked) {
+        if (rank == 0) {
+            TRACE_WARN("Ranks are not mapped to nodes in blocks; "
+                       "using flat activation exchange");
+        }
+        MPI_Comm_free(&node_comm);
+        return false;
+    }
+
+    MPI_Comm_split(sim_comm, node_rank == 0 ? 0 : MPI_UNDEFINED, rank,
+                   &leader_comm);
+    if (node_rank == 0) {
+        int num_leaders;
+        MPI_Comm_size(leader_comm, &num_leaders);
+        leader_recvcounts = new int [num_leaders];
+        leader_displacements = new int [num_leaders];
+        MPI_Allgather(&node_size, 1, MPI_INT, leader_recvcounts, 1, MPI_INT,
+                      leader_comm);
+        MPI_Allgather(&rank, 1, MPI_INT, leader_displacements, 1, MPI_INT,
+                      leader_comm);
+    }
+    return true;
+}
+
+
+static void free_node_comms() {
+    if (node_rank == 0) {
+        MPI_Comm_free(&leader_comm);
+        delete [] leader_recvcounts;
+        delete [] leader_displacements;
+    }
+    MPI_Comm_free(&node_comm);
+}
+
+
+/**
+ * Set up the node-shared activation window
+ */
+static void init_shared_activations() {
+    MPI_Aint win_size = (node_rank == 0) ? max_count * size : 0;
+    MPI_Win_allocate_shared(win_size, sizeof(uint8_t), MPI_INFO_NULL,
+                            node_comm, &global_activations, &activations_win);
+    MPI_Aint leader_size;
+    int disp_unit;
+    MPI_Win_shared_query(activations_win, 0, &leader_size, &disp_unit,
+                         &global_activations);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, activations_win);
+    shared_activations = true;
+}
+
+
+/**
+ * Set up the gather plan for the hierarchical exchange: the ranks of a
+ * node send their units to the leader, each as one resizestrided at
+ * their own rank
+ */
+static void init_hierarchical_sync() {
+    node_gather_counts = new int [node_size];
+    node_gather_displacements = new int [node_size];
+    for (int i = 0; i < node_size; i++) {
+        node_gather_counts[i] = 1;
+        node_gather_displacements[i] = node_first_rank + i;
+    }
+    hierarchical_sync = true;
+}
+
+
 void init_global_activations() {
     init_global_counts_displacements();
-    global_activations = new uint8_t [max_count * size];
     build_mpi_components();
+
+    bool shared = props.getBool("nodeSharedActivations", false);
+    bool hierarchical = props.getBool("hierarchicalSync", false);
+    int group_size = props.getInt("sharedActivationsGroupSize", 0);
+    has_node_comms = (shared || hierarchical) && init_node_comms(group_size);
+    if (has_node_comms && shared) {
+        init_shared_activations();
+    } else {
+        global_activations = new uint8_t [max_count * size];
+        if (has_node_comms) {
+            init_hierarchical_sync();
+        }
+    }
+
+    init_sync_mode();
+    if (sync_mode != NS_SYNC_OFF) {
+        if (shared_activations) {
+            if (node_rank == 0) {
+                plan_allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL,
+                                global_activations, leader_recvcounts,
+                                leader_displacements, resizestrided,
+                                leader_comm, sync_plan);
+            }
+        } else {
+            plan_allgatherv(MPI_IN_PLACE, 1, resizestrided,
+                            global_activations, recvcounts, displacements,
+                            resizestrided, sim_comm, sync_plan);
+        }
+    }
+}
+
+
+void free_global_activations() {
+    plan_free(sync_plan);
+    if (shared_activations) {
+        MPI_Win_unlock_all(activations_win);
+        MPI_Win_free(&activations_win);
+    } else {
+        delete [] global_activations;
+    }
+    if (has_node_comms) {
+        free_node_comms();
+    }
+    global_activations = NULL;
+}
+
+
+/**
+ * Whether this rank should write activations that are set identically by
+ * all ranks (e.g. patterns). With shared activations, only the node leader
+ * does, and must be followed by fence_global_activations().
+ */
+bool writes_global_activations() {
+    return !shared_activations || node_rank == 0;
+}
+
+
+/**
+ * With shared activations, wait until all ranks on the node have finished
+ * reading or writing global_activations, and make their writes visible.
+ */
+void fence_global_activations() {
+    if (shared_activations) {
+        MPI_Win_sync(activations_win);
+        MPI_Barrier(node_comm);
+        MPI_Win_sync(activations_win);
+    }
+}
+
+
+/**
+ * Exchange the node-aggregated activations between node leaders
+ */
+static void exchange_between_leaders() {
+    if (sync_mode != NS_SYNC_OFF && shared_activations) {
+        plan_start(sync_plan);
+        MPI_Waitall(sync_plan.size(), sync_plan.data(), MPI_STATUSES_IGNORE);
+    } else {
+        MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL,
+                       global_activations, leader_recvcounts,
+                       leader_displacements, resizestrided, leader_comm);
+    }
 }
 
 
 void synchronize() {
-    MPI_Allgatherv(MPI_IN_PLACE, 1, resizestrided,
-                   global_activations, recvcounts, displacements,
-                   resizestrided, MPI_COMM_WORLD);
-}
\ No newline at end of file
+    NsProfileRegion region(NS_PHASE_SYNCHRONIZE);
+
+    if (shared_activations) {
+        fence_global_activations();
+        if (node_rank == 0) {
+            exchange_between_leaders();
+        }
+        fence_global_activations();
+        return;
+    }
+
+    if (hierarchical_sync) {
+        // Gather within the node, exchange between node leaders,
+        // broadcast within the node
+        //
+        if (node_rank == 0) {
+            MPI_Gatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL,
+                        global_activations, node_gather_counts,
+                        node_gather_displacements, resizestrided, 0,
+                        node_comm);
+            exchange_between_leaders();
+        } else {
+            MPI_Gatherv(&global_activations[rank], 1, resizestrided,
+                        NULL, NULL, NULL, MPI_DATATYPE_NULL, 0, node_comm);
+        }
+        MPI_Bcast(global_activations, max_count * size, MPI_UINT8_T, 0,
+                  node_comm);
+        return;
+    }
+
+    if (sync_mode != NS_SYNC_OFF) {
+        plan_start(sync_plan);
+        MPI_Waitall(sync_plan.size(), sync_plan.data(), MPI_STATUSES_IGNORE);
+    } else {
+        MPI_Allgatherv(MPI_IN_PLACE, 1, resizestrided,
+                       global_activations, recvcounts, displacements,
+                       resizestrided, sim_comm);
+    }
+}
+
+
+/**
+ * Compute the string id ("<layer>.<index>") of a unit from its gid.
+ * Ids are only needed for traces, so they are not stored per unit
+ * or connection.
+ */
+string unit_id(uint gid)
+{
+    auto it = std::upper_bound(layer_first_gids.begin(),
+                               layer_first_gids.end(), gid);
+    uint l = it - layer_first_gids.begin() - 1;
+    return fmt::format("{}.{:02}", layer_names[l], gid - layer_first_gids[l]);
+}
@@ -5,6 +5,8 @@
 #include <unordered_set>
 #include <map>
 #include <string>
+#include <vector>
+#include <mpi.h>
 
 using std::string;
 
@@ -28,18 +30,26 @@ extern uint  timeStep; // hours
  * MPI / parallel stuff
  */
 
-extern int rank; // MPI rank
-extern int size; // MPI comm size
+extern MPI_Comm sim_comm; // ranks of this simulation (see NsEnsemble.hh)
+extern int rank; // MPI rank in sim_comm
+extern int size; // MPI comm size of sim_comm
 
 extern uint n_units_global; // total global number of units (neurons)
-extern std::unordered_set <uint> local_gids;
-extern std::map <uint, string> gid_id_map;
+extern std::vector<std::string> layer_names;
+extern std::vector<uint> layer_first_gids; // gid of each layer's first unit
+string unit_id(uint gid);
 
 extern int *counts;
 extern int *displacements;
 
 extern uint8_t *global_activations;
+extern bool shared_activations; // global_activations is shared within a node
+extern bool hierarchical_sync;  // exchange through node leaders
+extern bool has_node_comms;     // node and leader communicators exist
 void init_global_activations();
+void free_global_activations();
+bool writes_global_activations();
+void fence_global_activations();
 void synchronize();
 
 #endif
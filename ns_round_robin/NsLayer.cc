@@ -2,6 +2,7 @@
 #include "NsLayer.hh"
 #include "MathUtil.hh"
 #include "NsGlobals.hh"
+#include "NsOutput.hh"
 
 /**
  * Implementation of the NsLayer class
@@ -10,90 +11,134 @@
 NsLayer::NsLayer(const string &id, const string &type)
     : id(id),
       type(type),
-      width(props.getUint(id + '.' + "width")),
-      height(props.getUint(id + '.' + "height")),
-      k(props.getDouble(id + '.' + "k")),
-      minInhibition(props.getDouble("minInhibition")),
-      maxInhibition(props.getDouble("maxInhibition")),
-      initInhibition(props.getDouble("initInhibition")),
-      inhibIncr(props.getDouble("inhibIncr")),
-      inhibition(initInhibition),
+      params(params_layer(id)),
+      width(params.width),
+      height(params.height),
+      k(params.k),
+      inhibition(params.initInhibition),
       isClamped(false),
       isFrozen(false),
       isLesioned(false),
-      orthogonalPatterns(props.getBool("orthogonalPatterns")),
-      nextPatternUnit(0),
-      printPatterns(props.getBool("printPatterns"))
+      nextPatternUnit(0)
 {
-    uint numUnits = width * height;
-    for (uint i = 0; i < numUnits; i++) {
-        // round robin assignment of units to ranks
-        if (n_units_global % size == (unsigned)rank) {
-            units.push_back(new NsUnit(this, i, n_units_global));
-            local_gids.insert(n_units_global);
-        }
-        layer_gids.push_back(n_units_global);
-        gid_id_map.insert({n_units_global, id + "." + fmt::format("{:02}", i)});
-        n_units_global++;
+    num_units = width * height;
+    global_displacement = n_units_global;
+    layer_names.push_back(id);
+    layer_first_gids.push_back(global_displacement);
+    n_units_global += num_units;
+
+    // round robin assignment of units to ranks: only create the
+    // units this rank owns
+    uint first = (rank + size - global_displacement % size) % size;
+    uint maxOwned = (num_units + size - 1) / size;
+    unitSlab.reserve(maxOwned);
+    units.reserve(maxOwned);
+    for (uint i = first; i < num_units; i += size) {
+        unitSlab.emplace_back(this, i, global_displacement + i);
+        units.push_back(&unitSlab.back());
     }
 }
 
-void NsLayer::makePattern(const string &patId)
+/**
+ * Make a new pattern: a random set of units or, with orthogonalPatterns,
+ * the next units not used by any pattern yet
+ * @param patId Pattern ID
+ * @return the pattern's handle
+ */
+NsPatternHandle NsLayer::makePattern(const string &patId)
 {
-    ABORT_IF(definedPatterns.count(patId) != 0, "Duplicate pattern ID");
+    NsPatternHandle h = registerPattern(patId);
+    ABORT_IF(hasPattern(h), "Duplicate pattern ID");
     NsPattern p;
-    if (orthogonalPatterns) {
-        for (uint i = 0; i < k * layer_gids.size(); i++) {
-            ABORT_IF(nextPatternUnit >= layer_gids.size(), "too many patterns");
-            p.push_back(layer_gids[nextPatternUnit++]);
+    if (params.orthogonalPatterns) {
+        for (uint i = 0; i < k * num_units; i++) {
+            ABORT_IF(nextPatternUnit >= num_units, "too many patterns");
+            p.push_back(nextPatternUnit++);
         }
     } else {
-        p = Util::randUniqueUintList(k * layer_gids.size(), layer_gids.size());
+        p = Util::randUniqueUintList(k * num_units, num_units);
     }
-    definedPatterns.insert({patId, p});
-    definedPatternIds.push_back(patId);
+    definePattern(h, p);
 
     TRACE_DEBUG("{}.{} {}\n", id, patId, patternToStr(p));
+    return h;
 }
 
-void NsLayer::setPattern(const NsPattern &pat)
+/**
+ * Define a pattern
+ * @param h Pattern handle
+ * @param pattern The pattern's units
+ */
+void NsLayer::definePattern(NsPatternHandle h, const NsPattern &pattern)
+{
+    if (h >= definedPatterns.size()) {
+        definedPatterns.resize(h + 1);
+    }
+    definedPatterns[h] = { patternArena.copy(pattern),
+                           patternToMask(pattern, num_units, patternArena) };
+    definedPatternHandles.push_back(h);
+}
+
+void NsLayer::setPattern(const ArenaArray<uint> &pat)
 {
     if (!isFrozen) {
-        clear();
-        for (auto id : pat) {
-            global_activations[id] = true;
+        fence_global_activations();
+        if (writes_global_activations()) {
+            for (uint i = 0; i < num_units; i++) {
+                global_activations[global_displacement + i] = false;
+            }
+            for (auto i : pat) {
+                global_activations[global_displacement + i] = true;
+            }
         }
+        fence_global_activations();
     }
 }
 
+void NsLayer::setPattern(NsPatternHandle h)
+{
+    ABORT_IF(!hasPattern(h), "Layer {} has no pattern {}", id, h);
+    setPattern(definedPatterns[h].units);
+}
+
 void NsLayer::setPattern(const string &patId)
 {
-    setPattern(definedPatterns.at(patId));
+    setPattern(findPattern(patId));
 }
 
+/**
+ * Forget all defined patterns, and release their storage in place
+ */
 void NsLayer::clearPatterns()
 {
-    definedPatternIds.clear();
-    definedPatterns.clear();
+    for (auto h : definedPatternHandles) {
+        definedPatterns[h] = NsLayerPattern();
+    }
+    definedPatternHandles.clear();
+    patternArena.reset();
 }
 
 /**
  * Randomly select one of the trained patterns and activate it
  */
-const string &NsLayer::setRandomPattern()
+NsPatternHandle NsLayer::setRandomPattern()
 {
-    uint i = Util::randInt(0, definedPatternIds.size());
-    const string &pid = definedPatternIds[i];
-    setPattern(pid);
-    TRACE_INFO("Layer {}, pattern {}", id, pid);
-    return pid;
+    uint i = Util::randInt(0, definedPatternHandles.size());
+    NsPatternHandle h = definedPatternHandles[i];
+    setPattern(h);
+    TRACE_INFO("Layer {}, pattern {}", id, patternId(h));
+    return h;
 }
 
 void NsLayer::clear()
 {
-    for(auto gid : layer_gids) {
-        global_activations[gid] = false;
+    fence_global_activations();
+    if (writes_global_activations()) {
+        for(uint i = 0; i < num_units; i++) {
+            global_activations[global_displacement + i] = false;
+        }
     }
+    fence_global_activations();
 }
 
 /**
@@ -103,16 +148,16 @@ void NsLayer::clear()
 void NsLayer::adjustInhibition()
 {
     ABORT_IF(isFrozen, "Makes no sense");
-    int target = k * layer_gids.size();
+    int target = k * num_units;
     int error = (int) getNumActive() - target;
 
     // make an adjustment to the inhibition level
     // in proportion to the magnitude of the error
 
     inhibition = Util::bracket(
-        inhibition + (double) error / target * inhibIncr,
-        minInhibition,
-        maxInhibition);
+        inhibition + (double) error / target * params.inhibIncr,
+        params.minInhibition,
+        params.maxInhibition);
 
     TTRACE_DEBUG("inhib", "{} active: {}  inhib: {}", id, getNumActive(), inhibition);
 }
@@ -123,6 +168,7 @@ void NsLayer::adjustInhibition()
 void NsLayer::randomize()
 {
     ABORT_IF(isFrozen, "Makes no sense");
+    fence_global_activations();
     for(auto u : units) {
         *(u->isActive) = (Util::randDouble(0.0, 1.0) < k);
     }
@@ -160,9 +206,11 @@ void NsLayer::setFrozen(bool state)
     if (!isLesioned) {
         isFrozen = state;
 
+        fence_global_activations();
         for(auto u : units) {
             u->setFrozen(state);
         }
+        fence_global_activations();
     }
 }
 
@@ -183,8 +231,8 @@ void NsLayer::maintain()
 uint NsLayer::getNumActive() const
 {
     uint numActive = 0;
-    for(auto gid : layer_gids) {
-        if (global_activations[gid]) {
+    for(uint i = 0; i < num_units; i++) {
+        if (global_activations[global_displacement + i]) {
             numActive++;
         }
     }
@@ -199,24 +247,36 @@ void NsLayer::printState() const
     }
 }
 
+/**
+ * Get the set of active units
+ * @return the active units; valid until the next call
+ */
+const NsUnitMask &NsLayer::getActiveUnits() const
+{
+    activeUnits.assign(unitMaskWords(num_units), 0);
+    for (uint i = 0; i < num_units; i++) {
+        activeUnits[i / 64] |=
+            (uint64_t) (global_activations[global_displacement + i] != 0)
+            << (i % 64);
+    }
+    return activeUnits;
+}
+
 /**
  * Count number of active target units
- * @param targetId ID of target pattern
+ * @param target Target pattern
  * @return Count of targeted active units
  */
-uint NsLayer::getNumHits(const string &targetId) const
+uint NsLayer::getNumHits(NsPatternHandle target) const
 {
-    NsPattern target = definedPatterns.at(targetId);
-    uint ret = 0;
-    for (auto id : target) {
-        if(global_activations[id]) ret++;
-    }
-    return ret;
+    return countCommonUnits(getActiveUnits(), definedPatterns[target].mask);
 }
 
 void NsLayer::printScoreHdr()
 {
-    fmt::print("time score condition layer target hits extras\n");
+    if (rank == 0) {
+        fmt::print("time score condition layer target hits extras\n");
+    }
 }
 
 void NsLayer::printNumActiveHdr()
@@ -229,35 +289,39 @@ void NsLayer::printNumActive() const
       infoTrace("{} layer {} {}\n", simTime, id, getNumActive());
 }
 
-void NsLayer::printGrid(const string &tag, const string &targetId) const
+void NsLayer::printGrid(const string &tag, NsPatternHandle target) const
 {
-    bool targetKnown = (definedPatterns.count(targetId) != 0);
-
-    if (targetKnown) {
-        uint targetSize = definedPatterns.at(targetId).size();
-        uint numHits = getNumHits(targetId);
-        uint numExtras = getNumActive() > numHits ?
-            getNumActive() - numHits : 0;
-        fmt::print("{} score {} {} {} {} {}\n",
-                   simTime / 24., tag, id, targetSize, numHits, numExtras);
+    if (hasPattern(target)) {
+        const NsLayerPattern &pat = definedPatterns[target];
+        const NsUnitMask &active = getActiveUnits();
+        uint targetSize = pat.units.size();
+        uint numHits = countCommonUnits(active, pat.mask);
+        uint numActive = countUnits(active);
+        uint numExtras = numActive > numHits ? numActive - numHits : 0;
+        if (rank == 0) {
+            fmt::print("{} score {} {} {} {} {}\n",
+                       simTime / 24., tag, id, targetSize, numHits, numExtras);
+            output_record(NS_REC_SCORE, output_name(tag), output_name(id), 0,
+                          targetSize, numHits, numExtras);
+        }
     } else {
-        if (printPatterns) {
+        if (params.printPatterns) {
             infoTrace("{} {} {}\n", simTime / 24., tag, id);
         }
     }
 
-    if (printPatterns) {
-        infoTrace("+{}+\n", string(2 * width -1, '-'));
+    if (params.printPatterns) {
+        infoTrace("+{:-<{}}+\n", "", 2 * width - 1);
         for (uint row = 0; row < height; row++) {
             infoTrace("|");
             for (uint col = 0; col < width; col++) {
                 infoTrace("{}{}",
-                           global_activations[layer_gids[row * width + col]] ? '*' : ' ',
+                           global_activations[global_displacement + row * width + col] ? '*' : ' ',
                            (col < width - 1) ? " " : "");
             }
             infoTrace("|\n");
         }
-        infoTrace("+{}+\n", string(2 * width -1, '-'));
+        infoTrace("+{:-<{}}+\n", "", 2 * width - 1);
     }
 }
 
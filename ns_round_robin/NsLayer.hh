@@ -15,11 +15,16 @@ using std::string;
 class NsLayer {
 public:
     NsLayer(const string &id, const string &type);
-    void makePattern(const string &patId);
+    NsPatternHandle makePattern(const string &patId);
+    void definePattern(NsPatternHandle h, const NsPattern &pattern);
+    bool hasPattern(NsPatternHandle h) const {
+        return h < definedPatterns.size() && !definedPatterns[h].mask.empty();
+    }
     void setPattern(const string &patId);
-    void setPattern(const NsPattern &pat);
+    void setPattern(NsPatternHandle h);
+    void setPattern(const ArenaArray<uint> &pat);
     void clearPatterns();
-    const string &setRandomPattern();
+    NsPatternHandle setRandomPattern();
     void clear();
     void randomize();
     void computeNewActivations();
@@ -30,11 +35,12 @@ public:
     void maintain();
     uint getNumActive() const;
     static void printScoreHdr();
-    uint getNumHits(const string &targetId) const;
+    const NsUnitMask &getActiveUnits() const;
+    uint getNumHits(NsPatternHandle target) const;
     static void printNumActiveHdr();
     void printNumActive() const;
     void printState() const;
-    void printGrid(const string &tag, const string &targetId) const;
+    void printGrid(const string &tag, NsPatternHandle target) const;
 
     void saveInhibition() { savedInhibition = inhibition; }
     void restoreInhibition() { inhibition = savedInhibition; }
@@ -42,25 +48,25 @@ public:
     string toStr(uint iLvl = 0, const string &iStr = "   ") const;
     const string id;
     const string type;
+    uint intID;                      // index in NsSystem::layers_vec
+    const NsLayerParams &params;
     const uint width;
     const uint height;
     const double k;
-    const double minInhibition;
-    const double maxInhibition;
-    const double initInhibition;
-    const double inhibIncr;
     double inhibition;
     double savedInhibition;
     bool isClamped;
     bool isFrozen;
     bool isLesioned;
     vector<NsUnit *> units;
-    vector<uint> layer_gids;
-    bool orthogonalPatterns;
+    vector<NsUnit> unitSlab;         // the units, allocated in one block
+    uint global_displacement; // gid of the first unit
+    uint num_units;
     uint nextPatternUnit;
-    unordered_map<string, NsPattern> definedPatterns;
-    vector<string> definedPatternIds;
-    bool printPatterns;
+    vector<NsLayerPattern> definedPatterns;        // per handle
+    vector<NsPatternHandle> definedPatternHandles; // in order of definition
+    Arena patternArena;     // defined patterns, until clearPatterns()
+    mutable NsUnitMask activeUnits;
 };
 
 #endif
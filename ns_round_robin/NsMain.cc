@@ -14,12 +14,23 @@ using std::vector;
 #include "NsTract.hh"
 #include "NsLayer.hh"
 #include "NsGlobals.hh"
+#include "NsOutput.hh"
+#include "NsProfile.hh"
+#include "NsPersistent.hh"
+#include "NsEnsemble.hh"
+#include "NsCheckpoint.hh"
 
 static NsSystem *nsSystem;
 
 static uint stopTime;     // hours
 static uint numBackgroundPatterns;
 
+static string checkpointFile;      // empty: no checkpoints
+static uint checkpointInterval;    // hours
+static uint nextCheckpointTime;    // hours
+static string restartFile;         // empty: start at simTime 0
+static double lastEventTime;       // time of the last event processing
+
 /**
  * Print the system size (number of units and connections) and the system
  * state if the debug tags "psize" and "psys" are set, respectively.
@@ -39,6 +50,8 @@ static void printSystem()
  */
 static void buildSystem()
 {
+    NsProfileRegion region(NS_PHASE_CONSTRUCTION);
+
     // create global isActive array
     init_global_activations();
 
@@ -59,6 +72,22 @@ static void buildSystem()
     nsSystem->addBiTract(accLayerId, sc1LayerId, ncTractTypeId);
 }
 
+/**
+ * Print the slowest and the average time spent by the ranks in
+ * building their part of the system
+ * @param buildTime This rank's build time (seconds)
+ */
+static void printBuildTime(double buildTime)
+{
+    double maxTime = 0.0;
+    double sumTime = 0.0;
+    MPI_Reduce(&buildTime, &maxTime, 1, MPI_DOUBLE, MPI_MAX, 0, sim_comm);
+    MPI_Reduce(&buildTime, &sumTime, 1, MPI_DOUBLE, MPI_SUM, 0, sim_comm);
+    if (rank == 0) {
+        fmt::print("setup: {} {}\n", maxTime, sumTime / size);
+    }
+}
+
 /**
  * Convert time in days::hours format to hours
  */
@@ -80,155 +109,110 @@ static uint dhToH(string dh)
     return 24 * days + hours;
 }
 
-/**
- * struct used to schedule a time step change event
- */
-struct TimeStepChangeData {
-    uint timeStep;
-};
-
 /**
  * This function is called from the event scheduler.
  */
 static void changeTimeStep(
     double stime, 
     double now, 
-    TimeStepChangeData *data)
+    uint newTimeStep)
 {
     TRACE_INFO("Changing time step to {}: scheduled time={} now={}",
-               data->timeStep, stime, now);
-    timeStep = data->timeStep;
+               newTimeStep, stime, now);
+    timeStep = newTimeStep;
     nsSystem->calcRates();
-    delete data;
 }
 
-/**
- * struct used to schedule a reactivate event
- */
-struct ReactivateData {
-};
-
 /**
  * Reactivate
  * This function is called from the event scheduler.
  * @param stime Scheduled time for this event
  * @param now Current time
- * @param data Reactivation data
  */
 static void reactivate(
     double stime, 
-    double now, 
-    ReactivateData *data)
+    double now)
 {
     TRACE_INFO("Reactivating: scheduled time={} now={}", stime, now);
     nsSystem->reactivate();
-    delete data;
 }
 
-/**
- * struct used to schedule a freezing/unfreezing event
- */
-struct FreezeData {
-    FreezeData(const string &layerId, bool state)
-        : layerId(layerId), state(state)
-    {}
-    const string &layerId;
-    bool state;
-};
-
 /**
  * Freeze/unfreeze a layer
  * This function is called from the event scheduler.
  * @param stime Scheduled time for this event
  * @param now Current time
- * @param data Freeze data
+ * @param layerId Layer ID
+ * @param state Whether to freeze (true) or unfreeze (false) the layer
  */
 static void setFrozen(
     double stime, 
     double now, 
-    FreezeData *data)
+    const string &layerId,
+    bool state)
 {
     TRACE_INFO("{} {}: scheduled time={} now={}",
-               data->state ? "Freezing" : "Unfreezing",
-               data->layerId, stime, now);
-
-    nsSystem->setFrozen(data->layerId, data->state);
+               state ? "Freezing" : "Unfreezing",
+               layerId, stime, now);
 
-    delete data;
+    nsSystem->setFrozen(layerId, state);
 }
 
-/**
- * struct used to schedule a lesioning event
- */
-struct LesionData {
-    LesionData(const string &layerId)
-        : layerId(layerId)
-    {}
-    const string &layerId;
-};
-
 /**
  * Lesion a layer
  * This function is called from the event scheduler.
  * @param stime Scheduled time for this event
  * @param now Current time
- * @param data Lesion data
+ * @param layerId Layer ID
  */
 static void lesion(
     double stime, 
     double now, 
-    LesionData *data)
+    const string &layerId)
 {
     TRACE_INFO("Lesioning {}: scheduled time={} now={}",
-               data->layerId, stime, now);
-
-    nsSystem->lesion(data->layerId);
+               layerId, stime, now);
 
-    delete data;
+    nsSystem->lesion(layerId);
 }
 
-/**
- * struct used to schedule Psi on/off event
- */
-struct PsiData {
-    string layerId;
-    bool state;
-    PsiData(string layerId, bool state)
-        : layerId(layerId), state(state)
-    {}
-};
-
 /**
  * Toggle PSI on or off in the specified layer
  * This function is called from the event scheduler.
  * @param stime Scheduled time for this event
  * @param now Current time
- * @param data PSI event data
+ * @param layerId Layer ID
+ * @param state Whether to start (true) or stop (false) PSI
  */
 static void togglePsi(
     double stime, 
     double now, 
-    PsiData *data)
+    const string &layerId,
+    bool state)
 {
     TRACE_INFO("{} PSI in {}: scheduled time={} now={}",
-               (data->state ? "Starting" : "Stopping"),
-               data->layerId, stime, now);
-    nsSystem->togglePsi(data->layerId, data->state);
-    delete data;
+               (state ? "Starting" : "Stopping"),
+               layerId, stime, now);
+    nsSystem->togglePsi(layerId, state);
 }
 
 /**
  * Schedule events to toggle PSI on or off in a specified layer
- * @param layerId Layer ID
+ * @param layerId Layer ID, which must outlive the events
  * @param psiTimes Vector of times at which to toggle PSI on or off
  */
 void schedulePsiEvents(const string &layerId, const vector<string> psiTimes)
 {
+    // Capture the ID by pointer, so that the action needs no allocation
+    //
+    const string *layer = &layerId;
     for (uint i = 0; i <  psiTimes.size(); i++) {
-        PsiData *pd = new PsiData(layerId, Util::isEven(i));
-        Sched::scheduleEvent(
+        bool state = Util::isEven(i);
+        Sched::schedule(
             dhToH(psiTimes[i]),
-            (Sched::VoidPtrCallback) togglePsi, pd);
+            [layer, state](double stime, double now) {
+                togglePsi(stime, now, *layer, state);
+            });
     }
 }
 
@@ -244,11 +228,12 @@ static void scheduleEvents()
     ABORT_IF(Util::isOdd(timeStepChanges.size()),
              "timeStepChanges must have even number of elements");
     for (uint i = 0; i <  timeStepChanges.size(); i += 2) {
-        TimeStepChangeData *tscd = new TimeStepChangeData();
-        tscd->timeStep = strtoul(timeStepChanges[i + 1].c_str(), NULL, 10);
-        Sched::scheduleEvent(
+        uint step = strtoul(timeStepChanges[i + 1].c_str(), NULL, 10);
+        Sched::schedule(
             dhToH(timeStepChanges[i]),
-            (Sched::VoidPtrCallback) changeTimeStep, tscd);
+            [step](double stime, double now) {
+                changeTimeStep(stime, now, step);
+            });
     }
 
     // schedule reactivations
@@ -256,10 +241,7 @@ static void scheduleEvents()
     vector<string> reactivateTimes = 
         props.getStringVector("reactivateTimes", vector<string>());
     for (uint i = 0; i <  reactivateTimes.size(); i++) {
-        ReactivateData *rd = new ReactivateData();
-        Sched::scheduleEvent(
-            dhToH(reactivateTimes[i]),
-            (Sched::VoidPtrCallback) reactivate, rd);
+        Sched::schedule(dhToH(reactivateTimes[i]), reactivate);
     }
 
     // schedule HPC freezing/unfreezing
@@ -267,10 +249,12 @@ static void scheduleEvents()
     vector<string> hpcFreezeTimes = 
         props.getStringVector("hpcFreezeTimes", vector<string>());
     for (uint i = 0; i <  hpcFreezeTimes.size(); i++) {
-        FreezeData *ld = new FreezeData(hpcLayerId, Util::isEven(i));
-        Sched::scheduleEvent(
+        bool state = Util::isEven(i);
+        Sched::schedule(
             dhToH(hpcFreezeTimes[i]),
-            (Sched::VoidPtrCallback) setFrozen, ld);
+            [state](double stime, double now) {
+                setFrozen(stime, now, hpcLayerId, state);
+            });
     }
 
     // schedule ACC freezing/unfreezing
@@ -278,30 +262,34 @@ static void scheduleEvents()
     vector<string> accFreezeTimes = 
         props.getStringVector("accFreezeTimes", vector<string>());
     for (uint i = 0; i <  accFreezeTimes.size(); i++) {
-        FreezeData *ld = new FreezeData(accLayerId, Util::isEven(i));
-        Sched::scheduleEvent(
+        bool state = Util::isEven(i);
+        Sched::schedule(
             dhToH(accFreezeTimes[i]),
-            (Sched::VoidPtrCallback) setFrozen, ld);
+            [state](double stime, double now) {
+                setFrozen(stime, now, accLayerId, state);
+            });
     }
 
     // schedule HPC lesioning
     //
     string hpcLesionTime = props.getString("hpcLesionTime", "");
     if (!hpcLesionTime.empty()) {
-        LesionData *ld = new LesionData(hpcLayerId);
-        Sched::scheduleEvent(
+        Sched::schedule(
             dhToH(hpcLesionTime),
-            (Sched::VoidPtrCallback) lesion, ld);
+            [](double stime, double now) {
+                lesion(stime, now, hpcLayerId);
+            });
     }
 
     // schedule ACC lesioning
     //
     string accLesionTime = props.getString("accLesionTime", "");
     if (!accLesionTime.empty()) {
-        LesionData *ld = new LesionData(accLayerId);
-        Sched::scheduleEvent(
+        Sched::schedule(
             dhToH(accLesionTime),
-            (Sched::VoidPtrCallback) lesion, ld);
+            [](double stime, double now) {
+                lesion(stime, now, accLayerId);
+            });
     }
 
     // Schedule PSI infusions
@@ -341,6 +329,7 @@ static void presentPattern(const string &id)
 static void iterate()
 {
     Sched::processEvents(simTime);
+    lastEventTime = simTime;
     nsSystem->runBackgroundProcesses();
     simTime += timeStep;
 }
@@ -351,6 +340,8 @@ static void iterate()
  */
 void test()
 {
+    NsProfileRegion region(NS_PHASE_TEST);
+
     nsSystem->test(sc0LayerId, "CS-US", "intact");
 
     bool accWasFrozen = nsSystem->getLayer(accLayerId)->isFrozen;
@@ -373,33 +364,59 @@ void test()
 }
 
 /**
- * Run the simulation
+ * Write a checkpoint if one is due, i.e. if a multiple of
+ * checkpointInterval has been reached, or at the end of the run.
  */
-static void run()
+static void checkpointIfDue()
 {
-    simTime = 0;
-    nsSystem->calcRates();
-    
-    // Process events scheduled for time=0, if any.
-    //
-    Sched::processEvents(simTime);
+    if (checkpointFile.empty()) return;
 
-    // Present background pattens if defined
-    //
-    for (uint i = 0; i < numBackgroundPatterns; i++) {
-        presentPattern(fmt::format("dummy-{}", i));
-        nsSystem->train();
-        iterate();
+    if (simTime >= nextCheckpointTime || simTime >= stopTime) {
+        checkpoint_write(nsSystem, checkpointFile, lastEventTime);
+        while (nextCheckpointTime <= simTime) {
+            nextCheckpointTime += checkpointInterval;
+        }
     }
+}
 
-    // Present the training (CS-US) pattern
-    //
-    presentPattern("CS-US");
-    nsSystem->train();
+/**
+ * Run the simulation
+ * @param restarted Whether the system state was restored from a
+ *        checkpoint, rather than to be trained from scratch
+ */
+static void run(bool restarted)
+{
+    if (!restarted) {
+        simTime = 0;
+        nsSystem->calcRates();
+    
+        // Process events scheduled for time=0, if any.
+        //
+        Sched::processEvents(simTime);
+
+        {
+            NsProfileRegion region(NS_PHASE_TRAINING);
+
+            // Present background pattens if defined
+            //
+            for (uint i = 0; i < numBackgroundPatterns; i++) {
+                presentPattern(fmt::format("dummy-{}", i));
+                nsSystem->train();
+                iterate();
+            }
 
-    // Print the initial system state
-    //
-    printSystem();
+            // Present the training (CS-US) pattern
+            //
+            presentPattern("CS-US");
+            nsSystem->train();
+        }
+
+        // Print the initial system state
+        //
+        printSystem();
+    }
+    nextCheckpointTime = (simTime / checkpointInterval + 1) *
+        checkpointInterval;
 
     // Print state headers
     //
@@ -411,9 +428,54 @@ static void run()
         iterate();
         if (TRACE_INFO_IS_ON) nsSystem->printState();
         test();
+        checkpointIfDue();
     }
 }
 
+/**
+ * Instead of running the simulation, time numCalls activation exchanges
+ * with per-call collectives, with the persistent plan and, if enabled,
+ * through the node leaders, and print the per-call latency of each path
+ * (slowest rank, in microseconds)
+ */
+static void benchmarkSynchronize(uint numCalls)
+{
+    NsSyncMode planMode = sync_mode;
+    bool hierarchical = hierarchical_sync;
+    vector<std::pair<NsSyncMode, bool>> paths = { {NS_SYNC_OFF, false} };
+    if (planMode != NS_SYNC_OFF) {
+        paths.push_back({planMode, false});
+    }
+    if (hierarchical) {
+        paths.push_back({NS_SYNC_OFF, true});
+    }
+
+    for (auto path : paths) {
+        sync_mode = path.first;
+        hierarchical_sync = path.second;
+        for (uint i = 0; i < numCalls / 10 + 1; i++) {
+            synchronize();
+        }
+        MPI_Barrier(sim_comm);
+        double start = MPI_Wtime();
+        for (uint i = 0; i < numCalls; i++) {
+            synchronize();
+        }
+        double perCall = (MPI_Wtime() - start) / numCalls;
+        double maxPerCall = 0.0;
+        MPI_Reduce(&perCall, &maxPerCall, 1, MPI_DOUBLE, MPI_MAX, 0,
+                   sim_comm);
+        if (rank == 0) {
+            fmt::print("syncbench: {} {} {}\n",
+                       hierarchical_sync ? "hierarchical"
+                                         : sync_mode_name(sync_mode),
+                       numCalls, maxPerCall * 1e6);
+        }
+    }
+    sync_mode = planMode;
+    hierarchical_sync = hierarchical;
+}
+
 // Data structures for commandline processing
 
 // OptSpec type abbreviations
@@ -427,14 +489,16 @@ const int STR  = Util::OPTARG_STR;
 bool   help            = false;
 const char *traceLevel = "undefined";
 const char *traceTags  = "undefined";
+const char *ensembleFile = NULL;
 
 char *pname;
 vector<Util::ParseOptSpec> optSpecs = {
     { "tl",       STR,  &traceLevel,    "traceLevel", ""                  },
     { "tt",       STR,  &traceTags,     "traceTags",  ""                  },
+    { "ens",      STR,  &ensembleFile,  "ensembleFile", ""                },
     { "help",     NONE, &help,          "",           ""                  },
 };
-vector<string>nonFlags = { "[propname=value...] propsFilePath" };
+vector<string>nonFlags = { "[propname=value...] [propsFilePath] outputPrefix" };
 
 /**
  * Construct a syntax string for use in an invocation error message
@@ -452,20 +516,13 @@ int main(int argc, char *argv[])
     int provided;
     // init MPI
     MPI_Init_thread(&argc, &argv, MPI_THREAD_SINGLE, &provided);
+    sim_comm = MPI_COMM_WORLD;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
+    profile_init();
 
     double time_before_setup = MPI_Wtime();
 
-    // get every rank to write to its own output file
-    char fname_stdout[100];
-    char fname_stderr[100];
-    sprintf(fname_stdout, "%s_%d.raw", argv[argc-1], rank);
-    sprintf(fname_stderr, "%s_%d.err", argv[argc-1], rank);
-
-    FILE *fout = freopen(fname_stdout, "a", stdout);
-    FILE *ferr = freopen(fname_stderr, "a", stderr);
-
     // Initialize the random number generator
     //
     Util::initRand();
@@ -512,9 +569,33 @@ int main(int argc, char *argv[])
         optind++;
     }
 
+    // In an ensemble, this rank runs one of the simulations of the
+    // ensemble file on its block of ranks, and the last argument is the
+    // output directory of all of them
+    //
+    string outputPrefix = argv[argc-1];
+    vector<NsEnsembleRun> ensemble;
+    int ensembleRun = 0;
+    if (ensembleFile != NULL) {
+        if (propsFilePath != NULL) {
+            Util::usageExit(syntax(), "propsFilePath given with -ens");
+        }
+        ensemble = ensemble_read(ensembleFile);
+        ensembleRun = ensemble_split(ensemble);
+        MPI_Comm_rank(sim_comm, &rank);
+        MPI_Comm_size(sim_comm, &size);
+        outputPrefix = ensemble_output_prefix(argv[argc-1],
+                                              ensemble[ensembleRun]);
+        propsFilePath = ensemble[ensembleRun].propsPath.c_str();
+    }
+
     if (propsFilePath == NULL) {
         Util::usageExit(syntax(), "No propsFilePath.");
     }
+
+    // Rank 0 writes the text output, all ranks write binary records
+    // to a shared file
+    output_open(outputPrefix.c_str());
     
     // Set command line props.
     //
@@ -532,6 +613,7 @@ int main(int argc, char *argv[])
     // Load properties from the props file
     //
     props.readProps(propsFilePath);
+    profile_select_phases();
 
     // Retrieve 'title' property to suppress 'unused property' error
     //
@@ -568,9 +650,10 @@ int main(int argc, char *argv[])
     fmt::print("===================================\n");
     */
 
-    // Create the system
+    // Resolve the model parameters, and create the system
     //
-    nsSystem = new NsSystem(props);
+    params_init();
+    nsSystem = new NsSystem(params_system());
 
     // Initialize the simulation time step to 24h; It may be changed
     // dynamically during the simulation, as specified by the
@@ -584,25 +667,54 @@ int main(int argc, char *argv[])
 
     // Initialize the system and schedule events
     //
+    double time_before_build = MPI_Wtime();
     buildSystem();
+    double buildTime = MPI_Wtime() - time_before_build;
     printSystem();
     scheduleEvents();
 
+    // Checkpointing: write checkpoints to checkpointFile every
+    // checkpointInterval (days[:hours]) of simulated time and at the end
+    // of the run; start from the checkpoint in restartFile, if any.
+    //
+    checkpointFile = props.getString("checkpointFile", "");
+    checkpointInterval = dhToH(props.getString("checkpointInterval", "1"));
+    ABORT_IF(checkpointInterval == 0, "checkpointInterval must be > 0");
+    restartFile = props.getString("restartFile", "");
+    if (!restartFile.empty()) {
+        checkpoint_read(nsSystem, restartFile);
+    }
 
     double time_before_run = MPI_Wtime();
 
-    run();
+    uint numBenchmarkCalls = props.getUint("syncBenchmark", 0);
+    if (numBenchmarkCalls > 0) {
+        benchmarkSynchronize(numBenchmarkCalls);
+    } else {
+        run(!restartFile.empty());
+    }
 
     double time_after_run = MPI_Wtime();
 
+    output_record(NS_REC_TIMING, rank, 0, 0,
+                  time_after_run - time_before_setup,
+                  time_after_run - time_before_run,
+                  time_before_run - time_before_setup);
+
     fmt::print("timing: {} {}\n",
                time_after_run - time_before_setup,
                time_after_run - time_before_run);
 
+    printBuildTime(buildTime);
 
+    free_global_activations();
+    output_close();
+    if (ensembleFile != NULL) {
+        ensemble_report(argv[argc-1], ensemble,
+                        time_before_run - time_before_setup,
+                        time_after_run - time_before_run);
+    }
     MPI_Finalize();
-    fclose(fout);
-    fclose(ferr);
 
     return 0;
 }
@@ -0,0 +1,76 @@
+#ifndef NS_OUTPUT_HH
+#define NS_OUTPUT_HH
+
+#include <stdint.h>
+#include <string>
+using std::string;
+
+/**
+ * Parallel output
+ *
+ * Rank 0 writes the human-readable output (scores, trace messages) to
+ * <prefix>_0.raw and <prefix>_0.err. All other ranks discard their
+ * standard output and keep their standard error attached to the launcher.
+ *
+ * Scores (from rank 0), per-rank timings and, at trace level INFO, unit
+ * and connection state are also written as fixed-size binary records into
+ * a single shared file, <prefix>.rec, through MPI-IO. The file starts with
+ * an NsRecordFileHeader, followed by NsRecords in the order the ranks
+ * flushed them. The header and records are those of the serial ns (see
+ * ns/NsOutput.hh), so ns/NsRecordReader and nsrec read these files too.
+ * Layer, tract and condition names are stored once, in an NS_REC_NAME
+ * record written by rank 0, and are referred to by their index.
+ */
+
+enum NsRecordType {
+    NS_REC_NAME            = 1, // id: name index; id2: length in bytes
+    NS_REC_SCORE           = 2, // id: condition; id2: layer; values: target
+                                // size, hits, extras
+    NS_REC_NUM_ACTIVE      = 3, // id: layer; values[0]: active units
+    NS_REC_NUM_POTENTIATED = 4, // id: tract; values[0]: potentiated
+                                // connections
+    NS_REC_TIMING          = 5, // id: MPI rank (0 for ns); values: total,
+                                // run and network construction (ns) or
+                                // setup (MPI engines) time in seconds
+    NS_REC_UNIT            = 6, // id: layer; id2: unit index;
+                                // values[0]: active
+    NS_REC_CONN            = 7  // id: tract; id2, id3: from-unit and
+                                // to-unit indices; values: PSD size,
+                                // CI-AMPARs, CP-AMPARs;
+                                // flags: NS_REC_POTENTIATED, NS_REC_HEBBIAN
+};
+
+enum NsRecordFlags {
+    NS_REC_POTENTIATED = 1,
+    NS_REC_HEBBIAN     = 2
+};
+
+static const uint32_t recordFileVersion = 2;
+
+struct NsRecordFileHeader {
+    char     magic[4];    // "NSRO"
+    uint32_t version;
+    uint32_t recordSize;  // sizeof(NsRecord)
+    uint32_t replicate;
+    uint32_t numRanks;    // 1 for ns, number of ranks for the MPI engines
+};
+
+struct NsRecord {
+    uint16_t type;
+    uint16_t flags;
+    uint32_t id;
+    uint32_t id2;
+    uint32_t id3;
+    double   time;        // simTime in days
+    double   values[3];
+};
+
+void output_open(const char *prefix);
+uint32_t output_name(const string &name);
+void output_record(NsRecordType type, uint32_t id, uint32_t id2,
+                   uint32_t id3, double v0, double v1 = 0.0,
+                   double v2 = 0.0, uint16_t flags = 0);
+void output_flush();
+void output_close();
+
+#endif
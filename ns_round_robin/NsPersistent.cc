@@ -0,0 +1,125 @@
+#include <string>
+#include <mpi.h>
+#ifdef OPEN_MPI
+#include <mpi-ext.h>
+#endif
+
+#include "NsPersistent.hh"
+#include "NsGlobals.hh"
+#include "Trace.hh"
+
+#if MPI_VERSION >= 4
+#define NS_ALLGATHERV_INIT MPI_Allgatherv_init
+#elif defined(OMPI_HAVE_MPI_EXT_PCOLLREQ) && OMPI_HAVE_MPI_EXT_PCOLLREQ
+#define NS_ALLGATHERV_INIT MPIX_Allgatherv_init
+#endif
+
+NsSyncMode sync_mode = NS_SYNC_OFF;
+
+static const int planTag = 4711;
+
+/**
+ * Set sync_mode from the persistentSync property
+ */
+void init_sync_mode()
+{
+    string mode = props.getString("persistentSync", "on");
+    if (mode == "off") {
+        sync_mode = NS_SYNC_OFF;
+    } else if (mode == "p2p") {
+        sync_mode = NS_SYNC_P2P;
+    } else if (mode == "on") {
+#ifdef NS_ALLGATHERV_INIT
+        sync_mode = NS_SYNC_COLLECTIVE;
+#else
+        sync_mode = NS_SYNC_P2P;
+#endif
+    } else {
+        TRACE_FATAL("Bad persistentSync value: {}", mode);
+    }
+}
+
+const char *sync_mode_name(NsSyncMode mode)
+{
+    switch (mode) {
+    case NS_SYNC_OFF:        return "off";
+    case NS_SYNC_COLLECTIVE: return "collective";
+    case NS_SYNC_P2P:        return "p2p";
+    }
+    return "?";
+}
+
+/**
+ * Add the requests of a persistent MPI_Allgatherv to a plan, using the
+ * current sync_mode (which must not be NS_SYNC_OFF). Arguments are as for
+ * MPI_Allgatherv, including MPI_IN_PLACE for intracommunicators and
+ * intercommunicators, where each group gathers the blocks of the other.
+ */
+void plan_allgatherv(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                     void *recvbuf, const int *recvcounts, const int *displs,
+                     MPI_Datatype recvtype, MPI_Comm comm, NsSyncPlan &plan)
+{
+    MPI_Request req;
+
+#ifdef NS_ALLGATHERV_INIT
+    if (sync_mode == NS_SYNC_COLLECTIVE) {
+        NS_ALLGATHERV_INIT(sendbuf, sendcount, sendtype, recvbuf,
+                           recvcounts, displs, recvtype, comm,
+                           MPI_INFO_NULL, &req);
+        plan.push_back(req);
+        return;
+    }
+#endif
+
+    // Point-to-point schedule: send our block to, and receive a block
+    // from, every rank of the (remote) group
+    //
+    int isInter;
+    int myRank;
+    int numPeers;
+    MPI_Aint lb;
+    MPI_Aint extent;
+    MPI_Comm_test_inter(comm, &isInter);
+    MPI_Comm_rank(comm, &myRank);
+    if (isInter) {
+        MPI_Comm_remote_size(comm, &numPeers);
+    } else {
+        MPI_Comm_size(comm, &numPeers);
+    }
+    MPI_Type_get_extent(recvtype, &lb, &extent);
+    char *recvBytes = static_cast<char *>(recvbuf);
+
+    bool inPlace = (sendbuf == MPI_IN_PLACE);
+    if (inPlace) {
+        sendbuf = recvBytes + displs[myRank] * extent;
+        sendcount = recvcounts[myRank];
+        sendtype = recvtype;
+    }
+
+    for (int peer = 0; peer < numPeers; peer++) {
+        if (inPlace && !isInter && peer == myRank) continue;
+        MPI_Recv_init(recvBytes + displs[peer] * extent, recvcounts[peer],
+                      recvtype, peer, planTag, comm, &req);
+        plan.push_back(req);
+    }
+    for (int peer = 0; peer < numPeers; peer++) {
+        if (inPlace && !isInter && peer == myRank) continue;
+        MPI_Send_init(sendbuf, sendcount, sendtype, peer, planTag, comm, &req);
+        plan.push_back(req);
+    }
+}
+
+void plan_start(NsSyncPlan &plan)
+{
+    if (!plan.empty()) {
+        MPI_Startall(plan.size(), plan.data());
+    }
+}
+
+void plan_free(NsSyncPlan &plan)
+{
+    for (auto &req : plan) {
+        MPI_Request_free(&req);
+    }
+    plan.clear();
+}
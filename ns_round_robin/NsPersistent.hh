@@ -0,0 +1,42 @@
+#ifndef NS_PERSISTENT_HH
+#define NS_PERSISTENT_HH
+
+#include <vector>
+#include <mpi.h>
+
+/**
+ * Persistent plans for the activation exchange
+ *
+ * The exchange in synchronize() runs with the same buffers, counts and
+ * displacements thousands of times per run, so it is set up once as a
+ * persistent plan: a single persistent collective request where the MPI
+ * library provides one (MPI-4 MPI_Allgatherv_init, or Open MPI's
+ * MPIX_Allgatherv_init extension), or else a schedule of persistent
+ * point-to-point requests. A plan is run with plan_start() followed by
+ * MPI_Waitall() on its requests.
+ *
+ * The persistentSync property selects the mode:
+ *   on  - persistent collective if available, else point-to-point (default)
+ *   p2p - persistent point-to-point schedule
+ *   off - a (non-)blocking collective per call, as before
+ */
+enum NsSyncMode {
+    NS_SYNC_OFF,
+    NS_SYNC_COLLECTIVE,
+    NS_SYNC_P2P
+};
+
+extern NsSyncMode sync_mode;
+
+void init_sync_mode();
+const char *sync_mode_name(NsSyncMode mode);
+
+typedef std::vector<MPI_Request> NsSyncPlan;
+
+void plan_allgatherv(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                     void *recvbuf, const int *recvcounts, const int *displs,
+                     MPI_Datatype recvtype, MPI_Comm comm, NsSyncPlan &plan);
+void plan_start(NsSyncPlan &plan);
+void plan_free(NsSyncPlan &plan);
+
+#endif
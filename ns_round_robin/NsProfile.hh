@@ -0,0 +1,51 @@
+#ifndef NS_PROFILE_HH
+#define NS_PROFILE_HH
+
+/**
+ * Simulation phases, for MPI profiling with mpiP
+ *
+ * In a build with -DNS_MPIP (make ns_mpip), mpiP profiling is switched
+ * off right after MPI_Init, and only switched on while the program is
+ * inside one of the phases listed in the mpipPhases property (all phases
+ * by default). Phases nest: e.g. synchronize is part of settle, which is
+ * part of test. Running once per phase yields per-phase mpiP callsite
+ * statistics.
+ *
+ * Without NS_MPIP, all of this compiles to nothing.
+ */
+enum NsPhase {
+    NS_PHASE_CONSTRUCTION,
+    NS_PHASE_TRAINING,
+    NS_PHASE_SETTLE,
+    NS_PHASE_SYNCHRONIZE,
+    NS_PHASE_MAINTAIN,
+    NS_PHASE_TEST,
+    NS_PHASE_OUTPUT,
+    NS_NUM_PHASES
+};
+
+#ifdef NS_MPIP
+void profile_init();
+void profile_select_phases();
+void profile_begin(NsPhase phase);
+void profile_end(NsPhase phase);
+#else
+inline void profile_init() {}
+inline void profile_select_phases() {}
+inline void profile_begin(NsPhase) {}
+inline void profile_end(NsPhase) {}
+#endif
+
+/**
+ * Marks the enclosing scope as part of a phase
+ */
+class NsProfileRegion {
+public:
+    NsProfileRegion(NsPhase phase) : phase(phase) { profile_begin(phase); }
+    ~NsProfileRegion() { profile_end(phase); }
+
+private:
+    const NsPhase phase;
+};
+
+#endif
@@ -1,14 +1,16 @@
 #include "NsSystem.hh"
+#include "NsOutput.hh"
+#include "NsProfile.hh"
 
 /**
  * Constructor
- * @param props Properties
+ * @param params Parameters
  */
-NsSystem::NsSystem(Props &props)
-    : trainNumStimCycles(props.getUint("trainNumStimCycles")),
-      consNumStimCycles(props.getUint("consNumStimCycles")),
-      reactNumStimCycles(props.getUint("reactNumStimCycles")),
-      numSettleCycles(props.getUint("numSettleCycles"))
+NsSystem::NsSystem(const NsSystemParams &params)
+    : trainNumStimCycles(params.trainNumStimCycles),
+      consNumStimCycles(params.consNumStimCycles),
+      reactNumStimCycles(params.reactNumStimCycles),
+      numSettleCycles(params.numSettleCycles)
 {
 }
 
@@ -18,9 +20,17 @@ NsSystem::NsSystem(Props &props)
  */
 void NsSystem::addLayer(const string &id, const string &type)
 {
+    // All ranks add the same layers and tracts in the same order, so
+    // their record name indices agree
+    output_name(id);
+
     NsLayer *layer = new NsLayer(id, type);
     std::pair<string, NsLayer *> pair(id, layer);
     layers.insert(pair);
+    layer->intID = layers_vec.size();
+    layers_vec.push_back(layer);
+    inTracts.push_back(vector<NsTract *>());
+    outTracts.push_back(vector<NsTract *>());
 }
 
 /**
@@ -38,10 +48,15 @@ void NsSystem::addTract(const string &fromLayerId,
     NsLayer *fromLayer = layers.at(fromLayerId);
     NsLayer *toLayer = layers.at(toLayerId);
 
+    output_name(id);
     NsTract *tract =
         new NsTract(id, fromLayer, toLayer, type);
     std::pair<string, NsTract *> pair(id, tract);
     tracts.insert(pair);
+    tract->intID = tracts_vec.size();
+    tracts_vec.push_back(tract);
+    inTracts[toLayer->intID].push_back(tract);
+    outTracts[fromLayer->intID].push_back(tract);
 }
 
 /**
@@ -63,8 +78,8 @@ void NsSystem::addBiTract(const string &layer1Id, const string &layer2Id,
  */
 void NsSystem::calcRates()
 {
-    for (auto &t : tracts) {
-        t.second->calcRates();
+    for (auto t : tracts_vec) {
+        t->calcRates();
     }
 }
 
@@ -73,8 +88,8 @@ void NsSystem::calcRates()
  */
 void NsSystem::acquire(uint numStimCycles, const char *tag)
 {
-    for (auto &t : tracts) {
-        t.second->acquire(numStimCycles, tag);
+    for (auto t : tracts_vec) {
+        t->acquire(numStimCycles, tag);
     }
 }
 
@@ -85,23 +100,30 @@ void NsSystem::acquire(uint numStimCycles, const char *tag)
  */
 void NsSystem::settle()
 {
+    NsProfileRegion region(NS_PHASE_SETTLE);
+
     for (uint c = 0; c < numSettleCycles; c++) {
-        for (auto &l : layers) {
-            if (!l.second->isFrozen) {
-                l.second->computeNewActivations();
+        for (auto l : layers_vec) {
+            if (!l->isFrozen) {
+                l->computeNewActivations();
             }
         }
-        for (auto &l : layers) {
-            if (!l.second->isFrozen) {
-                l.second->applyNewActivations();
+        // With node-shared activations, nobody may update their units
+        // until everyone on the node has computed theirs.
+        //
+        fence_global_activations();
+
+        for (auto l : layers_vec) {
+            if (!l->isFrozen) {
+                l->applyNewActivations();
             }
         }
 
         synchronize();
 
-        for (auto &l : layers) {
-            if (!l.second->isFrozen) {
-                l.second->adjustInhibition();
+        for (auto l : layers_vec) {
+            if (!l->isFrozen) {
+                l->adjustInhibition();
             }
         }
     }
@@ -134,12 +156,12 @@ void NsSystem::consolidate()
     // Activate and clamp a randomly chosen defined pattern in
     // the HPC layer
     //
-    const string &hpcPid = hpcLayer->setRandomPattern();
+    NsPatternHandle hpcPid = hpcLayer->setRandomPattern();
     hpcLayer->isClamped = true;
 
 #else
     // Randomize the HPC layer
-    const string &hpcPid = "";
+    NsPatternHandle hpcPid = noPattern;
     hpcLayer->randomize();
 #endif
 
@@ -151,8 +173,8 @@ void NsSystem::consolidate()
     
     // Learn the pattern settled into: PSD growth
     //
-    for (auto &t : tracts) {
-        t.second->consolidate(consNumStimCycles);
+    for (auto t : tracts_vec) {
+        t->consolidate(consNumStimCycles);
     }
 }
 
@@ -161,11 +183,13 @@ void NsSystem::consolidate()
  */
 void NsSystem::maintain()
 {
-    for (auto &t : tracts) {
-        t.second->maintain();
+    NsProfileRegion region(NS_PHASE_MAINTAIN);
+
+    for (auto t : tracts_vec) {
+        t->maintain();
     }
-    for (auto &l : layers) {
-        l.second->maintain();
+    for (auto l : layers_vec) {
+        l->maintain();
     }
 }
 
@@ -174,9 +198,9 @@ void NsSystem::maintain()
  */
 void NsSystem::clear()
 {
-    for (auto &l : layers) {
-        l.second->clear();
-        l.second->isClamped = false;
+    for (auto l : layers_vec) {
+        l->clear();
+        l->isClamped = false;
     }
 }
 
@@ -220,7 +244,8 @@ void NsSystem::retrieve(const string &cueLayerId,
     // Set and clamp the specified pattern in the cue layer
     //
     NsLayer *cueLayer = layers.at(cueLayerId);
-    cueLayer->setPattern(patternId);
+    NsPatternHandle target = findPattern(patternId);
+    cueLayer->setPattern(target);
     cueLayer->isClamped = true;
 
     printGrids(fmt::format("{}-present", condition));
@@ -228,7 +253,7 @@ void NsSystem::retrieve(const string &cueLayerId,
     // Cycle until settled
     //
     settle();
-    printGrids(fmt::format("{}-settled", condition), patternId);
+    printGrids(fmt::format("{}-settled", condition), target);
 }
 
 /**
@@ -243,8 +268,8 @@ void NsSystem::test(const string &cueLayerId, const string &patternId,
 {
     // Record inhibition levels before the test
     //
-    for (auto l : layers) {
-        l.second->saveInhibition();
+    for (auto l : layers_vec) {
+        l->saveInhibition();
     }
 
     // Do the test
@@ -254,8 +279,8 @@ void NsSystem::test(const string &cueLayerId, const string &patternId,
     // Restore inhibition levels, in order to leave the system unaffected by
     // the test.
     //
-    for (auto l : layers) {
-        l.second->restoreInhibition();
+    for (auto l : layers_vec) {
+        l->restoreInhibition();
     }
 }
 
@@ -279,8 +304,8 @@ void NsSystem::reactivate()
 
     // Execute reactivation logic in all tracts
     //
-    for (auto &t : tracts) {
-        t.second->reactivate();
+    for (auto t : tracts_vec) {
+        t->reactivate();
     }
 
     // Patterns should disappear from HPC layer's (really, any layer's)
@@ -302,60 +327,65 @@ void NsSystem::reactivate()
 }
 
 /**
- * Toggle PSI on or off in all tracts that terminate on the
+ * Toggle PSI on or off in all tracts that start or terminate on the
  * specified layer.
  */
 void NsSystem::togglePsi(string layerId, bool state)
 {
     NsLayer *layer = getLayer(layerId);
-    for (auto &t : tracts) {
-        if (t.second->fromLayer == layer || t.second->toLayer == layer) {
-            t.second->togglePsi(state);
-        }
+    for (auto t : inTracts[layer->intID]) {
+        t->togglePsi(state);
+    }
+    for (auto t : outTracts[layer->intID]) {
+        t->togglePsi(state);
     }
 }
 
 void NsSystem::printStateHdrs()
 {
-    NsConnection::printStateHdr();
-    NsUnit::printStateHdr();
     NsLayer::printScoreHdr();
     NsLayer::printNumActiveHdr();
     NsTract::printNumPotentiatedHdr();
 }
 
+/**
+ * Print layer and tract summaries, and write unit and connection state to
+ * the record file. Must be called by all ranks.
+ */
 void NsSystem::printState() const
 {
-    for (auto &l : layers) {
-        l.second->printState();
+    NsProfileRegion region(NS_PHASE_OUTPUT);
+
+    for (auto l : layers_vec) {
+        l->printState();
     }
-    for (auto &t : tracts) {
-        t.second->printState();
+    for (auto t : tracts_vec) {
+        t->printState();
     }
+    output_flush();
 }
 
-void NsSystem::printGrids(const string &tag,
-                          const string &targetId) const
+void NsSystem::printGrids(const string &tag, NsPatternHandle target) const
 {
-    for (auto &l : layers) {
-        l.second->printGrid(tag, targetId);
+    for (auto l : layers_vec) {
+        l->printGrid(tag, target);
     }
 }
 
 void NsSystem::printSize()
 {
     uint tot = 0;
-    for (auto &l : layers) {
-        uint n = l.second->units.size();
-        infoTrace("Layer {}: {} units\n", l.second->id, n);
+    for (auto l : layers_vec) {
+        uint n = l->units.size();
+        infoTrace("Layer {}: {} units\n", l->id, n);
         tot += n;
     }
     infoTrace("Total: {} units\n", tot);
 
     tot = 0;
-    for (auto &t : tracts) {
-        uint n = t.second->connections.size();
-        infoTrace("Tract {}: {} connections\n", t.second->id, n);
+    for (auto t : tracts_vec) {
+        uint n = t->connections.size();
+        infoTrace("Tract {}: {} connections\n", t->id, n);
         tot += n;
     }
     infoTrace("Total: {} connections\n", tot);
@@ -365,11 +395,11 @@ void NsSystem::printSize()
 string NsSystem::toStr(uint iLvl, const string &iStr) const
 {
     string ret = Util::repeatStr(iStr, iLvl) + "NsSystem:";
-    for (auto &l : layers) {
-        ret += "\n" + l.second->toStr(iLvl + 1, iStr);
+    for (auto l : layers_vec) {
+        ret += "\n" + l->toStr(iLvl + 1, iStr);
     }
-    for (auto &t : tracts) {
-        ret += "\n" + t.second->toStr(iLvl + 1, iStr);
+    for (auto t : tracts_vec) {
+        ret += "\n" + t->toStr(iLvl + 1, iStr);
     }
 
     return ret;
@@ -11,6 +11,8 @@ using std::unordered_map;
 #include "NsLayer.hh"
 #include "NsTract.hh"
 #include "NsPattern.hh"
+#include "NsGlobals.hh"
+#include "NsParams.hh"
 
 
 static const string hpcLayerId = "HPC";
@@ -26,12 +28,12 @@ static const string ncLayerTypeId  = "nc";
 
 /**
  * Output trace message (without locator) if traceLevel is
- * INFO or lower
+ * INFO or lower. Only rank 0 produces human-readable output.
  */
 template <typename... Args>
 void infoTrace(const char *fmt, Args ... args)
 {
-    if (TRACE_INFO_IS_ON) {
+    if (TRACE_INFO_IS_ON && rank == 0) {
         fmt::vprint(stdout, fmt, fmt::make_format_args(args...));
     }
 }
@@ -43,7 +45,7 @@ void infoTrace(const char *fmt, Args ... args)
 template <typename... Args>
 void info1Trace(const char *fmt, Args ... args)
 {
-    if (TRACE_INFO1_IS_ON) {
+    if (TRACE_INFO1_IS_ON && rank == 0) {
         fmt::vprint(stdout, fmt, fmt::make_format_args(args...));
     }
 }
@@ -55,7 +57,7 @@ void info1Trace(const char *fmt, Args ... args)
 template <typename... Args>
 void debugTrace(const char *fmt, Args ... args)
 {
-    if (TRACE_DEBUG_IS_ON) {
+    if (TRACE_DEBUG_IS_ON && rank == 0) {
         fmt::vprint(stdout, fmt, fmt::make_format_args(args...));
     }
 }
@@ -64,7 +66,7 @@ void debugTrace(const char *fmt, Args ... args)
 class NsSystem {
 public:
     NsSystem() {}
-    NsSystem(Props &props);
+    NsSystem(const NsSystemParams &params);
 
     void addLayer(const string &id, const string &type);
     void addTract(const string &fromLayerId, const string &toLayerId,
@@ -97,17 +99,31 @@ public:
     void togglePsi(string layerId, bool state);
     static void printStateHdrs();
     void printState() const;
-    void printGrids(const string &tag, const string &targetId = "") const;
+    void printGrids(const string &tag,
+                    NsPatternHandle target = noPattern) const;
 
     NsLayer *getLayer(const string &id) { return layers.at(id); }
+    NsLayer *getLayer(uint intID) { return layers_vec[intID]; }
     NsTract *getTract(const string &id) { return tracts.at(id); }
+    NsTract *getTract(uint intID) { return tracts_vec[intID]; }
 
     void printSize();
     string toStr(uint iLvl = 0, const string &iStr = "   ") const;
 
+    // Layers and tracts by ID, for lookups when events are scheduled
+    //
     unordered_map<string, NsLayer *> layers;
     unordered_map<string, NsTract *> tracts;
 
+    // Layers and tracts by intID, i.e. in order of creation, and the
+    // tracts to and from each layer. All phases iterate these, so that
+    // random numbers are drawn in the same order in every run.
+    //
+    vector<NsLayer *> layers_vec;
+    vector<NsTract *> tracts_vec;
+    vector<vector<NsTract *>> inTracts;     // per layer intID
+    vector<vector<NsTract *>> outTracts;    // per layer intID
+
     uint trainNumStimCycles;
     uint consNumStimCycles;
     uint reactNumStimCycles;
@@ -1,52 +1,36 @@
 #include <limits.h>
 #include <float.h>
+#include <mpi.h>
 
 #include "NsSystem.hh"
 #include "NsTract.hh"
 
 
-#define CHECK_RANGE(val, min, max) \
-    ABORT_UNLESS(Util::isInRange(val, min, max), \
-                 "bad value for '{}': {}", #val, val)
-
 
 NsTract::NsTract(const string &id,
                  NsLayer *fromLayer,
                  NsLayer *toLayer,
                  const string &type)
-    : id(id), type(type), fromLayer(fromLayer), toLayer(toLayer),
+    : id(id), type(type), params(params_tract(type)),
+      fromLayer(fromLayer), toLayer(toLayer),
       e3Level(0), lastE3Level(DBL_MAX), lastTimeStep(UINT_MAX)
 {
-    acqLearnRate            = props.getDouble(type + '.' + "acqLearnRate");
-    reactE3Level            = props.getDouble(type + '.' + "reactE3Level");
-    consLearnRate01h        = props.getDouble(type + '.' + "consLearnRate01h");
-    psdDecayRate01h         = props.getDouble(type + '.' + "psdDecayRate01h");
-    cpAmparRemovalRate01h   = props.getDouble(type + '.' + "cpAmparRemovalRate01h");
-    ciAmparInsertionRate01h = props.getDouble(type + '.' + "ciAmparInsertionRate01h");
-    ciAmparRemovalRate01h   = props.getDouble(type + '.' + "ciAmparRemovalRate01h");
-    baseDepotProb01h        = props.getDouble(type + '.' + "baseDepotProb01h");
-    maxE3DepotProb01h       = props.getDouble(type + '.' + "maxE3DepotProb01h");
-    e3DecayRate01h          = props.getDouble(type + '.' + "e3DecayRate01h");
-    maxPotProb01h           = props.getDouble(type + '.' + "maxPotProb01h");
-    
-    
-    // Sanity check
+    // Only the inbound connections of units owned by this rank, allocated
+    // in one block. The capacity is reserved, so that the connections do
+    // not move while they are added to their to-units.
     //
-    CHECK_RANGE(acqLearnRate,            0.0, 1.0);
-    CHECK_RANGE(reactE3Level,            0.0, 1.0);
-    CHECK_RANGE(consLearnRate01h,        0.0, 1.0);
-    CHECK_RANGE(psdDecayRate01h,         0.0, 1.0);
-    CHECK_RANGE(cpAmparRemovalRate01h,   0.0, 1.0);
-    CHECK_RANGE(ciAmparRemovalRate01h,   0.0, 1.0);
-    CHECK_RANGE(baseDepotProb01h,        0.0, 1.0);
-    CHECK_RANGE(e3DecayRate01h,          0.0, 1.0);
-    CHECK_RANGE(maxE3DepotProb01h,       0.0, 1.0);
-    CHECK_RANGE(maxPotProb01h,           0.0, 1.0);
-
-    for (auto fu : fromLayer->layer_gids) {
+    uint numConnections = fromLayer->num_units * toLayer->units.size();
+    connectionSlab.reserve(numConnections);
+    connections.reserve(numConnections);
+    for (auto tu : toLayer->units) {
+        tu->inConnections.reserve(tu->inConnections.size() + fromLayer->num_units);
+    }
+    for (uint i = 0; i < fromLayer->num_units; i++) {
+        uint fu = fromLayer->global_displacement + i;
         for (auto tu : toLayer->units) {
             if (fu != tu->gid) {
-                connections.push_back(new NsConnection(this, fu, tu));
+                connectionSlab.emplace_back(this, fu, tu);
+                connections.push_back(&connectionSlab.back());
             }
         }
     }
@@ -103,17 +87,17 @@ static double calcConstantRate(double rateA, double intervalA, double intervalB)
  */
 void NsTract::calcRates()
 {
-    consLearnRate        = calcExpDecayRate(consLearnRate01h, 1.0, timeStep);
-    psdDecayRate         = calcExpDecayRate(psdDecayRate01h, 1.0, timeStep);
-    cpAmparRemovalRate   = calcExpDecayRate(cpAmparRemovalRate01h, 1.0,
+    consLearnRate        = calcExpDecayRate(params.consLearnRate01h, 1.0, timeStep);
+    psdDecayRate         = calcExpDecayRate(params.psdDecayRate01h, 1.0, timeStep);
+    cpAmparRemovalRate   = calcExpDecayRate(params.cpAmparRemovalRate01h, 1.0,
                                             timeStep);
-    ciAmparInsertionRate = calcConstantRate(ciAmparInsertionRate01h, 1.0,
+    ciAmparInsertionRate = calcConstantRate(params.ciAmparInsertionRate01h, 1.0,
                                           timeStep);
-    ciAmparRemovalRate   = calcExpDecayRate(ciAmparRemovalRate01h, 1.0,
+    ciAmparRemovalRate   = calcExpDecayRate(params.ciAmparRemovalRate01h, 1.0,
                                             timeStep);
-    baseDepotProb        = calcProb(baseDepotProb01h, 1.0, timeStep);
-    e3DecayRate          = calcExpDecayRate(e3DecayRate01h, 1.0, timeStep);
-    maxPotProb           = calcProb(maxPotProb01h, 1.0, timeStep);
+    baseDepotProb        = calcProb(params.baseDepotProb01h, 1.0, timeStep);
+    e3DecayRate          = calcExpDecayRate(params.e3DecayRate01h, 1.0, timeStep);
+    maxPotProb           = calcProb(params.maxPotProb01h, 1.0, timeStep);
     calcDepotProb();
 }
 
@@ -129,7 +113,7 @@ inline void NsTract::calcDepotProb()
     // Don't waste time if nothing changed
     //
     if (e3Level != lastE3Level || timeStep != lastTimeStep) {
-        double e3DepotProb01h = maxE3DepotProb01h * e3Level;
+        double e3DepotProb01h = params.maxE3DepotProb01h * e3Level;
         e3DepotProb = calcProb(e3DepotProb01h, 1.0, timeStep);
         depotProb = baseDepotProb + e3DepotProb - baseDepotProb * e3DepotProb;
 
@@ -150,7 +134,7 @@ void NsTract::stimulate(double learnRate, uint numStimCycles,
 
 void NsTract::acquire(uint numStimCycles, const char *tag)
 {
-    stimulate(acqLearnRate, numStimCycles, tag);
+    stimulate(params.acqLearnRate, numStimCycles, tag);
 }
 
 void NsTract::consolidate(uint numStimCycles)
@@ -219,7 +203,7 @@ void NsTract::reactivate()
     //   terminating on the units selected in makePattern below? i.e. units
     //   activated by reactivation.
     //
-    e3Level = reactE3Level;
+    e3Level = params.reactE3Level;
     calcDepotProb();
 
     for (auto c: connections) {
@@ -252,11 +236,15 @@ void NsTract::printNumPotentiatedHdr()
 }
 
 /**
- * Print number of potentiated connections in the tract
+ * Print number of potentiated connections in the tract (summed over
+ * all ranks). Must be called by all ranks.
  */
 void NsTract::printNumPotentiated() const
 {
-    infoTrace("{} tract {} {}\n", simTime, id, getNumPotentiated());
+    uint numPotentiated = getNumPotentiated();
+    MPI_Reduce(rank == 0 ? MPI_IN_PLACE : &numPotentiated,
+               &numPotentiated, 1, MPI_UINT32_T, MPI_SUM, 0, sim_comm);
+    infoTrace("{} tract {} {}\n", simTime, id, numPotentiated);
 }
 
 /**
@@ -278,7 +266,7 @@ string NsTract::toStr(uint iLvl, const string &iStr) const
     string ret = fmt::format("{}NsTract[{}]: ",
                              Util::repeatStr(iStr, iLvl), id);
     ret += fmt::format("\n{}acqLearnRate={}",
-                       Util::repeatStr(iStr, iLvl + 1), acqLearnRate);
+                       Util::repeatStr(iStr, iLvl + 1), params.acqLearnRate);
     ret += fmt::format("\n{}consLearnRate={}",
                        Util::repeatStr(iStr, iLvl + 1), consLearnRate);
 
@@ -34,13 +34,15 @@ public:
     string toStr(uint iLvl = 0, const string &iStr = "   ") const;
 
     string id;
+    uint intID;         // index in NsSystem::tracts_vec
     vector<NsConnection *> connections;
+    vector<NsConnection> connectionSlab;  // the connections, in one block
     string type;
+    const NsTractParams &params;
     NsLayer *fromLayer;
     NsLayer *toLayer;
 
     double e3Level; // E3 enzyme level between 0.0 and 1.0
-    double reactE3Level; // E3 level after reactivation
 
     // These are used to avoid useless calculations
     //
@@ -52,13 +54,9 @@ public:
     //
     double depotProb;
 
-    // Acquisition is simulated as a one-shot event, so not scaled to
-    // timeStep.
-    //
-    double acqLearnRate;
-
     // These rates and probabilities are per timeStep. They are calculated
-    // from the 01h rates, which are read from the property file
+    // from the 01h rates of params. Acquisition is simulated as a one-shot
+    // event, so params.acqLearnRate is not scaled to timeStep.
     //
     double consLearnRate;
     double psdDecayRate;
@@ -69,19 +67,6 @@ public:
     double e3DepotProb;
     double e3DecayRate;
     double maxPotProb;
-
-    // The 01h values for traffic rates and probabilities
-    //
-    double consLearnRate01h;
-    double psdDecayRate01h;
-    double cpAmparRemovalRate01h;
-    double ciAmparInsertionRate01h;
-    double ciAmparRemovalRate01h;
-    double baseDepotProb01h;
-    double maxE3DepotProb01h; // 01h prob of E3-induced depot when e3Level = 1.0
-    double e3DepotProb01h;
-    double e3DecayRate01h;
-    double maxPotProb01h;
 };
 
 /**
@@ -2,13 +2,13 @@
 #include "NsUnit.hh"
 #include "MathUtil.hh"
 #include "NsGlobals.hh"
+#include "NsOutput.hh"
 
 NsUnit::NsUnit(const NsLayer *layer, uint index, uint gid)
     : layer(layer), 
       id(layer->id + "." + fmt::format("{:02}", index)),
       gid(gid),
-      actFuncK(props.getDouble("actFuncK")),
-      actThreshold(props.getDouble("actThreshold")),
+      params(params_unit()),
       isFrozen(false),
       isActive(&global_activations[gid]),
       newIsActive(0),
@@ -23,10 +23,10 @@ NsUnit::NsUnit(const NsLayer *layer, uint index, uint gid)
  */
 uint8_t NsUnit::activationFunction(double netInput)
 {
-    if (netInput <= actThreshold) return 0;
+    if (netInput <= params.actThreshold) return 0;
 
     double probOfActivation =
-        MathUtil::asigmoid(netInput, actFuncK, layer->inhibition);
+        MathUtil::asigmoid(netInput, params.actFuncK, layer->inhibition);
     //infoTrace("XXX {}\n", netInput);
 
     uint8_t ret = Util::randDouble(0.0, 1.0) < probOfActivation;
@@ -93,14 +93,13 @@ void NsUnit::maintain()
 {
 }
 
-void NsUnit::printStateHdr()
-{
-    infoTrace("time unit ID ACTIVE\n");
-}
-
+/**
+ * Write the unit's state to the record file
+ */
 void NsUnit::printState() const
 {
-    infoTrace("{} unit {} {}\n", simTime / 24., id, *isActive ? 'a' : 'i');
+    output_record(NS_REC_UNIT, output_name(layer->id),
+                  gid - layer->global_displacement, 0, *isActive);
 }
 
 string NsUnit::toStr(uint iLvl, const string &iStr) const
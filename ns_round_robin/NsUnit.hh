@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <string>
 
+#include "NsParams.hh"
+
 using std::string;
 
 class NsLayer;
@@ -17,15 +19,13 @@ public:
     void applyNewActivation();
     void setFrozen(bool state);
     void maintain();
-    static void printStateHdr();
     void printState() const;
     string toStr(uint iLvl = 0, const string &iStr = "   ") const;
 
     const NsLayer *layer;
     const string id;
     const uint gid;
-    double actFuncK;
-    double actThreshold;
+    const NsUnitParams &params;
     bool isFrozen;
     uint8_t *isActive;
     uint8_t newIsActive;
@@ -3,11 +3,19 @@
  *
  * Copy selected columns from input to output
  *
+ * The input is memory-mapped if it is a regular file, and otherwise read
+ * in large blocks. Lines are found with memchr, and the selected columns
+ * are copied from the input to an output buffer as slices, without
+ * copying each token into a string of its own.
+ *
  * Author: Peter Helfer
  * Date: 2016-12-10
  */
 
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <vector>
 #include <string>
 using std::string;
@@ -45,6 +53,118 @@ void fail(string file, uint line, const char *format, const T & ... args)
     exit(1);
 }
 
+/**
+ * Input, read a line at a time
+ */
+class LineReader {
+public:
+    LineReader(FILE *fp)
+        : fd(fileno(fp))
+    {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                madvise(p, st.st_size, MADV_SEQUENTIAL);
+                mapped = (const char *) p;
+                mappedSize = st.st_size;
+                pos = mapped;
+                end = mapped + mappedSize;
+                eof = true;
+                return;
+            }
+        }
+        buf.resize(blockSize);
+        pos = end = buf.data();
+    }
+
+    ~LineReader()
+    {
+        if (mapped != NULL) {
+            munmap((void *) mapped, mappedSize);
+        }
+    }
+
+    /**
+     * Get the next line, without its newline
+     * @return false at the end of the input
+     */
+    bool nextLine(const char *&lineBegin, const char *&lineEnd)
+    {
+        const char *nl;
+        while ((nl = (const char *) memchr(pos, '\n', end - pos)) == NULL) {
+            if (eof) {
+                if (pos == end) return false;
+                lineBegin = pos;
+                lineEnd = pos = end;
+                return true;
+            }
+            fill();
+        }
+        lineBegin = pos;
+        lineEnd = nl;
+        pos = nl + 1;
+        return true;
+    }
+
+private:
+    static const size_t blockSize = 1 << 20;
+
+    /**
+     * Read another block, keeping the partial line at the end of the
+     * buffer
+     */
+    void fill()
+    {
+        size_t keep = end - pos;
+        if (keep > 0 && pos != buf.data()) {
+            memmove(buf.data(), pos, keep);
+        }
+        if (buf.size() - keep < blockSize) {
+            buf.resize(keep + blockSize);
+        }
+        ssize_t n = read(fd, buf.data() + keep, buf.size() - keep);
+        if (n < 0) {
+            perror("read");
+            exit(errno);
+        }
+        eof = (n == 0);
+        pos = buf.data();
+        end = pos + keep + n;
+    }
+
+    int fd;
+    const char *mapped = NULL;
+    size_t mappedSize = 0;
+    std::vector<char> buf;
+    const char *pos;
+    const char *end;
+    bool eof = false;
+};
+
+static bool isSep[256];
+
+/**
+ * Split a line into tokens, as Util::tokenize does (consecutive
+ * separators separate a single token)
+ * @param begin Start of the line
+ * @param end End of the line
+ * @param tokens Set to the begin and end of each token
+ */
+static void splitLine(const char *begin, const char *end,
+                      std::vector<std::pair<const char *, const char *>> &tokens)
+{
+    tokens.clear();
+    const char *p = begin;
+    for (;;) {
+        while (p < end && isSep[(uint8_t) *p]) p++;
+        if (p == end) break;
+        const char *tok = p;
+        while (p < end && !isSep[(uint8_t) *p]) p++;
+        tokens.push_back(std::make_pair(tok, p));
+    }
+}
+
 int main(int argc, char *argv[])
 {
     char *pname = argv[0];
@@ -97,18 +217,21 @@ int main(int argc, char *argv[])
     
     // Parse the header line
     //
-    const uint LINELEN = 2048;
-    char line[LINELEN];
+    for (const char *p = sepChars; *p != '\0'; p++) {
+        isSep[(uint8_t) *p] = true;
+    }
+    LineReader reader(fp);
+    const char *lineBegin, *lineEnd;
     uint lineNum = 1;
-    if (fgets(line, LINELEN, fp) == NULL) {
+    if (!reader.nextLine(lineBegin, lineEnd)) {
         fmt::print(stderr, "{}: failed to read header line\n", fname);
         exit(errno);
     }
-    Util::chop(line);
-    string errMsg;
-    std::vector<string> headers = Util::tokenize(line, sepChars, errMsg);
-    if (!errMsg.empty()) {
-        fail(fname, lineNum, "{}", errMsg);
+    std::vector<std::pair<const char *, const char *>> tokens;
+    splitLine(lineBegin, lineEnd, tokens);
+    std::vector<string> headers;
+    for (auto &tok : tokens) {
+        headers.push_back(string(tok.first, tok.second));
     }
 
     // Determine which columns to copy
@@ -123,7 +246,7 @@ int main(int argc, char *argv[])
         if (*p == '\0') {
             // If colSpec is an int, take it as column number
             //
-            if (colNum > 0 || colNum <= headers.size()) {
+            if (colNum > 0 && colNum <= headers.size()) {
                 columnNumbers.push_back(colNum - 1); // zero-based
             } else {
                 fmt::print(stderr, "invalid column number: {}\n", colNum);
@@ -165,23 +288,30 @@ int main(int argc, char *argv[])
     // Read the rest of the file and copy the
     // selected columns in the specified order
     //
-    while (fgets(line, LINELEN, fp) != NULL) {
-        Util::chop(line);
+    size_t osepLen = strlen(osep);
+    string out;
+    out.reserve(2 << 20);
+    while (reader.nextLine(lineBegin, lineEnd)) {
         lineNum++;
-        std::vector<string> tokens = Util::tokenize(line, sepChars, errMsg);
-        if (!errMsg.empty()) {
-            fail(fname, lineNum, "{}", errMsg);
-        }
+        splitLine(lineBegin, lineEnd, tokens);
         if (tokens.size() != headers.size()) {
+            fwrite(out.data(), 1, out.size(), outFile);
+            fflush(outFile);
             fail(fname, lineNum, "Expected {} columns, found {}",
                  headers.size(), tokens.size());
         }
         for (uint i = 0; i < columnNumbers.size(); i++) {
-            fmt::print(outFile, "{}", tokens[columnNumbers[i]]);
+            auto &tok = tokens[columnNumbers[i]];
+            out.append(tok.first, tok.second - tok.first);
             if (i < columnNumbers.size() - 1) {
-                fmt::print(outFile, "{}", osep);
+                out.append(osep, osepLen);
             }
         }
-        fmt::print(outFile, "\n");
+        out += '\n';
+        if (out.size() >= (1 << 20)) {
+            fwrite(out.data(), 1, out.size(), outFile);
+            out.clear();
+        }
     }
+    fwrite(out.data(), 1, out.size(), outFile);
 }
@@ -0,0 +1,18 @@
+#!/bin/bash
+#SBATCH --job-name=sync
+#SBATCH --output=sync_%j.out
+#SBATCH --nodes=4
+#SBATCH --ntasks=256
+#SBATCH --cpus-per-task=1
+#SBATCH --time=0:30:00
+#SBATCH -p normal
+#SBATCH -A TG-MDE210001
+
+# time the flat, persistent and hierarchical activation exchanges of the
+# largest network at 4 to 256 ranks
+mkdir -p out/sync
+for n in 4 8 16 32 64 128 256; do
+    mpirun -n $n ./ns -tl FATAL syncBenchmark=1000 hierarchicalSync=true \
+        props/b_256_react.props out/sync/sync_$n
+    grep syncbench out/sync/sync_${n}_0.raw | sed "s/^/$n /"
+done